@@ -0,0 +1,145 @@
+// Phase 1 benchmarks: VM instruction throughput on synthetic LR/CR/BT decks
+// and whole-deck runs, serial and batched.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o bench_phase1.exe bench_phase1.cpp
+#define OS_SIM_NO_MAIN
+#include "../phase1.cpp"
+#include "benchmark.h"
+#include "workloads.h"
+
+// Instructions per second of straight-line LR/CR/BT programs; arg 0 is the
+// number of jobs in the deck
+void BM_VM_StraightLine(bench::State& state)
+{
+    string deck = workloads::straightLineDeck((int)state.range(0));
+    long long instructions = 0;
+    for (auto _ : state) {
+        VM vm(deck);
+        instructions += vm.instructionsExecuted();
+    }
+    state.setItemsProcessed(instructions);
+    state.setLabel("items = instructions");
+}
+
+// Instructions per second of card-driven loops; args are iterations per job
+// and LR/CR pairs per iteration
+void BM_VM_CardLoop(bench::State& state)
+{
+    string deck = workloads::cardLoopDeck(1, (int)state.range(0), (int)state.range(1));
+    long long instructions = 0;
+    for (auto _ : state) {
+        VM vm(deck);
+        instructions += vm.instructionsExecuted();
+    }
+    state.setItemsProcessed(instructions);
+    state.setLabel("items = instructions");
+}
+
+// The same loops with the structured event stream instead of the text log
+void BM_VM_CardLoopNdjson(bench::State& state)
+{
+    string deck = workloads::cardLoopDeck(1, (int)state.range(0), (int)state.range(1));
+    long long instructions = 0;
+    for (auto _ : state) {
+        VM vm(deck, FORMAT_NDJSON);
+        instructions += vm.instructionsExecuted();
+    }
+    state.setItemsProcessed(instructions);
+    state.setLabel("items = instructions");
+}
+
+// The same loops with the profiler on, to compare with BM_VM_CardLoop
+void BM_VM_CardLoopProfiled(bench::State& state)
+{
+    string deck = workloads::cardLoopDeck(1, (int)state.range(0), (int)state.range(1));
+    long long instructions = 0;
+    for (auto _ : state) {
+        VM vm(deck, FORMAT_TEXT, nullptr, true);
+        instructions += vm.instructionsExecuted();
+    }
+    state.setItemsProcessed(instructions);
+    state.setLabel("items = instructions");
+}
+
+// Jobs per second through runDeck; arg 0 is the batch thread count (0 = serial)
+void BM_RunDeck(bench::State& state)
+{
+    string deck = workloads::straightLineDeck(256);
+    RunOptions options;
+    options.threads = (int)state.range(0);
+    long long bytes = 0;
+    for (auto _ : state) {
+        runDeck(deck, options, [&bytes](const string& data) {
+            bytes += data.size();
+        });
+    }
+    bench::doNotOptimize(bytes);
+    state.setItemsProcessed(state.iterations() * 256);
+    state.setLabel("items = jobs");
+}
+
+// Jobs per second through batch mode on a deck where one job's GD reads
+// past its data cards; args are the batch threads and that job's index, and
+// the jobs from it on are replayed serially. Fails unless the batch output
+// matches a serial run of the deck.
+void BM_RunDeckReadPastEnd(bench::State& state)
+{
+    string deck = workloads::readPastEndDeck(256, (int)state.range(1));
+    RunOptions options;
+    options.threads = (int)state.range(0);
+
+    string serial, batch;
+    runDeck(deck, RunOptions(), [&serial](const string& data) {
+        serial += data;
+    });
+    runDeck(deck, options, [&batch](const string& data) {
+        batch += data;
+    });
+    if (batch != serial) {
+        cerr << "Error: Batch output differs from the serial run" << endl;
+        exit(1);
+    }
+
+    long long bytes = 0;
+    for (auto _ : state) {
+        runDeck(deck, options, [&bytes](const string& data) {
+            bytes += data.size();
+        });
+    }
+    bench::doNotOptimize(bytes);
+    state.setItemsProcessed(state.iterations() * 256);
+    state.setLabel("items = jobs");
+}
+
+// Jobs per second multiprogrammed in shared paged memory; args are the
+// number of frames, which bounds how many jobs are resident at once, and
+// the spooling buffers (0 = unspooled)
+void BM_Multiprogram(bench::State& state)
+{
+    string deck = workloads::cardLoopDeck(256, 20, 3);
+    RunOptions options;
+    options.frames = (int)state.range(0);
+    options.spoolBuffers = (int)state.range(1);
+    long long bytes = 0;
+    for (auto _ : state) {
+        runDeck(deck, options, [&bytes](const string& data) {
+            bytes += data.size();
+        });
+    }
+    bench::doNotOptimize(bytes);
+    state.setItemsProcessed(state.iterations() * 256);
+    state.setLabel("items = jobs");
+}
+
+int main(int argc, char* argv[])
+{
+    bench::add("BM_VM_StraightLine", BM_VM_StraightLine)->args({1})->args({64});
+    bench::add("BM_VM_CardLoop", BM_VM_CardLoop)->args({100, 1})->args({1000, 8});
+    bench::add("BM_VM_CardLoopNdjson", BM_VM_CardLoopNdjson)->args({1000, 8});
+    bench::add("BM_VM_CardLoopProfiled", BM_VM_CardLoopProfiled)->args({1000, 8});
+    bench::add("BM_RunDeck", BM_RunDeck)->args({0})->args({1})->args({4});
+    bench::add("BM_RunDeckReadPastEnd", BM_RunDeckReadPastEnd)->args({4, 0})->args({4, 128});
+    bench::add("BM_Multiprogram", BM_Multiprogram)->args({MP_FRAMES, 0})->args({512, 0})
+        ->args({MP_FRAMES, SPOOL_BUFFERS});
+    return bench::runBenchmarks(argc, argv);
+}
@@ -0,0 +1,335 @@
+// Phase 2 benchmarks: MMU::translateAddress throughput across TLB and
+// working-set sizes, and script/trace parse throughput of executeCommands.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o bench_phase2.exe bench_phase2.cpp
+// Pass --trace=<script or .p2t> to also replay a captured production trace.
+#define OS_SIM_NO_MAIN
+#include "../phase2.cpp"
+#include "benchmark.h"
+#include "workloads.h"
+
+const long long SCRIPT_ACCESSES = 100000;
+
+// Accesses per second; args are TLB entries and working-set pages. Working
+// sets beyond the 64 frames fault and replace pages on most accesses.
+void BM_TranslateAddress(bench::State& state) {
+    MMUConfig config;
+    config.tlbSize = (int)state.range(0);
+    config.verbosity = VERBOSITY_SUMMARY;
+    MMU mmu(config);
+    mmu.createProcess(1, VIRTUAL_MEMORY_SIZE);
+
+    mt19937 rng(42);
+    uniform_int_distribution<int> addr(0, (int)state.range(1) * PAGE_SIZE - 1);
+    vector<int> addresses(1 << 16);
+    for (int& a : addresses) {
+        a = addr(rng);
+    }
+
+    long long i = 0, checksum = 0;
+    for (auto _ : state) {
+        checksum += mmu.translateAddress(1, addresses[i++ & 0xFFFF]);
+    }
+    bench::doNotOptimize(checksum);
+    state.setItemsProcessed(state.iterations());
+}
+
+// Script replay; arg 0 is the verbosity (0 summary, 1 events, 2 full), so
+// summary measures the tokenizer and MMU and full adds the text log
+void BM_ExecuteScript(bench::State& state) {
+    string script = workloads::accessScript(8, 64, 32, SCRIPT_ACCESSES, 20, 42);
+    MMUConfig config;
+    config.verbosity = (Verbosity)state.range(0);
+
+    long long outputBytes = 0;
+    for (auto _ : state) {
+        MMU mmu(config);
+        outputBytes += mmu.executeCommands(script).size();
+    }
+    bench::doNotOptimize(outputBytes);
+    state.setItemsProcessed(state.iterations() * SCRIPT_ACCESSES);
+    state.setBytesProcessed(state.iterations() * (long long)script.size());
+}
+
+// Binary trace replay; arg 0 is 1 for delta-encoded records
+void BM_ExecuteTrace(bench::State& state) {
+    int skipped;
+    string trace = convertTextTrace(workloads::accessScript(8, 64, 32, SCRIPT_ACCESSES, 20, 42),
+                                    state.range(0) != 0, skipped);
+    MMUConfig config;
+    config.verbosity = VERBOSITY_SUMMARY;
+
+    long long outputBytes = 0;
+    for (auto _ : state) {
+        MMU mmu(config);
+        outputBytes += mmu.executeCommands(trace).size();
+    }
+    bench::doNotOptimize(outputBytes);
+    state.setItemsProcessed(state.iterations() * SCRIPT_ACCESSES);
+    state.setBytesProcessed(state.iterations() * (long long)trace.size());
+}
+
+// Multi-core replay; arg 0 is the number of CPUs, each replaying the
+// processes pinned to it on its own thread
+void BM_ExecuteParallel(bench::State& state) {
+    int skipped;
+    string trace = convertTextTrace(workloads::accessScript(8, 64, 32, SCRIPT_ACCESSES, 20, 42), false, skipped);
+    MMUConfig config;
+    config.verbosity = VERBOSITY_SUMMARY;
+    config.cpus = (int)state.range(0);
+
+    long long outputBytes = 0;
+    for (auto _ : state) {
+        MMU mmu(config);
+        outputBytes += mmu.executeCommands(trace).size();
+    }
+    bench::doNotOptimize(outputBytes);
+    state.setItemsProcessed(state.iterations() * SCRIPT_ACCESSES);
+}
+
+// Sweep of frames x policy over one decoded trace; arg 0 is the number of
+// worker threads
+void BM_Sweep(bench::State& state) {
+    string script = workloads::accessScript(8, 64, 32, SCRIPT_ACCESSES, 20, 42);
+    vector<SweepPoint> points;
+    for (int frames : {16, 32, 64, 128}) {
+        for (ReplacementPolicyType policy : {POLICY_FIFO, POLICY_LRU, POLICY_CLOCK}) {
+            SweepPoint point;
+            point.config.frames = frames;
+            point.config.policy = policy;
+            points.push_back(point);
+        }
+    }
+
+    long long outputBytes = 0;
+    for (auto _ : state) {
+        outputBytes += runSweep(script.data(), script.size(), points, (int)state.range(0), FORMAT_TEXT).size();
+    }
+    bench::doNotOptimize(outputBytes);
+    state.setItemsProcessed(state.iterations() * SCRIPT_ACCESSES * (long long)points.size());
+}
+
+// Analysis pass: reuse distances, miss-ratio curve and working set
+void BM_Analyze(bench::State& state) {
+    string script = workloads::accessScript(8, 64, 32, SCRIPT_ACCESSES, 20, 42);
+    MMUConfig config;
+    config.format = FORMAT_NDJSON;
+
+    long long outputBytes = 0;
+    for (auto _ : state) {
+        TraceAnalyzer analyzer(config, ANALYSIS_WINDOW);
+        outputBytes += analyzer.analyze(script.data(), script.size()).size();
+    }
+    bench::doNotOptimize(outputBytes);
+    state.setItemsProcessed(state.iterations() * SCRIPT_ACCESSES);
+}
+
+// Processes created, touched once and terminated per second; arg 0 is how
+// many stay live at a time, so the pid index and PCB pool see real churn
+void BM_ProcessChurn(bench::State& state) {
+    int live = (int)state.range(0);
+    MMUConfig config;
+    config.verbosity = VERBOSITY_SUMMARY;
+    MMU mmu(config);
+    for (int pid = 0; pid < live; pid++) {
+        mmu.createProcess(pid, 8);
+    }
+
+    int next = live;
+    for (auto _ : state) {
+        mmu.terminateProcess(next - live);
+        mmu.createProcess(next, 8);
+        bench::doNotOptimize(mmu.translateAddress(next, 0));
+        next++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+
+// Scheduled replay of 10000 processes; arg 0 is the SchedulerType, so the
+// run queues are compared on the same work
+void BM_Schedule(bench::State& state) {
+    string script = workloads::accessScript(10000, 8, 8, SCRIPT_ACCESSES, 20, 42);
+    MMUConfig config;
+    config.verbosity = VERBOSITY_SUMMARY;
+    config.frames = 1024;
+    config.scheduler = (SchedulerType)state.range(0);
+
+    long long outputBytes = 0;
+    for (auto _ : state) {
+        MMU mmu(config);
+        outputBytes += mmu.executeCommands(script).size();
+    }
+    bench::doNotOptimize(outputBytes);
+    state.setItemsProcessed(state.iterations() * SCRIPT_ACCESSES);
+}
+
+// Script replay with a swap device; args are the write-back batch and the
+// read-ahead window (0 = off)
+void BM_Swap(bench::State& state) {
+    string script = workloads::accessScript(8, 64, 32, SCRIPT_ACCESSES, 20, 42);
+    MMUConfig config;
+    config.verbosity = VERBOSITY_SUMMARY;
+    config.swapSlots = SWAP_SLOTS;
+    config.writeBackBatch = (int)state.range(0);
+    config.prefetch = (int)state.range(1);
+
+    long long outputBytes = 0;
+    for (auto _ : state) {
+        MMU mmu(config);
+        outputBytes += mmu.executeCommands(script).size();
+    }
+    bench::doNotOptimize(outputBytes);
+    state.setItemsProcessed(state.iterations() * SCRIPT_ACCESSES);
+}
+
+// Forks per second of a process with arg 0 resident pages in a full-size
+// address space, each child terminated right away. Both follow the resident
+// pages, not the address space.
+void BM_Fork(bench::State& state) {
+    MMUConfig config;
+    config.verbosity = VERBOSITY_SUMMARY;
+    config.frames = 1024;
+    MMU mmu(config);
+    mmu.createProcess(1, VIRTUAL_MEMORY_SIZE);
+    for (int page = 0; page < (int)state.range(0); page++) {
+        mmu.translateAddress(1, page * PAGE_SIZE, true);
+    }
+
+    int child = 2;
+    for (auto _ : state) {
+        mmu.forkProcess(1, child);
+        mmu.terminateProcess(child++);
+    }
+    state.setItemsProcessed(state.iterations());
+}
+
+// Random accesses over 384 resident pages with a 16-entry TLB; arg 0 is the
+// huge page size in pages, 0 for base pages only. Huge pages save most TLB
+// misses, and base pages pay for probing the other sizes on every miss.
+void BM_HugePages(bench::State& state) {
+    MMUConfig config;
+    config.verbosity = VERBOSITY_SUMMARY;
+    config.frames = 512;
+    config.tlbSize = 16;
+    if (state.range(0) > 0) {
+        config.hugePages.push_back(state.range(0) * PAGE_SIZE);
+    }
+    MMU mmu(config);
+    mmu.createProcess(1, 384);
+
+    mt19937 rng(42);
+    uniform_int_distribution<int> addr(0, 384 * PAGE_SIZE - 1);
+    vector<int> addresses(1 << 16);
+    for (int& a : addresses) {
+        a = addr(rng);
+    }
+
+    long long i = 0, checksum = 0;
+    for (auto _ : state) {
+        checksum += mmu.translateAddress(1, addresses[i++ & 0xFFFF]);
+    }
+    bench::doNotOptimize(checksum);
+    state.setItemsProcessed(state.iterations());
+}
+
+// Allocate and free on a memory of 4M frames kept half full by random
+// frees; arg 0 is the allocator and arg 1 the block size in frames. The
+// buddy takes O(orders) per block; the bitmap finds a word holding a block
+// of each size below 64 frames through that size's summary tree, and larger
+// blocks through its nested bitmap of whole free words.
+void BM_FrameAllocator(bench::State& state) {
+    const int frames = 1 << 22;
+    unique_ptr<FrameAllocator> allocator = createFrameAllocator((FrameAllocatorType)state.range(0), frames);
+    int order = 0;
+    while ((1LL << order) < state.range(1)) {
+        order++;
+    }
+    mt19937 rng(42);
+    vector<int> held;
+    while (allocator->freeFrames() > frames / 2) {
+        held.push_back(allocator->allocate(order));
+    }
+    
+    for (auto _ : state) {
+        size_t i = rng() % held.size();
+        allocator->free(held[i], order);
+        held[i] = allocator->allocate(order);
+    }
+    bench::doNotOptimize(allocator->freeFrames() + held[0]);
+    state.setItemsProcessed(state.iterations());
+}
+
+// Checkpoint of the MMU at the end of a script; arg 0 is 0 to take one and
+// 1 to restore one into a fresh MMU
+void BM_Checkpoint(bench::State& state) {
+    string script = workloads::accessScript(8, 64, 32, SCRIPT_ACCESSES, 20, 42);
+    MMUConfig config;
+    config.verbosity = VERBOSITY_SUMMARY;
+    config.frames = 1024;
+    MMU source(config);
+    source.executeCommands(script);
+    string checkpoint = source.saveCheckpoint(SCRIPT_ACCESSES);
+
+    long long checksum = 0;
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            checksum += source.saveCheckpoint(SCRIPT_ACCESSES).size();
+        } else {
+            MMU mmu(config);
+            checksum += mmu.restoreCheckpoint(checkpoint.data(), checkpoint.size()).size();
+        }
+    }
+    bench::doNotOptimize(checksum);
+    state.setBytesProcessed(state.iterations() * (long long)checkpoint.size());
+}
+
+int main(int argc, char* argv[]) {
+    for (long long tlbSize : {4, 16, 64}) {
+        for (long long workingSet : {4, 32, 128}) {
+            bench::add("BM_TranslateAddress", BM_TranslateAddress)->args({tlbSize, workingSet});
+        }
+    }
+    bench::add("BM_ExecuteScript", BM_ExecuteScript)->args({VERBOSITY_SUMMARY})->args({VERBOSITY_FULL});
+    bench::add("BM_ExecuteTrace", BM_ExecuteTrace)->args({0})->args({1});
+    bench::add("BM_ExecuteParallel", BM_ExecuteParallel)->args({1})->args({2})->args({4});
+    bench::add("BM_Sweep", BM_Sweep)->args({1})->args({4});
+    bench::add("BM_Analyze", BM_Analyze);
+    bench::add("BM_ProcessChurn", BM_ProcessChurn)->args({16})->args({10000});
+    for (long long scheduler : {SCHEDULER_NONE, SCHEDULER_FCFS, SCHEDULER_RR, SCHEDULER_PRIORITY, SCHEDULER_MLFQ,
+                                SCHEDULER_CFS}) {
+        bench::add("BM_Schedule", BM_Schedule)->args({scheduler});
+    }
+    bench::add("BM_Swap", BM_Swap)->args({0, 0})->args({16, 0})->args({16, 8});
+    bench::add("BM_Fork", BM_Fork)->args({8})->args({64});
+    bench::add("BM_HugePages", BM_HugePages)->args({0})->args({16})->args({64});
+    for (long long allocator : {ALLOCATOR_BUDDY, ALLOCATOR_BITMAP}) {
+        bench::add("BM_FrameAllocator", BM_FrameAllocator)->args({allocator, 1})->args({allocator, 16});
+    }
+    bench::add("BM_Checkpoint", BM_Checkpoint)->args({0})->args({1});
+
+    // A captured trace, replayed the way the daemon would run it
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 8, "--trace=") != 0) {
+            continue;
+        }
+        string path = arg.substr(8);
+        auto trace = make_shared<MappedFile>(path);
+        if (!trace->isOpen()) {
+            cerr << "Error: Cannot open trace " << path << endl;
+            return 1;
+        }
+        bench::add("BM_Replay", [trace, path](bench::State& state) {
+            MMUConfig config;
+            config.verbosity = VERBOSITY_SUMMARY;
+            for (auto _ : state) {
+                MMU mmu(config);
+                bench::doNotOptimize(mmu.executeInput(trace->data(), trace->size()).size());
+            }
+            state.setBytesProcessed(state.iterations() * (long long)trace->size());
+            state.setLabel(path);
+        });
+    }
+
+    return bench::runBenchmarks(argc, argv);
+}
@@ -0,0 +1,326 @@
+// Minimal Google Benchmark-style harness for the simulator benchmarks.
+//
+// Each benchmark is a function taking a State; the timed part is the
+// "for (auto _ : state)" loop. The iteration count grows until a run takes
+// at least --benchmark_min_time seconds. Results are printed as a table and,
+// with --benchmark_out=file.json, written in Google Benchmark's JSON format so
+// its compare.py and existing dashboards can track them.
+#ifndef OS_SIM_BENCHMARK_H
+#define OS_SIM_BENCHMARK_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+using namespace std;
+
+inline volatile long long optimizerSink;
+
+// Keep a computed value alive so the optimiser cannot drop the work
+inline void doNotOptimize(long long value) {
+    optimizerSink = value;
+}
+
+class State {
+private:
+    long long iterationCount;
+    vector<long long> arguments;
+    chrono::steady_clock::time_point startReal, stopReal;
+    clock_t startCpu, stopCpu;
+    long long items;
+    long long bytes;
+    vector<pair<string, double>> userCounters;
+    string labelText;
+
+    void start() {
+        startCpu = clock();
+        startReal = chrono::steady_clock::now();
+    }
+
+    void stop() {
+        stopReal = chrono::steady_clock::now();
+        stopCpu = clock();
+    }
+
+public:
+    class Iterator {
+    private:
+        State* state;
+        long long left;
+
+    public:
+        Iterator(State* state, long long left) : state(state), left(left) {}
+
+        bool operator!=(const Iterator&) {
+            if (left > 0) {
+                return true;
+            }
+            state->stop();
+            return false;
+        }
+
+        void operator++() {
+            left--;
+        }
+
+        // Empty value, so "for (auto _ : state)" draws no unused warning
+        struct [[maybe_unused]] Value {};
+
+        Value operator*() const {
+            return Value();
+        }
+    };
+
+    State(long long iterations, const vector<long long>& args)
+        : iterationCount(iterations), arguments(args), startCpu(0), stopCpu(0), items(0), bytes(0) {}
+
+    Iterator begin() {
+        start();
+        return Iterator(this, iterationCount);
+    }
+
+    Iterator end() {
+        return Iterator(this, 0);
+    }
+
+    long long iterations() const {
+        return iterationCount;
+    }
+
+    long long range(size_t i) const {
+        return i < arguments.size() ? arguments[i] : 0;
+    }
+
+    // Totals over all iterations; reported as rates
+    void setItemsProcessed(long long n) {
+        items = n;
+    }
+
+    void setBytesProcessed(long long n) {
+        bytes = n;
+    }
+
+    void setLabel(const string& label) {
+        labelText = label;
+    }
+
+    void counter(const string& name, double value) {
+        userCounters.emplace_back(name, value);
+    }
+
+    double realSeconds() const {
+        return chrono::duration<double>(stopReal - startReal).count();
+    }
+
+    double cpuSeconds() const {
+        return (double)(stopCpu - startCpu) / CLOCKS_PER_SEC;
+    }
+
+    long long itemsProcessed() const {
+        return items;
+    }
+
+    long long bytesProcessed() const {
+        return bytes;
+    }
+
+    const string& label() const {
+        return labelText;
+    }
+
+    const vector<pair<string, double>>& counters() const {
+        return userCounters;
+    }
+};
+
+struct Benchmark {
+    string name;
+    function<void(State&)> body;
+    vector<vector<long long>> argSets;
+
+    // Add one run with these arguments, e.g. ->args({16, 64})
+    Benchmark* args(const vector<long long>& values) {
+        argSets.push_back(values);
+        return this;
+    }
+};
+
+struct Result {
+    string name;
+    long long iterations;
+    double realTime;  // ns per iteration
+    double cpuTime;   // ns per iteration
+    double itemsPerSecond;
+    double bytesPerSecond;
+    string label;
+    vector<pair<string, double>> counters;
+};
+
+// A deque, so the pointer add() returns stays valid as more are added
+inline deque<Benchmark>& registry() {
+    static deque<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+inline Benchmark* add(const string& name, function<void(State&)> body) {
+    registry().push_back(Benchmark{name, move(body), {}});
+    return &registry().back();
+}
+
+inline string runName(const Benchmark& benchmark, const vector<long long>& args) {
+    string name = benchmark.name;
+    for (long long arg : args) {
+        name += "/" + to_string(arg);
+    }
+    return name;
+}
+
+inline Result runOne(const Benchmark& benchmark, const vector<long long>& args, double minTime) {
+    long long iterations = 1;
+    while (true) {
+        State state(iterations, args);
+        benchmark.body(state);
+        double seconds = state.realSeconds();
+
+        if (seconds >= minTime || iterations >= 1000000000LL) {
+            Result result;
+            result.name = runName(benchmark, args);
+            result.iterations = iterations;
+            result.realTime = seconds * 1e9 / iterations;
+            result.cpuTime = state.cpuSeconds() * 1e9 / iterations;
+            result.itemsPerSecond = seconds > 0 ? state.itemsProcessed() / seconds : 0;
+            result.bytesPerSecond = seconds > 0 ? state.bytesProcessed() / seconds : 0;
+            result.label = state.label();
+            result.counters = state.counters();
+            return result;
+        }
+
+        // Aim a little past the minimum time, growing at most 10x per round
+        double multiplier = seconds > 0 ? minTime * 1.4 / seconds : 10;
+        if (multiplier > 10) {
+            multiplier = 10;
+        }
+        long long next = (long long)(iterations * multiplier);
+        iterations = next > iterations ? next : iterations + 1;
+    }
+}
+
+inline string jsonEscape(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += (c == '\n') ? ' ' : c;
+    }
+    return escaped;
+}
+
+inline void writeJson(ostream& out, const vector<Result>& results) {
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"num_cpus\": " << thread::hardware_concurrency() << ",\n";
+#ifdef __OPTIMIZE__
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "    {\n";
+        out << "      \"name\": \"" << jsonEscape(r.name) << "\",\n";
+        out << "      \"run_name\": \"" << jsonEscape(r.name) << "\",\n";
+        out << "      \"run_type\": \"iteration\",\n";
+        out << "      \"iterations\": " << r.iterations << ",\n";
+        out << "      \"real_time\": " << r.realTime << ",\n";
+        out << "      \"cpu_time\": " << r.cpuTime << ",\n";
+        out << "      \"time_unit\": \"ns\"";
+        if (r.itemsPerSecond > 0) {
+            out << ",\n      \"items_per_second\": " << r.itemsPerSecond;
+        }
+        if (r.bytesPerSecond > 0) {
+            out << ",\n      \"bytes_per_second\": " << r.bytesPerSecond;
+        }
+        for (auto& c : r.counters) {
+            out << ",\n      \"" << jsonEscape(c.first) << "\": " << c.second;
+        }
+        if (!r.label.empty()) {
+            out << ",\n      \"label\": \"" << jsonEscape(r.label) << "\"";
+        }
+        out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Run every registered benchmark matching --benchmark_filter (a substring).
+// Other flags: --benchmark_min_time=<seconds>, --benchmark_out=<file.json>.
+inline int runBenchmarks(int argc, char* argv[]) {
+    string filter, outPath;
+    double minTime = 0.5;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 19, "--benchmark_filter=") == 0) {
+            filter = arg.substr(19);
+        } else if (arg.compare(0, 21, "--benchmark_min_time=") == 0) {
+            minTime = atof(arg.c_str() + 21);
+        } else if (arg.compare(0, 16, "--benchmark_out=") == 0) {
+            outPath = arg.substr(16);
+        }
+    }
+
+    printf("%-44s %14s %14s %12s %16s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations", "Rate");
+    vector<Result> results;
+    for (const Benchmark& benchmark : registry()) {
+        vector<vector<long long>> argSets = benchmark.argSets;
+        if (argSets.empty()) {
+            argSets.push_back({});
+        }
+        for (auto& args : argSets) {
+            string name = runName(benchmark, args);
+            if (!filter.empty() && name.find(filter) == string::npos) {
+                continue;
+            }
+
+            Result r = runOne(benchmark, args, minTime);
+            char rate[32] = "";
+            if (r.itemsPerSecond > 0) {
+                snprintf(rate, sizeof(rate), "%.3gM items/s", r.itemsPerSecond / 1e6);
+            } else if (r.bytesPerSecond > 0) {
+                snprintf(rate, sizeof(rate), "%.3gMB/s", r.bytesPerSecond / 1e6);
+            }
+            printf("%-44s %14.0f %14.0f %12lld %16s %s\n", r.name.c_str(), r.realTime, r.cpuTime,
+                   r.iterations, rate, r.label.c_str());
+            fflush(stdout);
+            results.push_back(r);
+        }
+    }
+
+    if (!outPath.empty()) {
+        ofstream out(outPath);
+        if (!out.is_open()) {
+            fprintf(stderr, "Error: Cannot open output file %s\n", outPath.c_str());
+            return 1;
+        }
+        writeJson(out, results);
+    }
+    return 0;
+}
+
+} // namespace bench
+
+#endif
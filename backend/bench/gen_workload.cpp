@@ -0,0 +1,42 @@
+// Synthetic workload generator: writes the benchmark workloads to stdout so
+// they can be fed to the simulators, the HTTP benchmark or a profiler.
+//
+// Build: g++ -std=c++17 -O2 -o gen_workload.exe gen_workload.cpp
+//   gen_workload.exe straight <jobs>
+//   gen_workload.exe loop <jobs> <iterations> <compares>
+//   gen_workload.exe overread <jobs> <job>
+//   gen_workload.exe access <processes> <pages> <working_set> <accesses> <write_percent> [seed]
+#include <cstdlib>
+#include <iostream>
+#include "workloads.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    string kind = argc > 1 ? argv[1] : "";
+    auto arg = [&](int i, long long fallback) {
+        return i < argc ? atoll(argv[i]) : fallback;
+    };
+
+    if (kind == "straight") {
+        cout << workloads::straightLineDeck((int)arg(2, 64));
+    }
+    else if (kind == "loop") {
+        cout << workloads::cardLoopDeck((int)arg(2, 1), (int)arg(3, 1000), (int)arg(4, 8));
+    }
+    else if (kind == "overread") {
+        cout << workloads::readPastEndDeck((int)arg(2, 8), (int)arg(3, 4));
+    }
+    else if (kind == "access") {
+        cout << workloads::accessScript((int)arg(2, 8), (int)arg(3, 64), (int)arg(4, 32), arg(5, 100000),
+                                        (int)arg(6, 20), (unsigned)arg(7, 42));
+    }
+    else {
+        cerr << "Usage: " << argv[0] << " straight <jobs>" << endl;
+        cerr << "       " << argv[0] << " loop <jobs> <iterations> <compares>" << endl;
+        cerr << "       " << argv[0] << " overread <jobs> <job>" << endl;
+        cerr << "       " << argv[0] << " access <processes> <pages> <working_set> <accesses> <write_percent> [seed]" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+// End-to-end latency through server.js: starts the server on a spare port,
+// replays synthetic workloads against /api/phase1 and /api/phase2 and reports
+// latency percentiles in the same JSON format as the C++ benchmarks.
+//
+// Usage: node bench/http_bench.js [--requests=N] [--concurrency=N] [--benchmark_out=file.json]
+// Needs the compiled simulators and bench/gen_workload.exe (npm run bench:build).
+const { spawn, execFileSync } = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const BACKEND = path.join(__dirname, '..');
+const PORT = 5099;
+const BASE_URL = `http://localhost:${PORT}/api`;
+
+const option = (name, fallback) => {
+  const arg = process.argv.find((a) => a.startsWith(`--${name}=`));
+  return arg ? arg.slice(name.length + 3) : fallback;
+};
+
+const generate = (...args) => {
+  const program = path.join(__dirname, 'gen_workload.exe');
+  return execFileSync(program, args.map(String), { encoding: 'utf8', maxBuffer: 1 << 30 });
+};
+
+const CASES = [
+  { name: 'HTTP_Phase1/straight/1', phase: 'phase1', input: () => generate('straight', 1) },
+  { name: 'HTTP_Phase1/straight/256', phase: 'phase1', input: () => generate('straight', 256) },
+  { name: 'HTTP_Phase2/access/100', phase: 'phase2', input: () => generate('access', 4, 16, 8, 100, 20) },
+  { name: 'HTTP_Phase2/access/100000', phase: 'phase2', input: () => generate('access', 8, 64, 32, 100000, 20) }
+];
+
+const waitForServer = async () => {
+  for (let i = 0; i < 100; i++) {
+    try {
+      const response = await fetch(`${BASE_URL}/health`);
+      if (response.ok) return;
+    } catch (error) {
+      // Not listening yet
+    }
+    await new Promise((resolve) => setTimeout(resolve, 100));
+  }
+  throw new Error('server.js did not start');
+};
+
+// One request; returns [time to first byte, total time] in nanoseconds
+const request = async (phase, fileContent) => {
+  const start = process.hrtime.bigint();
+  const response = await fetch(`${BASE_URL}/${phase}`, {
+    method: 'POST',
+    headers: { 'Content-Type': 'application/json' },
+    body: JSON.stringify({ fileContent })
+  });
+  const reader = response.body.getReader();
+  let firstByte = null;
+  for (;;) {
+    const { done } = await reader.read();
+    if (firstByte === null) firstByte = process.hrtime.bigint();
+    if (done) break;
+  }
+  if (!response.ok) throw new Error(`${phase} returned ${response.status}`);
+  const end = process.hrtime.bigint();
+  return [Number(firstByte - start), Number(end - start)];
+};
+
+const percentile = (sorted, p) => sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+
+const runCase = async (testCase, requests, concurrency) => {
+  const fileContent = testCase.input();
+  for (let i = 0; i < 3; i++) await request(testCase.phase, fileContent);
+
+  // Large workloads get fewer requests so a run stays short
+  const count = Math.max(concurrency, Math.min(requests, Math.ceil(2e6 / fileContent.length)));
+  const totals = [];
+  const firstBytes = [];
+  let next = 0;
+  const started = process.hrtime.bigint();
+  const client = async () => {
+    while (next++ < count) {
+      const [firstByte, total] = await request(testCase.phase, fileContent);
+      firstBytes.push(firstByte);
+      totals.push(total);
+    }
+  };
+  await Promise.all(Array.from({ length: concurrency }, client));
+  const wall = Number(process.hrtime.bigint() - started);
+
+  totals.sort((a, b) => a - b);
+  firstBytes.sort((a, b) => a - b);
+  const mean = totals.reduce((sum, t) => sum + t, 0) / totals.length;
+  return {
+    name: `${testCase.name}/concurrency:${concurrency}`,
+    run_name: `${testCase.name}/concurrency:${concurrency}`,
+    run_type: 'iteration',
+    iterations: totals.length,
+    real_time: mean,
+    cpu_time: mean,
+    time_unit: 'ns',
+    items_per_second: totals.length / (wall / 1e9),
+    bytes_per_second: (fileContent.length * totals.length) / (wall / 1e9),
+    p50: percentile(totals, 0.5),
+    p90: percentile(totals, 0.9),
+    p99: percentile(totals, 0.99),
+    ttfb_p50: percentile(firstBytes, 0.5),
+    label: 'items = requests'
+  };
+};
+
+const main = async () => {
+  const requests = parseInt(option('requests', '200'), 10);
+  const concurrency = parseInt(option('concurrency', '1'), 10);
+  const outPath = option('benchmark_out', '');
+
+  const server = spawn(process.execPath, ['server.js'], {
+    cwd: BACKEND,
+    env: { ...process.env, PORT },
+    stdio: 'ignore'
+  });
+
+  const results = [];
+  try {
+    await waitForServer();
+    console.log('Benchmark'.padEnd(52) + 'Mean (ms)'.padStart(11) + 'p50'.padStart(9) + 'p99'.padStart(9) + 'TTFB p50'.padStart(10) + 'Req/s'.padStart(9));
+    for (const testCase of CASES) {
+      const r = await runCase(testCase, requests, concurrency);
+      const ms = (ns) => (ns / 1e6).toFixed(2).padStart(9);
+      console.log(r.name.padEnd(52) + ms(r.real_time).padStart(11) + ms(r.p50) + ms(r.p99) + ms(r.ttfb_p50).padStart(10) + r.items_per_second.toFixed(0).padStart(9));
+      results.push(r);
+    }
+  } finally {
+    server.kill();
+  }
+
+  if (outPath) {
+    const report = {
+      context: { date: new Date().toISOString(), num_cpus: os.cpus().length, library_build_type: 'release' },
+      benchmarks: results
+    };
+    fs.writeFileSync(outPath, JSON.stringify(report, null, 2) + '\n');
+  }
+};
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
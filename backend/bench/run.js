@@ -0,0 +1,23 @@
+// Runs the whole suite and writes Google Benchmark JSON to bench/results/,
+// one file per suite, for tracking over time (e.g. with compare.py).
+//
+// Usage: npm run bench [-- --benchmark_filter=<substring>]
+const { spawnSync } = require('child_process');
+const fs = require('fs');
+const path = require('path');
+
+const RESULTS = path.join(__dirname, 'results');
+fs.mkdirSync(RESULTS, { recursive: true });
+
+const extraArgs = process.argv.slice(2);
+const run = (program, args) => {
+  const result = spawnSync(program, [...args, ...extraArgs], { stdio: 'inherit' });
+  if (result.status !== 0) {
+    console.error(`${path.basename(program)} failed`);
+    process.exit(result.status || 1);
+  }
+};
+
+run(path.join(__dirname, 'bench_phase1.exe'), [`--benchmark_out=${path.join(RESULTS, 'phase1.json')}`]);
+run(path.join(__dirname, 'bench_phase2.exe'), [`--benchmark_out=${path.join(RESULTS, 'phase2.json')}`]);
+run(process.execPath, [path.join(__dirname, 'http_bench.js'), `--benchmark_out=${path.join(RESULTS, 'http.json')}`]);
@@ -0,0 +1,105 @@
+// Synthetic workload generators shared by the benchmarks and gen_workload.
+// Every generator is deterministic for a given seed, so runs are comparable.
+#ifndef OS_SIM_WORKLOADS_H
+#define OS_SIM_WORKLOADS_H
+
+#include <random>
+#include <string>
+
+namespace workloads {
+
+using namespace std;
+
+inline string twoDigits(int n) {
+    return string(1, (char)('0' + n / 10)) + (char)('0' + n % 10);
+}
+
+// Phase 1 deck of straight-line LR/CR/BT programs: every BT is taken and lands
+// on the next instruction, so each job runs its whole program and halts.
+inline string straightLineDeck(int jobs) {
+    string program;
+    int words = 0;
+    while (words + 3 < 99) {
+        program += "LR50 CR50 BT" + twoDigits(words + 3) + " ";
+        words += 3;
+    }
+    program += "H";
+
+    string deck;
+    for (int j = 0; j < jobs; j++) {
+        string id = to_string(j % 10000);
+        id.insert(0, 4 - id.size(), '0');
+        deck += "$AMJ" + id + "99999999\n" + program + "\n$DTA\n$END" + id + "\n";
+    }
+    return deck;
+}
+
+// Phase 1 deck of card-driven loops: each pass reads a data card with GD,
+// runs `compares` LR/CR pairs over it and branches back while its first two
+// words match. The last card breaks the loop, so a job runs `iterations`
+// passes of 2 + 2 * compares instructions.
+inline string cardLoopDeck(int jobs, int iterations, int compares) {
+    if (compares > 8) {
+        compares = 8;  // The program must stay below the card buffer at M[20]
+    }
+    string program = "GD20";
+    for (int i = 0; i < compares; i++) {
+        program += " LR20 CR21";
+    }
+    program += " BT00 H";
+
+    string deck;
+    for (int j = 0; j < jobs; j++) {
+        deck += "$AMJ000199999999\n" + program + "\n$DTA\n";
+        for (int i = 1; i < iterations; i++) {
+            deck += "AAAAAAAA\n";
+        }
+        deck += "AAAABBBB\n$END0001\n";
+    }
+    return deck;
+}
+
+// Phase 1 deck like straightLineDeck whose job `overread` has one data card
+// but three GDs, so its last GD reads the job's $END card and the next one
+// the following job's $AMJ: batch mode must fall back to a serial replay
+// from that job on to match a serial run
+inline string readPastEndDeck(int jobs, int overread) {
+    string straight = straightLineDeck(1);
+    string deck;
+    for (int j = 0; j < jobs; j++) {
+        if (j == overread) {
+            deck += "$AMJ000199999999\nGD10 GD20 GD30 PD30 H\n$DTA\nONLY ONE CARD\n$END0001\n";
+        } else {
+            deck += straight;
+        }
+    }
+    return deck;
+}
+
+// Phase 2 script: `processes` processes of `pages` pages each, then `accesses`
+// ACCESS/WRITE commands. Addresses fall in the first `workingSet` pages of a
+// random process; writePercent of the accesses are writes.
+inline string accessScript(int processes, int pages, int workingSet, long long accesses,
+                           int writePercent, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> pid(1, processes);
+    uniform_int_distribution<int> addr(0, (workingSet < pages ? workingSet : pages) * 1024 - 1);
+    uniform_int_distribution<int> percent(0, 99);
+
+    string script;
+    for (int p = 1; p <= processes; p++) {
+        script += "CREATE " + to_string(p) + " " + to_string(pages) + "\n";
+    }
+    for (long long i = 0; i < accesses; i++) {
+        script += percent(rng) < writePercent ? "WRITE " : "ACCESS ";
+        script += to_string(pid(rng)) + " " + to_string(addr(rng)) + "\n";
+    }
+    for (int p = 1; p <= processes; p++) {
+        script += "TERMINATE " + to_string(p) + "\n";
+    }
+    return script;
+}
+
+} // namespace workloads
+
+#endif
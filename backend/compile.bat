@@ -3,7 +3,7 @@ echo Compiling OS Simulator Backend...
 echo.
 
 echo Compiling Phase 1...
-g++ -o phase1.exe phase1.cpp
+g++ -std=c++17 -O2 -pthread -o phase1.exe phase1.cpp
 if %errorlevel% neq 0 (
     echo Error compiling phase1.cpp
     pause
@@ -11,7 +11,7 @@ if %errorlevel% neq 0 (
 )
 
 echo Compiling Phase 2...
-g++ -o phase2.exe phase2.cpp
+g++ -std=c++17 -O2 -pthread -o phase2.exe phase2.cpp
 if %errorlevel% neq 0 (
     echo Error compiling phase2.cpp
     pause
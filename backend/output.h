@@ -0,0 +1,250 @@
+// Output shared by phase1 and phase2: the output formats, the structured
+// event stream, and the framing of the --serve daemon mode. Each simulator
+// defines its own EventType enum and EVENT_SCHEMAS table.
+#ifndef OS_SIM_OUTPUT_H
+#define OS_SIM_OUTPUT_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <string_view>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Output formats
+enum OutputFormat {
+    FORMAT_TEXT,    // Human-readable log
+    FORMAT_NDJSON,  // One JSON object per event
+    FORMAT_BINARY   // Compact typed records
+};
+
+struct EventSchema {
+    const char* name;
+    const char* fields[8];
+    const char* textField;
+};
+
+// Indexed by the simulator's EventType
+extern const EventSchema EVENT_SCHEMAS[];
+
+class EventStream {
+private:
+    OutputFormat format;
+    string buffer;
+
+    void appendInt(long long value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr);
+    }
+
+    void appendVarint(long long value) {
+        uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+        while (v >= 0x80) {
+            buffer += (char)(v | 0x80);
+            v >>= 7;
+        }
+        buffer += (char)v;
+    }
+
+    void appendJsonString(string_view text) {
+        static const char hex[] = "0123456789abcdef";
+        buffer += '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                buffer += '\\';
+                buffer += c;
+            } else if ((unsigned char)c < 0x20) {
+                buffer += "\\u00";
+                buffer += hex[(c >> 4) & 0xF];
+                buffer += hex[c & 0xF];
+            } else {
+                buffer += c;
+            }
+        }
+        buffer += '"';
+    }
+
+public:
+    explicit EventStream(OutputFormat format) : format(format) {}
+
+    bool enabled() const {
+        return format != FORMAT_TEXT;
+    }
+
+    void emit(int type, initializer_list<long long> values = {}, string_view text = string_view()) {
+        const EventSchema& schema = EVENT_SCHEMAS[type];
+        if (format == FORMAT_BINARY) {
+            buffer += (char)type;
+            for (long long value : values) {
+                appendVarint(value);
+            }
+            if (schema.textField) {
+                appendVarint((long long)text.size());
+                buffer.append(text.data(), text.size());
+            }
+            return;
+        }
+
+        buffer += "{\"type\":\"";
+        buffer += schema.name;
+        buffer += '"';
+        int field = 0;
+        for (long long value : values) {
+            buffer += ",\"";
+            buffer += schema.fields[field++];
+            buffer += "\":";
+            appendInt(value);
+        }
+        if (schema.textField) {
+            buffer += ",\"";
+            buffer += schema.textField;
+            buffer += "\":";
+            appendJsonString(text);
+        }
+        buffer += "}\n";
+    }
+
+    const string& str() const {
+        return buffer;
+    }
+
+    size_t size() const {
+        return buffer.size();
+    }
+
+    void clear() {
+        buffer.clear();
+    }
+
+    string take() {
+        string taken;
+        taken.swap(buffer);
+        return taken;
+    }
+};
+
+// Receives output as it is produced when a run is streamed
+typedef function<void(const string&)> OutputSink;
+
+// Runs one served job: its payload, the options of its frame header, and
+// where to stream its output
+typedef function<void(const string&, const string&, const OutputSink&)> JobRunner;
+
+// Largest job payload the daemon accepts
+const size_t MAX_FRAME_BYTES = (size_t)1 << 28;
+
+// Daemon mode: each job arrives as "<length>[ <options>]\n<payload>" and its
+// result is sent back as "<length>\n<data>" chunks closed by an empty chunk
+// ("0\n"). The options are command line options applied to that job only.
+// A malformed or oversized header ends the stream.
+inline bool readFrame(FILE* in, string& payload, string& options) {
+    size_t length = 0;
+    bool hasDigits = false;
+    int ch;
+    options.clear();
+    while ((ch = getc(in)) != EOF && ch != '\n') {
+        if (ch == ' ' && hasDigits) {
+            while ((ch = getc(in)) != EOF && ch != '\n') {
+                options += (char)ch;
+            }
+            break;
+        }
+        if (ch < '0' || ch > '9' || length > (MAX_FRAME_BYTES - (ch - '0')) / 10) {
+            cerr << "Error: Malformed frame header" << endl;
+            return false;
+        }
+        length = length * 10 + (ch - '0');
+        hasDigits = true;
+    }
+    if (!hasDigits) {
+        return false;  // Clean end of stream
+    }
+
+    payload.resize(length);
+    return length == 0 || fread(&payload[0], 1, length, in) == length;
+}
+
+inline void writeChunk(FILE* out, const string& data) {
+    if (!data.empty()) {
+        fprintf(out, "%zu\n", data.size());
+        fwrite(data.data(), 1, data.size(), out);
+    }
+}
+
+inline void serveJobs(FILE* in, FILE* out, const JobRunner& runJob) {
+    string job, options;
+    while (readFrame(in, job, options)) {
+        // Results go out chunk by chunk while the job runs
+        runJob(job, options, [out](const string& data) {
+            writeChunk(out, data);
+            fflush(out);
+        });
+        fputs("0\n", out);
+        fflush(out);
+    }
+}
+
+inline void serveStdio(const JobRunner& runJob) {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    serveJobs(stdin, stdout, runJob);
+}
+
+inline int serveSocket(const char* path, const JobRunner& runJob) {
+#ifdef _WIN32
+    cerr << "Error: Unix socket mode is not supported on this platform" << endl;
+    return 1;
+#else
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if (listener < 0 || bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 16) < 0) {
+        cerr << "Error: Cannot listen on socket " << path << endl;
+        return 1;
+    }
+
+    // A client hanging up mid-response must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true) {
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) {
+            continue;
+        }
+        FILE* in = fdopen(conn, "rb");
+        FILE* out = fdopen(dup(conn), "wb");
+        // A job that fails ends only its own connection
+        try {
+            serveJobs(in, out, runJob);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+        }
+        fclose(in);
+        fclose(out);
+    }
+#endif
+}
+
+#endif
@@ -1,46 +1,481 @@
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <initializer_list>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <thread>
+#include <vector>
+#include "output.h"
 using namespace std;
 
+// Opcodes of the pre-decoded instruction stream
+enum Opcode : unsigned char
+{
+    OP_UNDECODED, // Slot was written since it was last decoded
+    OP_END,       // Empty word, the program stops here
+    OP_NOP,       // Unknown instruction or operand, skipped
+    OP_GD,
+    OP_PD,
+    OP_H,
+    OP_LR,
+    OP_SR,
+    OP_CR,
+    OP_BT
+};
+
+struct Instruction
+{
+    Opcode op;
+    unsigned char operand; // Memory address IR[2,3]
+};
+
+const char* const MNEMONICS[] = {"", "", "NOP", "GD", "PD", "H", "LR", "SR", "CR", "BT"};
+
+// Decode a 4-character memory word into an opcode and operand. GD and PD
+// only use IR[2], the block of ten words, and take its first word.
+Instruction decodeWord(const char* word)
+{
+    int operand = (word[2] - '0') * 10 + (word[3] - '0');
+    bool validOperand = operand >= 0 && operand < 100;
+    bool validBlock = word[2] >= '0' && word[2] <= '9';
+
+    Opcode op = OP_NOP;
+    if (word[0] == '\0')
+        op = OP_END;
+    else if (word[0] == 'G' && word[1] == 'D')
+    {
+        op = validBlock ? OP_GD : OP_NOP;
+        operand = (word[2] - '0') * 10;
+        validOperand = validBlock;
+    }
+    else if (word[0] == 'P' && word[1] == 'D')
+    {
+        op = validBlock ? OP_PD : OP_NOP;
+        operand = (word[2] - '0') * 10;
+        validOperand = validBlock;
+    }
+    else if (word[0] == 'H')
+        op = OP_H;
+    else if (word[0] == 'L' && word[1] == 'R')
+        op = validOperand ? OP_LR : OP_NOP;
+    else if (word[0] == 'S' && word[1] == 'R')
+        op = validOperand ? OP_SR : OP_NOP;
+    else if (word[0] == 'C' && word[1] == 'R')
+        op = validOperand ? OP_CR : OP_NOP;
+    else if (word[0] == 'B' && word[1] == 'T')
+        op = validOperand ? OP_BT : OP_NOP;
+
+    return Instruction{op, (unsigned char)(validOperand ? operand : 0)};
+}
+
+// A card goes into a 10-word block in one copy: at most 40 characters, as
+// many whole words as it fills, the last padded with '\0'. Returns the
+// number of words written.
+int cardToWords(const string& card, char* block)
+{
+    size_t length = min(card.size(), (size_t)40);
+    size_t words = (length + 3) / 4;
+    memcpy(block, card.data(), length);
+    memset(block + length, '\0', words * 4 - length);
+    return (int)words;
+}
+
+// Printed line of a 10-word block, leaving out its '\0' characters
+string wordsToLine(const char* block)
+{
+    string line(block, 40);
+    line.erase(remove(line.begin(), line.end(), '\0'), line.end());
+    return line;
+}
+
+// Structured events. In NDJSON every event is an object with a "type" and
+// the fields of its schema. The binary form is a headerless stream of
+// records: the type byte, zigzag varints of the integer fields in schema
+// order, then for events with a text field its length as a varint and the
+// raw bytes. Streams of consecutive jobs can simply be concatenated.
+enum EventType : unsigned char
+{
+    EV_JOB_START,    // job, time_limit, line_limit
+    EV_PROGRAM_CARD, // words
+    EV_LOAD,         // addr, text: word
+    EV_DATA_START,
+    EV_INSTRUCTION,  // ic, operand, text: op
+    EV_INTERRUPT,    // si, ic
+    EV_READ,         // addr, text: card
+    EV_WRITE,        // addr, text: line
+    EV_TERMINATE,
+    EV_JOB_END,
+    EV_JOB_LOADED,   // job, pages, frames, tick
+    EV_JOB_FINISHED, // job, tick, instructions, lines, error
+    EV_PRINT,        // job, text: line
+    EV_MULTIPROGRAM, // jobs, ticks, cpu_busy, reader_busy, printer_busy, overlap, context_switches
+    EV_SPOOL,        // buffers, input_waits, output_waits
+    EV_PROFILE,      // job, instructions, gd, pd, branches, taken
+    EV_OPCODE_COUNT, // count, text: op
+    EV_HOT_LOOP,     // start, end, iterations, instructions
+    EV_HOT_ADDRESS,  // addr, count
+    EV_INFINITE_LOOP,// branch, target
+    EV_CHECKPOINT,   // instructions, ic
+    EV_RESUME        // instructions, ic
+};
+
+const EventSchema EVENT_SCHEMAS[] = {
+    {"job_start", {"job", "time_limit", "line_limit"}, nullptr},
+    {"program_card", {"words"}, nullptr},
+    {"load", {"addr"}, "word"},
+    {"data_start", {}, nullptr},
+    {"instruction", {"ic", "operand"}, "op"},
+    {"interrupt", {"si", "ic"}, nullptr},
+    {"read", {"addr"}, "card"},
+    {"write", {"addr"}, "line"},
+    {"terminate", {}, nullptr},
+    {"job_end", {}, nullptr},
+    {"job_loaded", {"job", "pages", "frames", "tick"}, nullptr},
+    {"job_finished", {"job", "tick", "instructions", "lines", "error"}, nullptr},
+    {"print", {"job"}, "line"},
+    {"multiprogram", {"jobs", "ticks", "cpu_busy", "reader_busy", "printer_busy", "overlap", "context_switches"},
+     nullptr},
+    {"spool", {"buffers", "input_waits", "output_waits"}, nullptr},
+    {"profile", {"job", "instructions", "gd", "pd", "branches", "taken"}, nullptr},
+    {"opcode_count", {"count"}, "op"},
+    {"hot_loop", {"start", "end", "iterations", "instructions"}, nullptr},
+    {"hot_address", {"addr", "count"}, nullptr},
+    {"infinite_loop", {"branch", "target"}, nullptr},
+    {"checkpoint", {"instructions", "ic"}, nullptr},
+    {"resume", {"instructions", "ic"}, nullptr}
+};
+
+const int PROFILE_TOP = 5;  // Hot loops and addresses reported per job
+
+// Execution profile of one job. A loop is a taken BT back to an address at
+// or before it; its body is the words from the target to the BT.
+struct Profile
+{
+    struct Loop
+    {
+        int start, end;
+        long long iterations, instructions;
+    };
+
+    int job;
+    long long addressCount[100];
+    long long opcodeCount[OP_BT + 1];
+    long long taken[100];  // Taken BTs by branch address
+
+    // Infinite loop detection, Brent's algorithm over the machine state at
+    // taken backward branches: a state seen again repeats forever
+    char savedMemory[100][4];
+    char savedR[4];
+    bool savedC;
+    int savedIC;
+    long long savedInput;
+    long long power, steps;
+
+    Profile() { reset(0); }
+
+    void reset(int jobId)
+    {
+        job = jobId;
+        fill(addressCount, addressCount + 100, 0);
+        fill(opcodeCount, opcodeCount + OP_BT + 1, 0);
+        fill(taken, taken + 100, 0);
+        savedIC = -1;
+        power = 1;
+        steps = 0;
+    }
+
+    // Record the state after a taken backward branch; true if it repeats one
+    bool repeats(const char (*memory)[4], const char* R, bool C, int IC, long long input)
+    {
+        if (IC == savedIC && C == savedC && input == savedInput && equal(R, R + 4, savedR)
+            && memcmp(memory, savedMemory, sizeof(savedMemory)) == 0)
+            return true;
+        if (++steps == power)
+        {
+            memcpy(savedMemory, memory, sizeof(savedMemory));
+            copy(R, R + 4, savedR);
+            savedC = C;
+            savedIC = IC;
+            savedInput = input;
+            power *= 2;
+            steps = 0;
+        }
+        return false;
+    }
+
+    long long instructions() const
+    {
+        long long total = 0;
+        for (long long count : opcodeCount)
+            total += count;
+        return total;
+    }
+
+    long long branchesTaken() const
+    {
+        long long total = 0;
+        for (long long count : taken)
+            total += count;
+        return total;
+    }
+
+    // Loops, outermost first: by start, then the longer body first
+    vector<Loop> loops(const char (*memory)[4]) const
+    {
+        vector<Loop> found;
+        for (int end = 0; end < 100; end++)
+        {
+            Instruction branch = decodeWord(memory[end]);
+            if (taken[end] == 0 || branch.op != OP_BT || branch.operand > end)
+                continue;
+            Loop loop{branch.operand, end, taken[end], 0};
+            for (int i = loop.start; i <= end; i++)
+                loop.instructions += addressCount[i];
+            found.push_back(loop);
+        }
+        sort(found.begin(), found.end(), [](const Loop& a, const Loop& b) {
+            return a.start != b.start ? a.start < b.start : a.end > b.end;
+        });
+        return found;
+    }
+
+    // Flamegraph folded stacks: job, the loops around the word, then the
+    // word itself, with its execution count
+    string folded(const char (*memory)[4], const vector<Loop>& found) const
+    {
+        string out;
+        char frame[16];
+        for (int i = 0; i < 100; i++)
+        {
+            if (addressCount[i] == 0)
+                continue;
+            out += "job" + to_string(job);
+            for (const Loop& loop : found)
+            {
+                if (loop.start <= i && i <= loop.end)
+                {
+                    snprintf(frame, sizeof(frame), ";loop_M%02d-M%02d", loop.start, loop.end);
+                    out += frame;
+                }
+            }
+            snprintf(frame, sizeof(frame), ";M%02d_", i);
+            out += frame;
+            out.append(memory[i], strnlen(memory[i], 4));
+            out += ' ' + to_string(addressCount[i]) + '\n';
+        }
+        return out;
+    }
+};
+
+
+// Checkpoint of a VM between two instructions, written to disk as is:
+// fixed layout, host byte order. The decoded cache is rebuilt on restore.
+const uint32_t VM_SNAPSHOT_VERSION = 1;
+
+struct VMSnapshot
+{
+    char magic[4];           // "P1CK"
+    uint32_t version;
+    int64_t instructions;    // Executed over the deck so far
+    int64_t inputPosition;   // Next card of the deck, -1 once it is used up
+    int64_t deckSize;        // To refuse resuming against another deck
+    int32_t IC;
+    int32_t SI;
+    char memory[100][4];
+    char IR[4];
+    char R[4];
+    uint8_t C;
+    uint8_t inputExhausted;
+    uint8_t reserved[6];
+};
+static_assert(sizeof(VMSnapshot) == 456, "VMSnapshot is written to disk as is");
+
+// Receives each checkpoint as it is taken
+typedef function<void(const VMSnapshot&)> CheckpointSink;
+
+struct VMCheckpoints
+{
+    long long every;           // Instructions between checkpoints, 0 for none
+    CheckpointSink sink;
+    const VMSnapshot* resume;  // Start from here instead of the top of the deck
+
+    VMCheckpoints() : every(0), resume(nullptr) {}
+};
+
 class VM
 {
 private:
-    char buffer[40];
     char Memory[100][4];
     char IR[4]; // Instruction Register sa
     char R[4];  // General purpose Register
     bool C;     //  Toggle Register
     int IC;     // Instruction counter
     int SI;     // System Interrupt
+    Instruction decoded[100]; // Memory decoded once at load time
     stringstream infile;  // Changed from fstream to stringstream
-    stringstream outfile; // Changed from ofstream to stringstream
     string outputContent; // Store output for API response
+    bool inputExhausted;  // A GD read past its job's data cards
+    long long instructionCount; // Instructions executed over the whole deck
+    EventStream events;   // Structured output instead of the text log
+    OutputSink sink;      // Set when output is streamed job by job
+    unique_ptr<Profile> profile;  // Null unless profiling
+    string folded;        // Folded stacks of the profiled jobs
+    long long checkpointEvery;    // 0 unless checkpointing
+    CheckpointSink checkpointSink;
+    long long lastCheckpoint;     // Instruction count of the last one taken or resumed from
+
+    // Hand everything logged so far to the sink, if there is one
+    void flushOutput()
+    {
+        if (!sink)
+            return;
+        string data = events.enabled() ? events.take() : move(outputContent);
+        outputContent.clear();
+        if (!data.empty())
+            sink(data);
+    }
 
-    // Initialize all the variables (buffer, memory, IR, R, IC, C, SI)
+    // Initialize all the variables (memory, IR, R, IC, C, SI)
     void init()
     {
-        fill(buffer, buffer + sizeof(buffer), '\0');
         fill(&Memory[0][0], &Memory[0][0] + sizeof(Memory), '\0');
         fill(IR, IR + sizeof(IR), '\0');
         fill(R, R + sizeof(R), '\0');
+        fill(decoded, decoded + 100, Instruction{OP_END, 0});
         IC = 0;
         C = true;
         SI = 0;
-        outputContent = ""; // Initialize output content
     }
 
-    // Reset buffer to null
-    void resetBuffer()
+    // Decode the word at Memory[addr] into an opcode and operand
+    Instruction decode(int addr) const
+    {
+        return decodeWord(Memory[addr]);
+    }
+
+    // Any store into Memory must drop the decoded copy of that word
+    void invalidate(int addr)
+    {
+        decoded[addr].op = OP_UNDECODED;
+    }
+
+    // Numeric field of a control card, 0 if missing or malformed
+    static int cardField(const string& line, size_t pos)
     {
-        fill(buffer, buffer + sizeof(buffer), '\0');
+        int value = 0;
+        if (line.size() < pos + 4 || from_chars(line.data() + pos, line.data() + pos + 4, value).ec != errc())
+            return 0;
+        return value;
+    }
+
+    // A taken BT at `branch`; false if it closes an infinite loop, which
+    // ends the job with a time limit interrupt
+    bool profileBranch(int branch, int target)
+    {
+        profile->taken[branch]++;
+        if (target > branch || !profile->repeats(Memory, R, C, target, (long long)infile.tellg()))
+            return true;
+
+        if (events.enabled())
+            events.emit(EV_INFINITE_LOOP, {branch, target});
+        else
+            outputContent += "Time limit interrupt: infinite loop from M[" + to_string(branch) + "] back to M["
+                             + to_string(target) + "]\n";
+        TERMINATE();
+        return false;
+    }
+
+    // Summary of the job's profile, and its folded stacks
+    void reportProfile()
+    {
+        const Profile& p = *profile;
+        long long total = p.instructions();
+        if (total == 0)
+            return;
+        vector<Profile::Loop> loops = p.loops(Memory);
+        folded += p.folded(Memory, loops);
+
+        // Hottest first; the loops by instructions spent in their body
+        sort(loops.begin(), loops.end(), [](const Profile::Loop& a, const Profile::Loop& b) {
+            return a.instructions > b.instructions;
+        });
+        if (loops.size() > (size_t)PROFILE_TOP)
+            loops.resize(PROFILE_TOP);
+        vector<int> hot;
+        for (int i = 0; i < 100; i++)
+            if (p.addressCount[i] > 0)
+                hot.push_back(i);
+        stable_sort(hot.begin(), hot.end(), [&p](int a, int b) { return p.addressCount[a] > p.addressCount[b]; });
+        if (hot.size() > (size_t)PROFILE_TOP)
+            hot.resize(PROFILE_TOP);
+
+        long long branches = p.opcodeCount[OP_BT], taken = p.branchesTaken();
+        if (events.enabled())
+        {
+            events.emit(EV_PROFILE, {p.job, total, p.opcodeCount[OP_GD], p.opcodeCount[OP_PD], branches, taken});
+            for (int op = OP_NOP; op <= OP_BT; op++)
+                if (p.opcodeCount[op] > 0)
+                    events.emit(EV_OPCODE_COUNT, {p.opcodeCount[op]}, MNEMONICS[op]);
+            for (const Profile::Loop& loop : loops)
+                events.emit(EV_HOT_LOOP, {loop.start, loop.end, loop.iterations, loop.instructions});
+            for (int addr : hot)
+                events.emit(EV_HOT_ADDRESS, {addr, p.addressCount[addr]});
+            return;
+        }
+
+        ostringstream out;
+        out << fixed << setprecision(2);
+        out << "Profile of job " << p.job << ": " << total << " instruction(s)\n";
+        out << "  Opcodes:";
+        const char* separator = " ";
+        for (int op = OP_NOP; op <= OP_BT; op++)
+        {
+            if (p.opcodeCount[op] > 0)
+            {
+                out << separator << MNEMONICS[op] << " " << p.opcodeCount[op];
+                separator = ", ";
+            }
+        }
+        out << "\n  I/O: " << p.opcodeCount[OP_GD] << " GD, " << p.opcodeCount[OP_PD] << " PD\n";
+        out << "  Branches: " << branches << " BT, " << taken << " taken";
+        if (branches > 0)
+            out << " (" << (double)taken / branches * 100 << "%)";
+        out << "\n";
+        for (const Profile::Loop& loop : loops)
+            out << "  Hot loop M[" << loop.start << "]-M[" << loop.end << "]: " << loop.iterations << " iteration(s), "
+                << loop.instructions << " instructions (" << (double)loop.instructions / total * 100 << "%)\n";
+        out << "  Hot addresses:";
+        separator = " ";
+        for (int addr : hot)
+        {
+            out << separator << "M[" << addr << "] " << p.addressCount[addr];
+            separator = ", ";
+        }
+        out << "\n";
+        outputContent += out.str();
     }
 
     // Master Mode
     void MOS()
     {
+        if (events.enabled())
+            events.emit(EV_INTERRUPT, {SI, IC - 1});
+
         switch (SI)
         {
         case 1:
@@ -58,6 +493,62 @@ private:
         SI = 0;
     }
 
+    // State between two instructions of the current job
+    VMSnapshot snapshot()
+    {
+        VMSnapshot snap;
+        memset(&snap, 0, sizeof(snap));
+        memcpy(snap.magic, "P1CK", 4);
+        snap.version = VM_SNAPSHOT_VERSION;
+        snap.instructions = instructionCount;
+        snap.inputPosition = (int64_t)infile.tellg();
+        snap.deckSize = (int64_t)infile.str().size();
+        snap.IC = IC;
+        snap.SI = SI;
+        memcpy(snap.memory, Memory, sizeof(Memory));
+        memcpy(snap.IR, IR, sizeof(IR));
+        memcpy(snap.R, R, sizeof(R));
+        snap.C = C;
+        snap.inputExhausted = inputExhausted;
+        return snap;
+    }
+
+    void takeCheckpoint()
+    {
+        lastCheckpoint = instructionCount;
+        if (events.enabled())
+            events.emit(EV_CHECKPOINT, {instructionCount, IC});
+        else
+            outputContent += "Checkpoint at instruction " + to_string(instructionCount) + "\n";
+        checkpointSink(snapshot());
+    }
+
+    // Pick up the job a snapshot was taken in, then the rest of the deck
+    void resume(const VMSnapshot& snap)
+    {
+        init();
+        memcpy(Memory, snap.memory, sizeof(Memory));
+        fill(decoded, decoded + 100, Instruction{OP_UNDECODED, 0});
+        memcpy(IR, snap.IR, sizeof(IR));
+        memcpy(R, snap.R, sizeof(R));
+        C = snap.C != 0;
+        IC = snap.IC;
+        SI = snap.SI;
+        inputExhausted = snap.inputExhausted != 0;
+        instructionCount = lastCheckpoint = snap.instructions;
+        if (snap.inputPosition < 0)
+            infile.seekg(0, ios::end).setstate(ios::failbit);
+        else
+            infile.seekg(snap.inputPosition);
+
+        if (events.enabled())
+            events.emit(EV_RESUME, {instructionCount, IC});
+        else
+            outputContent += "Resumed from checkpoint at instruction " + to_string(instructionCount) + "\n";
+        EXECUTEUSERPROGRAM();
+        LOAD();
+    }
+
     void LOAD()
     {
         if (infile.str().empty())
@@ -71,44 +562,67 @@ private:
             if (line.substr(0, 4) == "$AMJ")
             {
                 init();
-                outputContent += "New Job started\n";
-                // Reset output stream
-                outfile.str("");
-                outfile.clear();
+                if (profile)
+                    profile->reset(cardField(line, 4));
+                if (events.enabled())
+                    events.emit(EV_JOB_START, {cardField(line, 4), cardField(line, 8), cardField(line, 12)});
+                else
+                    outputContent += "New Job started\n";
             }
 
             // --- START OF DATA ---
             else if (line.substr(0, 4) == "$DTA")
             {
-                outputContent += "Data card loading\n";
-                resetBuffer();
+                if (events.enabled())
+                    events.emit(EV_DATA_START);
+                else
+                    outputContent += "Data card loading\n";
                 STARTEXE();
             }
 
             // --- END OF JOB ---
             else if (line.substr(0, 4) == "$END")
             {
-                outputContent += "END of Job\n";
+                if (profile)
+                {
+                    reportProfile();
+                    profile->reset(profile->job);
+                }
+                if (events.enabled())
+                    events.emit(EV_JOB_END);
+                else
+                    outputContent += "END of Job\n";
+                flushOutput();
             }
 
             // -- PROGRAM CARD --
             else
             {
-                outputContent += "Program Card loading\n";
-
                 stringstream ss(line);
                 string instr;
+                int firstWord = IC;
 
                 // Split line into instructions like "GD20", "PD20", "H"
-                while (ss >> instr)
+                while (ss >> instr && IC < 100)
                 {
                     for (int j = 0; j < 4; j++)
                     {
                         Memory[IC][j] = (j < instr.size()) ? instr[j] : '\0';
                     }
+                    decoded[IC] = decode(IC);
                     IC++;
                 }
 
+                if (events.enabled())
+                {
+                    events.emit(EV_PROGRAM_CARD, {IC - firstWord});
+                    for (int i = firstWord; i < IC; i++)
+                        events.emit(EV_LOAD, {i}, string_view(Memory[i], strnlen(Memory[i], 4)));
+                    continue;
+                }
+
+                outputContent += "Program Card loading\n";
+
                 // Debug: print just the loaded instructions
                 for (int i = 0; i < IC; i++)
                 {
@@ -119,6 +633,9 @@ private:
                 }
             }
         }
+        if (profile)
+            reportProfile();  // A last job without $END
+        flushOutput();
     }
 
     void STARTEXE()
@@ -129,144 +646,140 @@ private:
 
     void READ()
     {
-        outputContent += "Read function called\n";
+        if (!events.enabled())
+            outputContent += "Read function called\n";
+
+        int block = (IR[2] - '0') * 10;
+        if (block < 0 || block > 90)
+            return;
 
         string data;
-        if (getline(infile, data)) {
-            int len = data.size();
-            for (int i = 0; i < len; i++)
-            {
-                buffer[i] = data[i];
-            }
-            int buff = 0, mem_ptr = (IR[2] - '0') * 10;
-            while (buff < 40 && buffer[buff] != '\0')
-            {
-                for (int i = 0; i < 4; i++)
-                {
-                    Memory[mem_ptr][i] = buffer[buff];
-                    buff++;
-                }
-                mem_ptr++;
-            }
+        // Past the job's data cards: a serial run reads on into the next job
+        if (!getline(infile, data) || data.compare(0, 4, "$END") == 0 || data.compare(0, 4, "$AMJ") == 0)
+            inputExhausted = true;
+        if (infile) {
+            if (events.enabled())
+                events.emit(EV_READ, {block}, data);
+            int words = cardToWords(data, Memory[block]);
+            for (int i = 0; i < words; i++)
+                invalidate(block + i);
         }
-        resetBuffer();
     }
 
     void WRITE()
     {
-        outputContent += "Write function called\n";
+        int block = (IR[2] - '0') * 10;
+        if (block < 0 || block > 90)
+            return;
+        string line = wordsToLine(Memory[block]);
 
-        for (int i = (IR[2] - '0') * 10; i < (IR[2] - '0' + 1) * 10; i++)
+        if (events.enabled())
         {
-            for (int j = 0; j < 4; j++)
-            {
-                if (Memory[i][j] != '\0')
-                {
-                    outfile << Memory[i][j];
-                    outputContent += Memory[i][j]; // Also add to output content
-                }
-            }
+            events.emit(EV_WRITE, {block}, line);
+            return;
         }
-        outfile << "\n";
+        outputContent += "Write function called\n";
+        outputContent += line; // Also add to output content
         outputContent += "\n";
     }
 
     void TERMINATE()
     {
+        if (events.enabled())
+        {
+            events.emit(EV_TERMINATE);
+            return;
+        }
         outputContent += "Terminate called\n\n";
-        outfile << "\n\n";
         outputContent += "\n\n";
     }
 
     void EXECUTEUSERPROGRAM()
     { // Slave Mode
-        while (IC < 99 && Memory[IC][0] != '\0')
+        while (IC < 99)
         {
+            Instruction ins = decoded[IC];
+            if (ins.op == OP_UNDECODED)
+            {
+                ins = decoded[IC] = decode(IC);
+            }
+            if (ins.op == OP_END)
+            {
+                return;
+            }
 
-            for (int i = 0; i < 4; i++)
+            if (checkpointEvery > 0 && instructionCount % checkpointEvery == 0 && instructionCount != lastCheckpoint)
+                takeCheckpoint();
+            instructionCount++;
+            if (events.enabled())
+                events.emit(EV_INSTRUCTION, {IC, ins.operand}, MNEMONICS[ins.op]);
+            if (profile)
             {
-                IR[i] = Memory[IC][i];
+                profile->addressCount[IC]++;
+                profile->opcodeCount[ins.op]++;
+            }
+
+            // Only the trapping instructions need IR, MOS reads it
+            if (ins.op == OP_GD || ins.op == OP_PD || ins.op == OP_H)
+            {
+                copy(Memory[IC], Memory[IC] + 4, IR);
             }
 
             IC++;
 
             // SI= 1-GD, 2-PD, 3-H
-
-            // GD
-            if (IR[0] == 'G' && IR[1] == 'D')
+            switch (ins.op)
             {
+            case OP_GD:
                 SI = 1;
                 MOS();
-            }
+                break;
 
-            // PD
-            else if (IR[0] == 'P' && IR[1] == 'D')
-            {
+            case OP_PD:
                 SI = 2;
                 MOS();
-            }
+                break;
 
-            // H
-            else if (IR[0] == 'H')
-            {
+            case OP_H:
                 SI = 3;
                 MOS();
                 return;
-            }
 
             // LR - LOAD DATA (R <-- memory[IR[2,3]])
-            else if (IR[0] == 'L' && IR[1] == 'R')
-            {
-                for (int i = 0; i < 4; i++)
-                {
-                    R[i] = Memory[(IR[2] - '0') * 10 + (IR[3] - '0')][i];
-                }
-            }
+            case OP_LR:
+                copy(Memory[ins.operand], Memory[ins.operand] + 4, R);
+                break;
 
             // SR - STORE (memory[IR[2,3]] <-- R)
-            else if (IR[0] == 'S' && IR[1] == 'R')
-            {
-                for (int i = 0; i < 4; i++)
-                {
-                    Memory[(IR[2] - '0') * 10 + (IR[3] - '0')][i] = R[i];
-                }
-            }
+            case OP_SR:
+                copy(R, R + 4, Memory[ins.operand]);
+                invalidate(ins.operand);
+                break;
 
             // CR - COMPARE(R, memory[IR[2,3]])
-            else if (IR[0] == 'C' && IR[1] == 'R')
-            {
-                int cnt = 0;
-                for (int i = 0; i < 4; i++)
-                {
-                    if (Memory[(IR[2] - '0') * 10 + (IR[3] - '0')][i] == R[i])
-                    {
-                        cnt++;
-                    }
-                }
-                if (cnt == 4)
-                {
-                    C = true;
-                }
-                else
-                {
-                    C = false;
-                }
-            }
+            case OP_CR:
+                C = equal(R, R + 4, Memory[ins.operand]);
+                break;
 
             // BT (JUMP if toogle is T)
-            else if (IR[0] == 'B' && IR[1] == 'T')
-            {
+            case OP_BT:
                 if (C)
                 {
-                    IC = (IR[2] - '0') * 10 + (IR[3] - '0');
+                    if (profile && !profileBranch(IC - 1, ins.operand))
+                        return;
+                    IC = ins.operand;
                 }
+                break;
+
+            default:
+                break;
             }
         }
     }
 
 public:
     // Original constructor for file-based execution
-    VM()
+    VM() : events(FORMAT_TEXT)
     {
         // infile.open("./example_job.txt", ios::in);
         // infile.open("./input_custom.txt", ios::in);
@@ -277,24 +790,882 @@ public:
             infile.str(content);
             file.close();
         }
+        outputContent = "";
+        inputExhausted = false;
+        instructionCount = 0;
+        checkpointEvery = 0;
+        lastCheckpoint = 0;
         init();
         LOAD();
     }
 
-    // New constructor for API-based execution
-    VM(const string& inputContent)
+    // New constructor for API-based execution; with a sink the output is
+    // streamed to it after every job and getOutput() stays empty. Profiling
+    // adds a profile after each job. With checkpoints the run may start
+    // from a snapshot, which must come from the same deck and be unprofiled.
+    VM(const string& inputContent, OutputFormat format = FORMAT_TEXT, OutputSink outputSink = nullptr,
+       bool profiling = false, const VMCheckpoints* checkpoints = nullptr)
+        : events(format), sink(move(outputSink)), profile(profiling ? new Profile() : nullptr)
     {
         infile.str(inputContent);
+        outputContent = "";
+        inputExhausted = false;
+        instructionCount = 0;
+        checkpointEvery = checkpoints ? checkpoints->every : 0;
+        if (checkpoints)
+            checkpointSink = checkpoints->sink;
+        lastCheckpoint = 0;
+        if (checkpoints && checkpoints->resume)
+        {
+            resume(*checkpoints->resume);
+            return;
+        }
         init();
         LOAD();
     }
 
     // Method to get output for API response
     string getOutput() const {
-        return outputContent;
+        return events.enabled() ? events.str() : outputContent;
     }
+
+    bool readPastEnd() const {
+        return inputExhausted;
+    }
+
+    long long instructionsExecuted() const {
+        return instructionCount;
+    }
+
+    // Flamegraph folded stacks of every profiled job so far
+    const string& foldedStacks() const {
+        return folded;
+    }
+};
+
+// Multiprogramming, see Multiprogrammer
+const int PAGE_WORDS = 10;
+const int JOB_PAGES = 10;  // 100-word address space
+const int MP_FRAMES = 30;  // Default shared memory, 300 words
+const int MP_SLICE = 10;   // Default time slice, in instructions
+const int MP_IO_TIME = 5;  // Default ticks per card read or line printed
+const int SPOOL_BUFFERS = 4;  // Default buffers per spooling pool
+
+// Settings for running a deck
+struct RunOptions
+{
+    int threads;         // 0 runs the whole deck serially in one VM
+    OutputFormat format;
+    int frames;          // > 0 multiprograms the jobs in that much shared memory
+    int slice;           // Multiprogramming time slice, in instructions
+    int ioTime;          // Ticks per card read or line printed
+    int spoolBuffers;    // > 0 spools multiprogrammed I/O through that many buffers each way
+    bool profile;        // Profile each job of a serial or batch run
+    string foldedPath;   // File for the profile's folded stacks, in file mode
+
+    RunOptions() : threads(0), format(FORMAT_TEXT), frames(0), slice(MP_SLICE), ioTime(MP_IO_TIME), spoolBuffers(0),
+                   profile(false) {}
 };
 
+// Apply a --name[=value] run option; returns false if arg is not a valid one
+bool parseRunOption(const string& arg, RunOptions& options)
+{
+    if (arg == "--batch") {
+        options.threads = max(1u, thread::hardware_concurrency());
+    }
+    else if (arg.compare(0, 8, "--batch=") == 0) {
+        options.threads = max(1, atoi(arg.c_str() + 8));
+    }
+    else if (arg == "--multiprogram") {
+        options.frames = MP_FRAMES;
+    }
+    else if (arg.compare(0, 15, "--multiprogram=") == 0) {
+        options.frames = atoi(arg.c_str() + 15);
+        return options.frames > 0;
+    }
+    else if (arg.compare(0, 8, "--slice=") == 0) {
+        options.slice = atoi(arg.c_str() + 8);
+        return options.slice > 0;
+    }
+    else if (arg == "--spool") {
+        options.spoolBuffers = SPOOL_BUFFERS;
+    }
+    else if (arg.compare(0, 8, "--spool=") == 0) {
+        options.spoolBuffers = atoi(arg.c_str() + 8);
+        return options.spoolBuffers > 0;
+    }
+    else if (arg.compare(0, 10, "--io-time=") == 0) {
+        options.ioTime = atoi(arg.c_str() + 10);
+        return options.ioTime >= 0;
+    }
+    else if (arg == "--profile") {
+        options.profile = true;
+    }
+    else if (arg.compare(0, 10, "--profile=") == 0) {
+        options.profile = true;
+        options.foldedPath = arg.substr(10);
+        return !options.foldedPath.empty();
+    }
+    else if (arg == "--format=text") {
+        options.format = FORMAT_TEXT;
+    }
+    else if (arg == "--format=ndjson") {
+        options.format = FORMAT_NDJSON;
+    }
+    else if (arg == "--format=binary") {
+        options.format = FORMAT_BINARY;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Split a deck into independent jobs, each starting at its $AMJ card.
+// Anything before the first $AMJ forms a job of its own.
+vector<string> splitJobs(const string& deck)
+{
+    vector<string> jobs;
+    size_t jobStart = 0, pos = 0;
+    while (pos < deck.size()) {
+        if (pos > jobStart && deck.compare(pos, 4, "$AMJ") == 0) {
+            jobs.push_back(deck.substr(jobStart, pos - jobStart));
+            jobStart = pos;
+        }
+        size_t newline = deck.find('\n', pos);
+        pos = (newline == string::npos) ? deck.size() : newline + 1;
+    }
+    if (jobStart < deck.size()) {
+        jobs.push_back(deck.substr(jobStart));
+    }
+    return jobs;
+}
+
+// Batch mode: every job runs on its own VM in a pool of worker threads and
+// the outputs are handed to the sink in input order as soon as each is ready,
+// matching a serial run byte for byte. Folded profile stacks, if wanted,
+// are appended to `folded` in the same order.
+void runBatch(const string& deck, const RunOptions& options, const OutputSink& sink, string* folded)
+{
+    vector<string> jobs = splitJobs(deck);
+    vector<string> outputs(jobs.size());
+    vector<string> stacks(jobs.size());
+    vector<char> readPastEnd(jobs.size(), 0);
+    vector<char> finished(jobs.size(), 0);
+    atomic<size_t> nextJob(0);
+    mutex resultLock;
+    condition_variable resultReady;
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = nextJob++) < jobs.size()) {
+            VM vm(jobs[i], options.format, nullptr, options.profile);
+            lock_guard<mutex> lock(resultLock);
+            outputs[i] = vm.getOutput();
+            stacks[i] = vm.foldedStacks();
+            readPastEnd[i] = vm.readPastEnd();
+            finished[i] = 1;
+            resultReady.notify_all();
+        }
+    };
+
+    vector<thread> pool;
+    for (int t = 0; t < options.threads && t < (int)jobs.size(); t++) {
+        pool.emplace_back(worker);
+    }
+
+    size_t next = 0;
+    for (; next < jobs.size(); next++) {
+        unique_lock<mutex> lock(resultLock);
+        resultReady.wait(lock, [&] { return finished[next] != 0; });
+        if (readPastEnd[next] && next + 1 < jobs.size()) {
+            break;
+        }
+        string output = move(outputs[next]);
+        if (folded)
+            *folded += stacks[next];
+        lock.unlock();
+        sink(output);
+    }
+
+    // A GD that ran out of data cards would have read the next job's cards
+    // in a serial run, so the deck from that job on is replayed serially
+    if (next < jobs.size()) {
+        nextJob = jobs.size();
+        string rest;
+        for (size_t i = next; i < jobs.size(); i++) {
+            rest += jobs[i];
+        }
+        VM vm(rest, options.format, sink, options.profile);
+        if (folded)
+            *folded += vm.foldedStacks();
+    }
+
+    for (auto& th : pool) {
+        th.join();
+    }
+}
+
+// Multiprogramming mode. The jobs of a deck are resident together in one
+// shared memory of `frames` frames of PAGE_WORDS words. Each job sees the
+// usual 100-word address space through its own page table, as in phase 2:
+// a page gets a frame when it is first written by program loading, GD or
+// SR, and LR, CR or PD through an unmapped page is an invalid page fault.
+// A job is admitted, in deck order, once the frames it can need are free:
+// its program pages plus the pages its GD and SR instructions write.
+// Resident jobs take turns round robin, one tick per instruction. GD and
+// PD go to the card reader and the line printer, which serve one request
+// at a time and take `ioTime` ticks each; meanwhile the job waits and the
+// CPU runs the others.
+//
+// With spooling, each device is driven by a channel through a pool of
+// buffers, running alongside the CPU in simulated time. The reader channel
+// reads the data cards of resident jobs, in admission order, into free
+// input buffers ahead of their GDs, so a GD only waits if its card has not
+// been read yet. A PD copies the line into a free output buffer and goes
+// on; the printer channel drains the buffers in order, and a PD only
+// waits when all of them are full.
+
+// Why a job ended, numbered as the MOS error codes
+enum JobError
+{
+    ERR_NONE = 0,
+    ERR_OUT_OF_DATA = 1,
+    ERR_LINE_LIMIT = 2,
+    ERR_TIME_LIMIT = 3,
+    ERR_INVALID_PAGE = 6,
+    ERR_MEMORY = 7  // Needs more frames than the machine has
+};
+
+const char* jobErrorMessage(int error)
+{
+    switch (error)
+    {
+    case ERR_NONE: return "No error";
+    case ERR_OUT_OF_DATA: return "Out of data";
+    case ERR_LINE_LIMIT: return "Line limit exceeded";
+    case ERR_TIME_LIMIT: return "Time limit exceeded";
+    case ERR_INVALID_PAGE: return "Invalid page fault";
+    default: return "Memory exceeded";
+    }
+}
+
+struct PageTableEntry
+{
+    int frameNumber;
+    bool valid;
+};
+
+// A job and its saved CPU state
+struct MPJob
+{
+    int id;
+    int timeLimit;  // Instructions, 0 for none
+    int lineLimit;  // Lines printed, 0 for none
+    vector<string> program;  // Words of the program cards
+    vector<string> data;     // Data cards
+    size_t nextCard;
+    size_t cardsSpooled;     // Read into input buffers, with spooling
+    int pendingPage;         // Page of a GD waiting for its card, -1 if none
+    PageTableEntry pageTable[JOB_PAGES];
+    int reserved;  // Frames set aside at admission
+    int mapped;    // Frames in use
+    char R[4];
+    bool C;
+    int IC;
+    long long instructions;
+    vector<string> lines;    // Printed, spooled until the job ends
+    long long ioDone;        // Tick its GD/PD completes
+    long long finish;
+
+    MPJob() : id(0), timeLimit(0), lineLimit(0), nextCard(0), cardsSpooled(0), pendingPage(-1), reserved(0), mapped(0),
+              C(true), IC(0),
+              instructions(0), ioDone(0), finish(-1)
+    {
+        fill(R, R + 4, '\0');
+        fill(pageTable, pageTable + JOB_PAGES, PageTableEntry{-1, false});
+    }
+};
+
+// A card reader or line printer, one request at a time
+struct Device
+{
+    long long freeAt;     // Tick the last queued request completes
+    long long spanStart;  // Start of the current busy stretch
+    long long busy;       // Total busy ticks
+
+    Device() : freeAt(0), spanStart(0), busy(0) {}
+
+    // Queue a request made at `now`; returns its completion tick
+    long long request(long long now, int ioTime)
+    {
+        if (now >= freeAt)
+            spanStart = now;
+        freeAt = max(now, freeAt) + ioTime;
+        busy += ioTime;
+        return freeAt;
+    }
+
+    bool busyAt(long long tick) const
+    {
+        return tick >= spanStart && tick < freeAt;
+    }
+};
+
+class Multiprogrammer
+{
+private:
+    int frames;
+    int slice;
+    int ioTime;
+    vector<char> memory;          // frames * PAGE_WORDS words of 4 characters
+    vector<Instruction> decoded;  // Per physical word, as in VM
+    vector<int> freeFrames;
+    int available;                // Free frames not reserved by a resident job
+    Device reader, printer;
+    int spoolBuffers;             // 0 without spooling
+    int inputBuffers;             // Holding a card read or being read
+    deque<long long> printing;    // Completion ticks of the full output buffers
+    deque<MPJob*> readQueue;      // Jobs whose cards the reader channel has yet to read
+    MPJob* reading;               // Owner of the card being read
+    long long readDone;
+    long long readerClock;        // The reader channel can go on from here
+    deque<MPJob*> woken;          // Jobs whose card arrived
+    long long inputWaits, outputWaits;
+    long long now;
+    long long cpuBusy, overlap, contextSwitches, timerInterrupts;
+    long long ended, aborted, turnaround;  // Over finished jobs; all arrive at tick 0
+    EventStream events;
+    string outputContent;
+    OutputSink sink;
+
+    // Hand everything logged so far to the sink, if there is one
+    void flushOutput()
+    {
+        if (!sink)
+            return;
+        string data = events.enabled() ? events.take() : move(outputContent);
+        outputContent.clear();
+        if (!data.empty())
+            sink(data);
+    }
+
+    char* word(int physical)
+    {
+        return &memory[(size_t)physical * 4];
+    }
+
+    // Physical word of a job's virtual address, -1 if its page is unmapped
+    int translate(const MPJob& job, int addr) const
+    {
+        const PageTableEntry& entry = job.pageTable[addr / PAGE_WORDS];
+        return entry.valid ? entry.frameNumber * PAGE_WORDS + addr % PAGE_WORDS : -1;
+    }
+
+    // Give a page a cleared frame, out of the job's reservation if there
+    // is any left; false if memory is exhausted
+    bool mapPage(MPJob& job, int page)
+    {
+        if (job.pageTable[page].valid)
+            return true;
+        if (job.mapped == job.reserved)
+        {
+            if (available == 0)
+                return false;
+            available--;
+            job.reserved++;
+        }
+        int frame = freeFrames.back();
+        freeFrames.pop_back();
+        job.pageTable[page] = PageTableEntry{frame, true};
+        job.mapped++;
+        fill(word(frame * PAGE_WORDS), word(frame * PAGE_WORDS) + PAGE_WORDS * 4, '\0');
+        fill(decoded.begin() + frame * PAGE_WORDS, decoded.begin() + (frame + 1) * PAGE_WORDS, Instruction{OP_END, 0});
+        return true;
+    }
+
+    // Copy a card into a mapped page in one transfer
+    void transferCard(MPJob& job, int page, const string& card)
+    {
+        int base = job.pageTable[page].frameNumber * PAGE_WORDS;
+        int words = cardToWords(card, word(base));
+        for (int i = 0; i < words; i++)
+            decoded[base + i].op = OP_UNDECODED;
+    }
+
+    // Run the reader channel up to tick t: finish the card in flight, hand
+    // it to a GD waiting for it, and start on the next card while an input
+    // buffer is free
+    void advanceReader(long long t)
+    {
+        while (true)
+        {
+            if (reading != nullptr)
+            {
+                if (readDone > t)
+                    return;
+                MPJob& job = *reading;
+                reading = nullptr;
+                readerClock = max(readerClock, readDone);
+                if (job.finish >= 0)
+                    inputBuffers--;  // Its job ended while the card was read
+                else if (++job.cardsSpooled, job.pendingPage >= 0)
+                {
+                    transferCard(job, job.pendingPage, job.data[job.nextCard++]);
+                    job.pendingPage = -1;
+                    inputBuffers--;
+                    woken.push_back(&job);
+                }
+            }
+            while (!readQueue.empty()
+                   && (readQueue.front()->finish >= 0 || readQueue.front()->cardsSpooled == readQueue.front()->data.size()))
+                readQueue.pop_front();
+            if (readQueue.empty() || inputBuffers == spoolBuffers)
+                return;
+            reading = readQueue.front();
+            inputBuffers++;
+            readDone = reader.request(readerClock, ioTime);
+        }
+    }
+
+    // The reader channel may go on from now: a buffer was freed or a job
+    // arrived since advancing it to now
+    void kickReader()
+    {
+        readerClock = max(readerClock, now);
+        advanceReader(now);
+    }
+
+    // Frames a job can need: program pages and the pages GD and SR write
+    static int framesNeeded(const MPJob& job)
+    {
+        bool needed[JOB_PAGES] = {false};
+        for (size_t i = 0; i < job.program.size(); i++)
+        {
+            needed[i / PAGE_WORDS] = true;
+            Instruction ins = decodeWord(job.program[i].c_str());
+            if (ins.op == OP_GD || ins.op == OP_SR)
+                needed[ins.operand / PAGE_WORDS] = true;
+        }
+        return (int)count(needed, needed + JOB_PAGES, true);
+    }
+
+    void admit(MPJob& job, int needed)
+    {
+        available -= needed;
+        job.reserved = needed;
+        for (size_t i = 0; i < job.program.size(); i++)
+        {
+            mapPage(job, (int)i / PAGE_WORDS);
+            int physical = translate(job, (int)i);
+            copy(job.program[i].begin(), job.program[i].end(), word(physical));
+            decoded[physical] = decodeWord(word(physical));
+        }
+        int pages = (int)(job.program.size() + PAGE_WORDS - 1) / PAGE_WORDS;
+        if (events.enabled())
+            events.emit(EV_JOB_LOADED, {job.id, pages, needed, now});
+        else
+            outputContent += "[t=" + to_string(now) + "] Job " + to_string(job.id) + " loaded: " + to_string(pages)
+                             + " program page(s), " + to_string(needed) + " frame(s) reserved\n";
+    }
+
+    void finish(MPJob& job, int error)
+    {
+        if (spoolBuffers > 0)
+            advanceReader(now);
+        job.finish = now;
+        ended++;
+        aborted += (error != ERR_NONE);
+        turnaround += now;
+        for (PageTableEntry& entry : job.pageTable)
+        {
+            if (entry.valid)
+                freeFrames.push_back(entry.frameNumber);
+            entry = PageTableEntry{-1, false};
+        }
+        available += job.reserved;
+        job.reserved = job.mapped = 0;
+        if (spoolBuffers > 0 && job.cardsSpooled > job.nextCard)
+        {
+            inputBuffers -= (int)(job.cardsSpooled - job.nextCard);
+            job.nextCard = job.cardsSpooled;
+            kickReader();
+        }
+
+        if (events.enabled())
+        {
+            events.emit(EV_JOB_FINISHED, {job.id, now, job.instructions, (long long)job.lines.size(), error});
+            for (const string& line : job.lines)
+                events.emit(EV_PRINT, {job.id}, line);
+        }
+        else
+        {
+            outputContent += "[t=" + to_string(now) + "] Job " + to_string(job.id) + " ended: "
+                             + jobErrorMessage(error) + ", " + to_string(job.instructions) + " instruction(s), "
+                             + to_string(job.lines.size()) + " line(s)\n";
+            for (const string& line : job.lines)
+                outputContent += line + "\n";
+            outputContent += "\n";
+        }
+        flushOutput();
+    }
+
+    enum StepResult
+    {
+        STEP_CONTINUE,
+        STEP_IO,      // Waiting for the reader or printer until ioDone
+        STEP_BLOCKED, // Waiting for the reader channel to read its card
+        STEP_ENDED
+    };
+
+    // Run one instruction of a job at tick `now`
+    StepResult step(MPJob& job)
+    {
+        int physical = job.IC < 100 ? translate(job, job.IC) : -1;
+        Instruction ins = physical < 0 ? Instruction{OP_END, 0} : decoded[physical];
+        if (ins.op == OP_UNDECODED)
+            ins = decoded[physical] = decodeWord(word(physical));
+        if (ins.op == OP_END)
+        {
+            finish(job, ERR_NONE);  // Ran off its program, as a serial run stops there
+            return STEP_ENDED;
+        }
+        if (job.timeLimit > 0 && job.instructions >= job.timeLimit)
+        {
+            finish(job, ERR_TIME_LIMIT);
+            return STEP_ENDED;
+        }
+
+        job.instructions++;
+        job.IC++;
+        cpuBusy++;
+        overlap += reader.busyAt(now) || printer.busyAt(now);
+        now++;
+
+        int page = ins.operand / PAGE_WORDS;
+        int target = translate(job, ins.operand);
+        switch (ins.op)
+        {
+        case OP_GD:
+        {
+            if (job.nextCard == job.data.size())
+            {
+                finish(job, ERR_OUT_OF_DATA);
+                return STEP_ENDED;
+            }
+            if (!mapPage(job, page))
+            {
+                finish(job, ERR_MEMORY);
+                return STEP_ENDED;
+            }
+            if (spoolBuffers == 0)
+            {
+                transferCard(job, page, job.data[job.nextCard++]);
+                job.ioDone = reader.request(now, ioTime);
+                return STEP_IO;
+            }
+            advanceReader(now);
+            if (job.nextCard == job.cardsSpooled)
+            {
+                job.pendingPage = page;
+                inputWaits++;
+                return STEP_BLOCKED;
+            }
+            transferCard(job, page, job.data[job.nextCard++]);
+            inputBuffers--;
+            kickReader();
+            break;
+        }
+
+        case OP_PD:
+        {
+            if (!job.pageTable[page].valid)
+            {
+                finish(job, ERR_INVALID_PAGE);
+                return STEP_ENDED;
+            }
+            if (job.lineLimit > 0 && (int)job.lines.size() >= job.lineLimit)
+            {
+                finish(job, ERR_LINE_LIMIT);
+                return STEP_ENDED;
+            }
+            job.lines.push_back(wordsToLine(word(job.pageTable[page].frameNumber * PAGE_WORDS)));
+            if (spoolBuffers == 0)
+            {
+                job.ioDone = printer.request(now, ioTime);
+                return STEP_IO;
+            }
+            while (!printing.empty() && printing.front() <= now)
+                printing.pop_front();
+            if ((int)printing.size() < spoolBuffers)
+            {
+                printing.push_back(printer.request(now, ioTime));
+                break;
+            }
+            // All output buffers are full, wait for the printer to empty one
+            job.ioDone = printing.front();
+            printing.pop_front();
+            printing.push_back(printer.request(job.ioDone, ioTime));
+            outputWaits++;
+            return STEP_IO;
+        }
+
+        case OP_H:
+            finish(job, ERR_NONE);
+            return STEP_ENDED;
+
+        case OP_LR:
+        case OP_CR:
+            if (target < 0)
+            {
+                finish(job, ERR_INVALID_PAGE);
+                return STEP_ENDED;
+            }
+            if (ins.op == OP_LR)
+                copy(word(target), word(target) + 4, job.R);
+            else
+                job.C = equal(job.R, job.R + 4, word(target));
+            break;
+
+        case OP_SR:
+            if (!mapPage(job, page))
+            {
+                finish(job, ERR_MEMORY);
+                return STEP_ENDED;
+            }
+            target = translate(job, ins.operand);
+            copy(job.R, job.R + 4, word(target));
+            decoded[target].op = OP_UNDECODED;
+            break;
+
+        case OP_BT:
+            if (job.C)
+                job.IC = ins.operand;
+            break;
+
+        default:
+            break;
+        }
+        return STEP_CONTINUE;
+    }
+
+    // Jobs of a deck with their program words and data cards
+    static vector<MPJob> parseJobs(const string& deck)
+    {
+        vector<MPJob> jobs;
+        for (const string& text : splitJobs(deck))
+        {
+            MPJob job;
+            bool inData = false;
+            istringstream cards(text);
+            string line;
+            while (getline(cards, line))
+            {
+                if (line.compare(0, 4, "$AMJ") == 0)
+                {
+                    job.id = cardField(line, 4);
+                    job.timeLimit = cardField(line, 8);
+                    job.lineLimit = cardField(line, 12);
+                }
+                else if (line.compare(0, 4, "$DTA") == 0)
+                    inData = true;
+                else if (line.compare(0, 4, "$END") == 0)
+                    break;
+                else if (inData)
+                    job.data.push_back(line);
+                else
+                {
+                    istringstream words(line);
+                    string instr;
+                    while (words >> instr && job.program.size() < 100)
+                    {
+                        instr.resize(4, '\0');
+                        job.program.push_back(instr);
+                    }
+                }
+            }
+            jobs.push_back(move(job));
+        }
+        return jobs;
+    }
+
+    static int cardField(const string& line, size_t pos)
+    {
+        int value = 0;
+        if (line.size() < pos + 4 || from_chars(line.data() + pos, line.data() + pos + 4, value).ec != errc())
+            return 0;
+        return value;
+    }
+
+public:
+    Multiprogrammer(int frames, int slice, int ioTime, int spoolBuffers, OutputFormat format, OutputSink outputSink)
+        : frames(frames), slice(slice), ioTime(ioTime), memory((size_t)frames * PAGE_WORDS * 4, '\0'),
+          decoded((size_t)frames * PAGE_WORDS, Instruction{OP_END, 0}), available(frames), spoolBuffers(spoolBuffers),
+          inputBuffers(0), reading(nullptr), readDone(0), readerClock(0), inputWaits(0), outputWaits(0), now(0), cpuBusy(0),
+          overlap(0), contextSwitches(0), timerInterrupts(0), ended(0), aborted(0), turnaround(0), events(format), sink(move(outputSink))
+    {
+        for (int frame = frames - 1; frame >= 0; frame--)
+            freeFrames.push_back(frame);
+    }
+
+    // Run a whole deck; returns the output unless it went to the sink
+    string run(const string& deck)
+    {
+        vector<MPJob> jobs = parseJobs(deck);
+        if (!events.enabled())
+        {
+            outputContent += "Multiprogramming: " + to_string(frames) + " frames of " + to_string(PAGE_WORDS)
+                             + " words, time slice " + to_string(slice) + ", " + to_string(ioTime)
+                             + " ticks per card or line";
+            if (spoolBuffers > 0)
+                outputContent += ", spooled through " + to_string(spoolBuffers) + " buffers each way";
+            outputContent += "\n\n";
+        }
+
+        deque<MPJob*> ready;
+        typedef pair<pair<long long, long long>, MPJob*> Waiting;  // By completion tick, then request order
+        priority_queue<Waiting, vector<Waiting>, greater<Waiting>> waiting;
+        long long requests = 0;
+        size_t nextJob = 0;
+        MPJob* running = nullptr;
+        MPJob* previous = nullptr;  // Last job to have the CPU
+        MPJob* expired = nullptr;   // Queued again behind this tick's I/O completions
+        int used = 0;
+
+        while (ended < (long long)jobs.size())
+        {
+            // Admission in deck order while the next job fits
+            while (nextJob < jobs.size())
+            {
+                MPJob& job = jobs[nextJob];
+                int needed = framesNeeded(job);
+                if (needed > frames)
+                {
+                    nextJob++;
+                    finish(job, ERR_MEMORY);
+                    continue;
+                }
+                if (needed > available)
+                    break;
+                nextJob++;
+                admit(job, needed);
+                ready.push_back(&job);
+                if (spoolBuffers > 0 && !job.data.empty())
+                {
+                    advanceReader(now);
+                    readQueue.push_back(&job);
+                    kickReader();
+                }
+            }
+            advanceReader(now);
+            while (!woken.empty())
+            {
+                ready.push_back(woken.front());
+                woken.pop_front();
+            }
+            while (!waiting.empty() && waiting.top().first.first <= now)
+            {
+                ready.push_back(waiting.top().second);
+                waiting.pop();
+            }
+            if (expired != nullptr)
+            {
+                ready.push_back(expired);
+                expired = nullptr;
+            }
+
+            if (running == nullptr)
+            {
+                if (ready.empty())
+                {
+                    // CPU idle until the next I/O completes
+                    if (waiting.empty() && reading == nullptr)
+                        break;
+                    long long next = (reading != nullptr) ? readDone : waiting.top().first.first;
+                    if (!waiting.empty())
+                        next = min(next, waiting.top().first.first);
+                    now = next;
+                    continue;
+                }
+                running = ready.front();
+                ready.pop_front();
+                if (running != previous)
+                    contextSwitches++;
+                previous = running;
+                used = 0;
+            }
+
+            StepResult result = step(*running);
+            used++;
+            if (result == STEP_ENDED || result == STEP_BLOCKED)
+                running = nullptr;
+            else if (result == STEP_IO)
+            {
+                waiting.push(Waiting{{running->ioDone, requests++}, running});
+                running = nullptr;
+            }
+            else if (used >= slice)
+            {
+                timerInterrupts++;
+                expired = running;
+                running = nullptr;
+            }
+        }
+
+        // The last job may still be printing
+        now = max(now, max(reader.freeAt, printer.freeAt));
+        if (events.enabled())
+        {
+            events.emit(EV_MULTIPROGRAM, {ended, now, cpuBusy, reader.busy, printer.busy, overlap, contextSwitches});
+            if (spoolBuffers > 0)
+                events.emit(EV_SPOOL, {spoolBuffers, inputWaits, outputWaits});
+        }
+        else
+        {
+            stringstream out;
+            out << fixed << setprecision(2);
+            out << "=== MULTIPROGRAMMING SUMMARY ===\n";
+            out << "Jobs: " << ended << " (" << aborted << " aborted)\n";
+            out << "Ticks: " << now << "\n";
+            if (now > 0)
+            {
+                out << "CPU Utilisation: " << (double)cpuBusy / now * 100 << "% (" << cpuBusy << " busy ticks)\n";
+                out << "Reader Channel Busy: " << reader.busy << " ticks (" << (double)reader.busy / now * 100 << "%)\n";
+                out << "Printer Channel Busy: " << printer.busy << " ticks (" << (double)printer.busy / now * 100 << "%)\n";
+                out << "CPU and I/O Overlap: " << overlap << " ticks (" << (double)overlap / now * 100 << "%)\n";
+                out << "Throughput: " << (double)ended / now * 1000 << " jobs per 1000 ticks\n";
+            }
+            out << "Context Switches: " << contextSwitches << " (" << timerInterrupts << " timer interrupts)\n";
+            if (ended > 0)
+                out << "Average Turnaround: " << (double)turnaround / ended << " ticks\n";
+            if (spoolBuffers > 0)
+                out << "Spooling: " << inputWaits << " GD waits for a card, " << outputWaits
+                    << " PD waits for an output buffer\n";
+            outputContent += out.str();
+        }
+        flushOutput();
+        return sink ? "" : (events.enabled() ? events.take() : outputContent);
+    }
+};
+
+// Run a deck serially in one VM, in batch mode when threads > 0, or
+// multiprogrammed when frames > 0. A profiled run appends its folded
+// stacks to `folded` when given.
+void runDeck(const string& deck, const RunOptions& options, const OutputSink& sink, string* folded = nullptr)
+{
+    if (options.frames > 0) {
+        Multiprogrammer(options.frames, options.slice, options.ioTime, options.spoolBuffers, options.format, sink).run(deck);
+        return;
+    }
+    if (options.threads > 0) {
+        runBatch(deck, options, sink, folded);
+        return;
+    }
+    VM vm(deck, options.format, sink, options.profile);
+    if (folded)
+        *folded += vm.foldedStacks();
+}
+
 // Original main function for file-based execution
 int main_original()
 {
@@ -302,19 +1673,102 @@ int main_original()
     return 0;
 }
 
+// Daemon mode: each job's frame options apply on top of the defaults
+JobRunner jobRunner(const RunOptions& defaults)
+{
+    return [defaults](const string& job, const string& optionText, const OutputSink& sink) {
+        RunOptions options = defaults;
+        istringstream optionWords(optionText);
+        string arg;
+        while (optionWords >> arg) {
+            if (!parseRunOption(arg, options)) {
+                cerr << "Warning: Ignoring invalid job option " << arg << endl;
+            }
+        }
+
+        // Results go out chunk by chunk, one per finished job
+        runDeck(job, options, sink);
+    };
+}
+
+// Benchmarks include this file with OS_SIM_NO_MAIN defined
+#ifndef OS_SIM_NO_MAIN
 // New main function for CLI execution with backend integration
 int main(int argc, char* argv[])
 {
-    if (argc == 1) {
+    // Options may appear anywhere; everything else is a file name
+    bool serve = false;
+    string socketPath;
+    RunOptions options;
+    vector<string> files;
+    long long checkpointEvery = 0;  // Set by --checkpoint
+    string checkpointDir = ".";
+    string resumePath;              // Set by --resume
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--serve") {
+            serve = true;
+        }
+        else if (arg.compare(0, 8, "--serve=") == 0) {
+            serve = true;
+            socketPath = arg.substr(8);
+        }
+        else if (arg.compare(0, 13, "--checkpoint=") == 0) {
+            checkpointEvery = atoll(arg.c_str() + 13);
+            if (checkpointEvery <= 0) {
+                cerr << "Error: Checkpoint interval must be positive" << endl;
+                return 1;
+            }
+        }
+        else if (arg.compare(0, 17, "--checkpoint-dir=") == 0) {
+            checkpointDir = arg.substr(17);
+        }
+        else if (arg.compare(0, 9, "--resume=") == 0) {
+            resumePath = arg.substr(9);
+        }
+        else if (parseRunOption(arg, options)) {
+            continue;
+        }
+        else if (arg.compare(0, 2, "--") == 0) {
+            cerr << "Error: Invalid option " << arg << endl;
+            return 1;
+        }
+        else {
+            files.push_back(arg);
+        }
+    }
+
+    if (options.profile && options.frames > 0) {
+        cerr << "Error: --profile applies to serial and batch runs, not --multiprogram" << endl;
+        return 1;
+    }
+
+    bool checkpointing = checkpointEvery > 0 || !resumePath.empty();
+    if (checkpointing && (options.threads > 0 || options.frames > 0 || options.profile)) {
+        cerr << "Error: Checkpoints apply to serial runs without --profile" << endl;
+        return 1;
+    }
+
+    if (serve && files.empty()) {
+        if (!socketPath.empty()) {
+            // Daemon mode on a Unix socket: phase1.exe --serve=/tmp/phase1.sock
+            return serveSocket(socketPath.c_str(), jobRunner(options));
+        }
+        // Daemon mode on stdin/stdout: phase1.exe --serve
+        serveStdio(jobRunner(options));
+        return 0;
+    }
+    else if (argc == 1) {
         // No arguments - run original behavior
         VM v;
         return 0;
     }
-    else if (argc == 3) {
-        // CLI mode: phase1.exe input.txt output.txt
-        ifstream inputFile(argv[1]);
+    else if (!serve && files.size() == 2) {
+        // CLI mode: phase1.exe [options] input.txt output.txt
+        ifstream inputFile(files[0]);
         if (!inputFile.is_open()) {
-            cerr << "Error: Cannot open input file " << argv[1] << endl;
+            cerr << "Error: Cannot open input file " << files[0] << endl;
             return 1;
         }
         
@@ -322,22 +1776,67 @@ int main(int argc, char* argv[])
                       istreambuf_iterator<char>());
         inputFile.close();
         
-        VM vm(content);
-        
-        ofstream outputFile(argv[2]);
+        ofstream outputFile(files[1], options.format == FORMAT_BINARY ? ios::binary : ios::out);
         if (!outputFile.is_open()) {
-            cerr << "Error: Cannot open output file " << argv[2] << endl;
+            cerr << "Error: Cannot open output file " << files[1] << endl;
             return 1;
         }
         
-        outputFile << vm.getOutput();
+        OutputSink sink = [&outputFile](const string& data) {
+            outputFile << data;
+        };
+        if (checkpointing) {
+            VMSnapshot snap;
+            VMCheckpoints checkpoints;
+            if (!resumePath.empty()) {
+                ifstream snapFile(resumePath, ios::binary);
+                if (!snapFile.read((char*)&snap, sizeof(snap)) || snapFile.get() != EOF
+                    || memcmp(snap.magic, "P1CK", 4) != 0 || snap.version != VM_SNAPSHOT_VERSION) {
+                    cerr << "Error: " << resumePath << " is not a Phase 1 checkpoint" << endl;
+                    return 1;
+                }
+                if (snap.deckSize != (int64_t)content.size() || snap.inputPosition > snap.deckSize
+                    || snap.IC < 0 || snap.IC > 100 || snap.SI < 0 || snap.SI > 3 || snap.instructions < 0) {
+                    cerr << "Error: Checkpoint " << resumePath << " does not belong to " << files[0] << endl;
+                    return 1;
+                }
+                checkpoints.resume = &snap;
+            }
+            checkpoints.every = checkpointEvery;
+            checkpoints.sink = [&checkpointDir](const VMSnapshot& taken) {
+                string path = checkpointDir + "/checkpoint-" + to_string(taken.instructions) + ".p1ck";
+                ofstream file(path, ios::binary);
+                file.write((const char*)&taken, sizeof(taken));
+                if (!file)
+                    cerr << "Warning: Cannot write checkpoint " << path << endl;
+            };
+            VM vm(content, options.format, sink, false, &checkpoints);
+            return 0;
+        }
+
+        string folded;
+        runDeck(content, options, sink, options.foldedPath.empty() ? nullptr : &folded);
         outputFile.close();
+
+        if (!options.foldedPath.empty()) {
+            ofstream foldedFile(options.foldedPath);
+            if (!foldedFile.is_open()) {
+                cerr << "Error: Cannot open profile file " << options.foldedPath << endl;
+                return 1;
+            }
+            foldedFile << folded;
+        }
         
         return 0;
     }
     else {
-        cerr << "Usage: " << argv[0] << " [input_file output_file]" << endl;
+        cerr << "Usage: " << argv[0] << " [options] [input_file output_file | --serve[=socket_path]]" << endl;
+        cerr << "Options: --batch[=threads] --format=text|ndjson|binary" << endl;
+        cerr << "         --multiprogram[=frames] --slice=N --io-time=N --spool[=buffers]" << endl;
+        cerr << "         --profile[=folded_stacks_file]" << endl;
+        cerr << "         --checkpoint=N --checkpoint-dir=DIR --resume=CHECKPOINT" << endl;
         cerr << "If no arguments provided, uses default input_Phase1.txt" << endl;
         return 1;
     }
-}
\ No newline at end of file
+}
+#endif
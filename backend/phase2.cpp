@@ -1,19 +1,70 @@
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <map>
+#include <set>
+#include <tuple>
+#include <memory>
+#include <climits>
+#include <cmath>
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <sstream>
 #include <iomanip>
+#include <initializer_list>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "output.h"
 
 using namespace std;
 
 // Constants
-const int PAGE_SIZE = 1024;           // 1KB page size
-const int PHYSICAL_MEMORY_SIZE = 64;  // 64 pages in physical memory
-const int VIRTUAL_MEMORY_SIZE = 256;  // 256 pages per process
-const int TLB_SIZE = 4;               // Translation Lookaside Buffer size
+const int PAGE_SIZE = 1024;           // Default page size, 1KB
+const int PHYSICAL_MEMORY_SIZE = 64;  // Default frames of physical memory
+const int MAX_FRAMES = 1 << 24;       // Largest configurable physical memory
+const int VIRTUAL_MEMORY_SIZE = 256;  // Default pages per process
+const int VA_BITS = 18;               // Default virtual address width (256 pages of 1KB)
+const int MAX_NODE_BITS = 20;         // Largest page table node, 2^20 entries
+const int TLB_SIZE = 4;               // Default Translation Lookaside Buffer size
+const int MAX_CPUS = 64;              // Cores in multi-core mode, one bit each in PCB::cpuMask
+const size_t REFERENCE_BATCH = 256;   // Multi-core: TLB hits a core batches before taking memoryLock
+const size_t FLUSH_BYTES = 64 * 1024; // Output piece size when streaming
+const long long ANALYSIS_WINDOW = 1000; // Default working-set window, in accesses
+const int QUANTUM = 10;               // Default scheduler time slice, in ticks (accesses)
+const int MLFQ_LEVELS = 3;            // MLFQ queues, the slice doubles per level
+const int MLFQ_BOOST = 50;            // Quanta between MLFQ priority boosts
+const int SWAP_SLOTS = 4096;          // Default swap device size, in pages
+const int MAX_SWAP_SLOTS = 1 << 26;   // Largest configurable swap device
+const int MEMORY_NANOS = 100;         // Default memory access time
+const int DISK_LATENCY_MICROS = 5000; // Default disk latency per request (seek and rotation)
+const int DISK_BANDWIDTH = 100;       // Default disk transfer rate, MB/s
 
 // Interrupt Types
 enum InterruptType {
@@ -38,425 +89,5633 @@ struct PageTableEntry {
     bool valid;
     bool dirty;
     bool referenced;
+    uint8_t copyOnWrite : 1;  // Shared by FORK; a write copies the page unless it is the last mapping
+    uint8_t order : 7;        // The entry is part of a huge page of 2^order pages, 0 for a base page
     
-    PageTableEntry() : frameNumber(-1), valid(false), dirty(false), referenced(false) {}
+    PageTableEntry() : frameNumber(-1), valid(false), dirty(false), referenced(false), copyOnWrite(false), order(0) {}
 };
 
-// TLB Entry
-struct TLBEntry {
-    int pid;
-    int pageNumber;
-    int frameNumber;
-    bool valid;
+// A virtual page of a process
+struct PageKey {
+    int32_t pid;
+    int64_t page;
     
-    TLBEntry() : pid(-1), pageNumber(-1), frameNumber(-1), valid(false) {}
+    bool operator==(const PageKey& other) const {
+        return pid == other.pid && page == other.page;
+    }
 };
 
-// Process Control Block
-class PCB {
+struct PageKeyHash {
+    size_t operator()(const PageKey& key) const {
+        uint64_t mixed = ((uint64_t)(uint32_t)key.pid << 32) + (uint64_t)key.page;
+        return (size_t)((mixed * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+};
+
+void putVarint(string& out, int64_t value);
+
+// Reads back the zigzag varints of a checkpoint. A read past the end or a
+// value out of range marks the whole checkpoint as failed.
+class CheckpointReader {
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+    
 public:
-    int pid;
-    ProcessState state;
-    int programCounter;
-    int priority;
-    vector<PageTableEntry> pageTable;
-    int allocatedPages;
-    int pageFaults;
+    bool failed;
+    
+    CheckpointReader(const char* data, size_t size)
+        : pos((const uint8_t*)data), end((const uint8_t*)data + size), failed(false) {}
+    
+    int64_t get() {
+        uint64_t v = 0;
+        for (int shift = 0; pos < end && shift < 64; shift += 7) {
+            uint8_t byte = *pos++;
+            v |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+            }
+        }
+        failed = true;
+        return 0;
+    }
+    
+    // A value that must lie in [low, high)
+    int64_t get(int64_t low, int64_t high) {
+        int64_t value = get();
+        if (value < low || value >= high) {
+            failed = true;
+            return low;
+        }
+        return value;
+    }
+    
+    // A length, then that many bytes, all before the end
+    string getString() {
+        int64_t length = get();
+        if (failed || length < 0 || length > end - pos) {
+            failed = true;
+            return string();
+        }
+        string text((const char*)pos, (size_t)length);
+        pos += length;
+        return text;
+    }
     
-    PCB(int id, int pages) : pid(id), state(NEW), programCounter(0), 
-                             priority(0), allocatedPages(pages), pageFaults(0) {
-        pageTable.resize(VIRTUAL_MEMORY_SIZE);
+    bool atEnd() const {
+        return pos == end;
     }
 };
 
-// Memory Management Unit
-class MMU {
+// Per-process page table. Entries are created on first use and keep their
+// address until clear(), so the frame table can point at them.
+class PageTable {
+public:
+    virtual ~PageTable() {}
+    
+    // Entry of a page, or nullptr if it was never created
+    virtual PageTableEntry* find(int64_t page) = 0;
+    
+    // Entry of a page, creating it and any missing table nodes
+    virtual PageTableEntry* entry(int64_t page) = 0;
+    
+    // The page is no longer resident; its entry may be dropped
+    virtual void release(int64_t page) {}
+    
+    // Drop every entry and table node below the root
+    virtual void clear() = 0;
+    
+    // Visit the valid entries in ascending page order
+    virtual void forEachValid(const function<void(int64_t, PageTableEntry&)>& visit) = 0;
+    
+    // Memory held by the table itself
+    virtual size_t memoryBytes() const = 0;
+    
+    // Checkpoints: the nodes or buckets allocated so far, which set the
+    // table's memory use. Valid entries are saved separately.
+    virtual void saveShape(string& out) const = 0;
+    virtual void restoreShape(CheckpointReader& in) = 0;
+};
+
+// Radix tree of 1 to 4 levels over the virtual page number. The top level
+// takes any bits left over from an even split. Nodes are only allocated when
+// a page under them is first touched.
+class RadixPageTable : public PageTable {
 private:
-    vector<bool> physicalMemory;  // Frame allocation bitmap
-    queue<int> freeFrames;
-    vector<TLBEntry> tlb;
-    int tlbHits;
-    int tlbMisses;
-    map<int, PCB*> processTable;
-    stringstream output;  // Changed from ofstream& to stringstream
+    struct Node {
+        vector<unique_ptr<Node>> children;  // Inner levels
+        vector<PageTableEntry> entries;     // Last level
+    };
     
-    // FIFO page replacement
-    queue<pair<int, int>> fifoQueue;  // (pid, pageNumber)
+    vector<int> shifts;  // Per level, top first: where its index starts
+    vector<int> widths;  // Per level: how many bits it indexes
+    unique_ptr<Node> root;
+    size_t bytes;
     
-public:
-    // Original constructor for file output
-    MMU(ofstream& out) : tlbHits(0), tlbMisses(0) {
-        physicalMemory.resize(PHYSICAL_MEMORY_SIZE, false);
-        tlb.resize(TLB_SIZE);
-        
-        // Initialize free frames
-        for (int i = 0; i < PHYSICAL_MEMORY_SIZE; i++) {
-            freeFrames.push(i);
+    Node* newNode(int level) {
+        Node* node = new Node();
+        size_t slots = (size_t)1 << widths[level];
+        if (level + 1 == (int)widths.size()) {
+            node->entries.resize(slots);
+            bytes += sizeof(Node) + slots * sizeof(PageTableEntry);
+        } else {
+            node->children.resize(slots);
+            bytes += sizeof(Node) + slots * sizeof(unique_ptr<Node>);
         }
+        return node;
     }
     
-    // New constructor for API output
-    MMU() : tlbHits(0), tlbMisses(0) {
-        physicalMemory.resize(PHYSICAL_MEMORY_SIZE, false);
-        tlb.resize(TLB_SIZE);
-        
-        // Initialize free frames
-        for (int i = 0; i < PHYSICAL_MEMORY_SIZE; i++) {
-            freeFrames.push(i);
+    size_t indexAt(int level, int64_t page) const {
+        return (size_t)(((uint64_t)page >> shifts[level]) & (((uint64_t)1 << widths[level]) - 1));
+    }
+    
+    // First page under every last-level node
+    void collectLeaves(const Node* node, int level, int64_t base, vector<int64_t>& leaves) const {
+        if (level + 1 == (int)widths.size()) {
+            leaves.push_back(base);
+            return;
+        }
+        for (size_t i = 0; i < node->children.size(); i++) {
+            if (node->children[i]) {
+                collectLeaves(node->children[i].get(), level + 1, base | ((int64_t)i << shifts[level]), leaves);
+            }
         }
     }
     
-    // Execute commands from string input
-    string executeCommands(const string& inputContent) {
-        output.str(""); // Clear previous output
-        output.clear();
-        
-        output << "=== OS SIMULATOR - PHASE 2 ===\n";
-        output << "Page Size: " << PAGE_SIZE << " bytes\n";
-        output << "Physical Memory: " << PHYSICAL_MEMORY_SIZE << " frames\n";
-        output << "Virtual Memory: " << VIRTUAL_MEMORY_SIZE << " pages per process\n\n";
-        
-        istringstream input(inputContent);
-        string line;
-        int lineNum = 0;
-        
-        while (getline(input, line)) {
-            lineNum++;
-            
-            if (line.empty() || line[0] == '#') {
-                continue;  // Skip empty lines and comments
+    void visitNode(Node* node, int level, int64_t base, const function<void(int64_t, PageTableEntry&)>& visit) {
+        if (level + 1 == (int)widths.size()) {
+            for (size_t i = 0; i < node->entries.size(); i++) {
+                if (node->entries[i].valid) {
+                    visit(base | ((int64_t)i << shifts[level]), node->entries[i]);
+                }
             }
-            
-            output << "Command [" << lineNum << "]: " << line << "\n";
-            
-            istringstream iss(line);
-            string command;
-            iss >> command;
-            
-            if (command == "CREATE") {
-                int pid, pages;
-                iss >> pid >> pages;
-                createProcess(pid, pages);
+            return;
+        }
+        for (size_t i = 0; i < node->children.size(); i++) {
+            if (node->children[i]) {
+                visitNode(node->children[i].get(), level + 1, base | ((int64_t)i << shifts[level]), visit);
             }
-            else if (command == "ACCESS") {
-                int pid, addr;
-                iss >> pid >> addr;
-                output << "Accessing virtual address " << addr << " of process " << pid << "\n";
-                int physAddr = translateAddress(pid, addr, false);
-                if (physAddr != -1) {
-                    output << "Physical address: " << physAddr << "\n";
-                }
+        }
+    }
+    
+public:
+    RadixPageTable(int levels, int pageBits) : bytes(0) {
+        int shift = pageBits;
+        for (int level = levels - 1; level >= 0; level--) {
+            int width = pageBits / levels + (level < pageBits % levels ? 1 : 0);
+            shift -= width;
+            shifts.insert(shifts.begin(), shift);
+            widths.insert(widths.begin(), width);
+        }
+    }
+    
+    // "4+4 bits" style split, top level first
+    string describeSplit() const {
+        string split;
+        for (size_t i = 0; i < widths.size(); i++) {
+            split += (i > 0 ? "+" : "") + to_string(widths[i]);
+        }
+        return split + " bits";
+    }
+    
+    PageTableEntry* find(int64_t page) override {
+        Node* node = root.get();
+        for (int level = 0; node != nullptr; level++) {
+            size_t i = indexAt(level, page);
+            if (level + 1 == (int)widths.size()) {
+                return &node->entries[i];
             }
-            else if (command == "WRITE") {
-                int pid, addr;
-                iss >> pid >> addr;
-                output << "Writing to virtual address " << addr << " of process " << pid << "\n";
-                int physAddr = translateAddress(pid, addr, true);
-                if (physAddr != -1) {
-                    output << "Physical address: " << physAddr << "\n";
-                }
+            node = node->children[i].get();
+        }
+        return nullptr;
+    }
+    
+    PageTableEntry* entry(int64_t page) override {
+        if (!root) {
+            root.reset(newNode(0));
+        }
+        Node* node = root.get();
+        for (int level = 0;; level++) {
+            size_t i = indexAt(level, page);
+            if (level + 1 == (int)widths.size()) {
+                return &node->entries[i];
             }
-            else if (command == "TERMINATE") {
-                int pid;
-                iss >> pid;
-                terminateProcess(pid);
+            if (!node->children[i]) {
+                node->children[i].reset(newNode(level + 1));
             }
-            else if (command == "STATS") {
-                printStatistics();
+            node = node->children[i].get();
+        }
+    }
+    
+    void clear() override {
+        if (!root) {
+            return;
+        }
+        // Keep an emptied root so a recycled PCB does not allocate it again
+        if (widths.size() == 1) {
+            fill(root->entries.begin(), root->entries.end(), PageTableEntry());
+            bytes = sizeof(Node) + root->entries.size() * sizeof(PageTableEntry);
+        } else {
+            for (auto& child : root->children) {
+                child.reset();
             }
-            else if (command == "MEMMAP") {
-                printMemoryMap();
+            bytes = sizeof(Node) + root->children.size() * sizeof(unique_ptr<Node>);
+        }
+    }
+    
+    void forEachValid(const function<void(int64_t, PageTableEntry&)>& visit) override {
+        if (root) {
+            visitNode(root.get(), 0, 0, visit);
+        }
+    }
+    
+    size_t memoryBytes() const override {
+        return bytes;
+    }
+    
+    // The root, kept even when emptied, and the path to every leaf node
+    void saveShape(string& out) const override {
+        vector<int64_t> leaves;
+        if (root) {
+            collectLeaves(root.get(), 0, 0, leaves);
+        }
+        putVarint(out, root ? 1 : 0);
+        putVarint(out, (int64_t)leaves.size());
+        for (int64_t page : leaves) {
+            putVarint(out, page);
+        }
+    }
+    
+    void restoreShape(CheckpointReader& in) override {
+        if (in.get(0, 2) && !root) {
+            root.reset(newNode(0));
+        }
+        int64_t pages = (int64_t)1 << accumulate(widths.begin(), widths.end(), 0);
+        for (int64_t n = in.get(0, pages + 1); n > 0 && !in.failed; n--) {
+            entry(in.get(0, pages));
+        }
+    }
+};
+
+// Hashed page table: only resident pages have an entry, so its size follows
+// the process's resident set rather than its address space, as an inverted
+// page table would.
+class HashedPageTable : public PageTable {
+private:
+    unordered_map<int64_t, PageTableEntry> entries;
+    
+public:
+    PageTableEntry* find(int64_t page) override {
+        auto it = entries.find(page);
+        return it == entries.end() ? nullptr : &it->second;
+    }
+    
+    PageTableEntry* entry(int64_t page) override {
+        return &entries[page];
+    }
+    
+    void release(int64_t page) override {
+        entries.erase(page);
+    }
+    
+    void clear() override {
+        unordered_map<int64_t, PageTableEntry>().swap(entries);
+    }
+    
+    void forEachValid(const function<void(int64_t, PageTableEntry&)>& visit) override {
+        vector<int64_t> pages;
+        pages.reserve(entries.size());
+        for (auto& pair : entries) {
+            if (pair.second.valid) {
+                pages.push_back(pair.first);
             }
-            else {
-                output << "Unknown command: " << command << "\n";
+        }
+        sort(pages.begin(), pages.end());
+        for (int64_t page : pages) {
+            visit(page, entries[page]);
+        }
+    }
+    
+    size_t memoryBytes() const override {
+        // Node: key, entry, next pointer and cached hash; plus the bucket array
+        return entries.size() * (sizeof(pair<const int64_t, PageTableEntry>) + 2 * sizeof(void*)) +
+               entries.bucket_count() * sizeof(void*);
+    }
+    
+    // Buckets only grow, so their count depends on the table's history
+    void saveShape(string& out) const override {
+        putVarint(out, (int64_t)entries.bucket_count());
+    }
+    
+    void restoreShape(CheckpointReader& in) override {
+        size_t buckets = (size_t)in.get(1, (int64_t)MAX_FRAMES * 4);
+        if (!in.failed && buckets != entries.bucket_count()) {
+            entries.rehash(buckets);
+        }
+    }
+};
+
+// TLB Entry
+struct TLBEntry {
+    int pid;
+    int64_t pageNumber;  // Tagged with the page size, see TLB::tag
+    int frameNumber;     // The first frame of a huge page
+    bool valid;
+    
+    TLBEntry() : pid(-1), pageNumber(-1), frameNumber(-1), valid(false) {}
+};
+
+// Translation Lookaside Buffer with configurable associativity. The entries
+// are grouped into sets of `ways` slots, a (pid, page) pair can only live in
+// the set it hashes to, and every set refills its slots in FIFO order.
+// ways == 1 is direct-mapped, ways == size is fully associative. An entry
+// for a huge page covers all of its pages; a base-page miss probes for one
+// of every huge page size in turn.
+class TLB {
+private:
+    int numSets;
+    int ways;
+    vector<TLBEntry> entries;     // numSets * ways, set by set
+    vector<int> refillIndex;      // Next slot to refill in each set
+    bool useIndex;                // Wide sets are searched through `index`
+    unordered_map<PageKey, int, PageKeyHash> index;  // (pid, page) -> slot
+    vector<int> hugeOrders;       // Huge page sizes to probe, largest first
+    long long reachPages;         // Pages mapped by the valid entries
+    
+    int setOf(int pid, int64_t pageNumber) const {
+        if (numSets == 1) {
+            return 0;
+        }
+        return (int)(PageKeyHash()(PageKey{pid, pageNumber}) % numSets);
+    }
+    
+    // Slot holding (pid, page), or -1
+    int find(int pid, int64_t pageNumber) const {
+        if (useIndex) {
+            auto it = index.find(PageKey{pid, pageNumber});
+            return it == index.end() ? -1 : it->second;
+        }
+        int base = setOf(pid, pageNumber) * ways;
+        for (int i = base; i < base + ways; i++) {
+            const TLBEntry& entry = entries[i];
+            if (entry.valid && entry.pid == pid && entry.pageNumber == pageNumber) {
+                return i;
             }
-            
-            output << "\n";
         }
-        
-        output << "\n=== FINAL STATISTICS ===\n";
-        printStatistics();
-        printMemoryMap();
-        
-        return output.str();
+        return -1;
     }
     
-    // Create a new process
-    void createProcess(int pid, int pages) {
-        if (processTable.find(pid) != processTable.end()) {
-            output << "Error: Process " << pid << " already exists\n";
-            return;
+    void invalidateSlot(int slot) {
+        if (useIndex) {
+            index.erase(PageKey{entries[slot].pid, entries[slot].pageNumber});
         }
-        
-        PCB* pcb = new PCB(pid, pages);
-        pcb->state = READY;
-        processTable[pid] = pcb;
-        output << "Process " << pid << " created with " << pages << " pages\n";
+        entries[slot].valid = false;
+        reachPages -= 1LL << orderOf(entries[slot].pageNumber);
     }
     
-    // Allocate a frame
-    int allocateFrame() {
-        if (!freeFrames.empty()) {
-            int frame = freeFrames.front();
-            freeFrames.pop();
-            physicalMemory[frame] = true;
-            return frame;
+public:
+    TLB(int size, int ways) : ways(ways > 0 ? ways : size), entries(size), reachPages(0) {
+        numSets = size / this->ways;
+        refillIndex.assign(numSets, 0);
+        useIndex = this->ways > 8;
+        if (useIndex) {
+            index.reserve(size);
         }
-        return -1;  // No free frames
     }
     
-    // Free a frame
-    void freeFrame(int frame) {
-        if (frame >= 0 && frame < PHYSICAL_MEMORY_SIZE) {
-            physicalMemory[frame] = false;
-            freeFrames.push(frame);
+    int size() const {
+        return (int)entries.size();
+    }
+    
+    int associativity() const {
+        return ways;
+    }
+    
+    // The key of a page mapped as part of 2^order pages: the first of them,
+    // with the order in bits above any page number (at most 58 bits)
+    static int64_t tag(int64_t pageNumber, int order) {
+        return order == 0 ? pageNumber : (pageNumber >> order << order) | (int64_t)order << 58;
+    }
+    
+    static int orderOf(int64_t tagged) {
+        return (int)(tagged >> 58);
+    }
+    
+    void setHugeOrders(const vector<int>& orders) {
+        hugeOrders = orders;
+    }
+    
+    // TLB reach: pages the valid entries translate, and entries for huge pages
+    long long reach() const {
+        return reachPages;
+    }
+    
+    int hugeEntries() const {
+        int count = 0;
+        for (const TLBEntry& entry : entries) {
+            count += entry.valid && orderOf(entry.pageNumber) > 0;
         }
+        return count;
     }
     
-    // Page replacement using FIFO
-    int replacePage() {
-        if (fifoQueue.empty()) {
-            return -1;
+    // Fetch the frame cached for (pid, page); false on a miss
+    bool lookup(int pid, int64_t pageNumber, int& frameNumber) const {
+        int slot = find(pid, pageNumber);
+        if (slot == -1) {
+            return !hugeOrders.empty() && lookupHuge(pid, pageNumber, frameNumber);
         }
-        
-        auto victim = fifoQueue.front();
-        fifoQueue.pop();
-        
-        int victimPid = victim.first;
-        int victimPage = victim.second;
-        
-        if (processTable.find(victimPid) != processTable.end()) {
-            PCB* pcb = processTable[victimPid];
-            if (victimPage < pcb->pageTable.size() && pcb->pageTable[victimPage].valid) {
-                int frame = pcb->pageTable[victimPage].frameNumber;
-                
-                output << "Replacing page " << victimPage << " of process " << victimPid;
-                if (pcb->pageTable[victimPage].dirty) {
-                    output << " (dirty - writing back to disk)";
-                }
-                output << "\n";
-                
-                pcb->pageTable[victimPage].valid = false;
-                pcb->pageTable[victimPage].frameNumber = -1;
-                
-                // Invalidate TLB entry
-                for (auto& entry : tlb) {
-                    if (entry.valid && entry.pid == victimPid && entry.pageNumber == victimPage) {
-                        entry.valid = false;
-                    }
-                }
-                
-                return frame;
+        frameNumber = entries[slot].frameNumber;
+        return true;
+    }
+    
+    // A base-page miss: is the page in a huge page cached here?
+    bool lookupHuge(int pid, int64_t pageNumber, int& frameNumber) const {
+        for (int order : hugeOrders) {
+            int slot = find(pid, tag(pageNumber, order));
+            if (slot != -1) {
+                frameNumber = entries[slot].frameNumber + (int)(pageNumber & ((1LL << order) - 1));
+                return true;
             }
         }
-        
-        return allocateFrame();
+        return false;
     }
     
-    // Handle page fault
-    void handlePageFault(int pid, int pageNumber) {
-        output << "PAGE FAULT: Process " << pid << ", Page " << pageNumber << "\n";
-        
-        if (processTable.find(pid) == processTable.end()) {
-            handleInterrupt(INVALID_ACCESS, pid, pageNumber);
-            return;
+    // Cache the frame of a page; with an order, the whole huge page it is in
+    void insert(int pid, int64_t pageNumber, int frameNumber, int order = 0) {
+        if (order > 0) {
+            frameNumber -= (int)(pageNumber & ((1LL << order) - 1));
+            pageNumber = tag(pageNumber, order);
         }
+        int set = setOf(pid, pageNumber);
+        int slot = set * ways + refillIndex[set];
+        refillIndex[set] = (refillIndex[set] + 1) % ways;
         
-        PCB* pcb = processTable[pid];
-        pcb->pageFaults++;
-        
-        if (pageNumber >= pcb->allocatedPages) {
-            handleInterrupt(SEGMENTATION_FAULT, pid, pageNumber);
-            return;
+        if (entries[slot].valid) {
+            invalidateSlot(slot);
         }
-        
-        int frame = allocateFrame();
-        if (frame == -1) {
-            frame = replacePage();
-            if (frame == -1) {
-                output << "Error: Cannot allocate frame for page " << pageNumber << "\n";
-                return;
+        entries[slot].pid = pid;
+        entries[slot].pageNumber = pageNumber;
+        entries[slot].frameNumber = frameNumber;
+        entries[slot].valid = true;
+        reachPages += 1LL << order;
+        if (useIndex) {
+            index[PageKey{pid, pageNumber}] = slot;
+        }
+    }
+    
+    void invalidate(int pid, int64_t pageNumber, int order = 0) {
+        int slot = find(pid, tag(pageNumber, order));
+        if (slot != -1) {
+            invalidateSlot(slot);
+        }
+    }
+    
+    void invalidateProcess(int pid) {
+        for (int i = 0; i < (int)entries.size(); i++) {
+            if (entries[i].valid && entries[i].pid == pid) {
+                invalidateSlot(i);
             }
         }
-        
-        pcb->pageTable[pageNumber].frameNumber = frame;
-        pcb->pageTable[pageNumber].valid = true;
-        pcb->pageTable[pageNumber].referenced = true;
-        
-        fifoQueue.push({pid, pageNumber});
-        
-        output << "Allocated frame " << frame << " to page " << pageNumber << " of process " << pid << "\n";
     }
     
-    // Translate virtual address to physical address
-    int translateAddress(int pid, int virtualAddr, bool write = false) {
-        int pageNumber = virtualAddr / PAGE_SIZE;
-        int offset = virtualAddr % PAGE_SIZE;
-        
-        // Check TLB first
-        for (int i = 0; i < TLB_SIZE; i++) {
-            if (tlb[i].valid && tlb[i].pid == pid && tlb[i].pageNumber == pageNumber) {
-                tlbHits++;
-                output << "TLB Hit: Process " << pid << ", Page " << pageNumber << "\n";
-                
-                if (write && processTable.find(pid) != processTable.end()) {
-                    processTable[pid]->pageTable[pageNumber].dirty = true;
-                }
-                
-                return tlb[i].frameNumber * PAGE_SIZE + offset;
+    // Checkpoints: every slot, then where each set refills next
+    void save(string& out) const {
+        for (const TLBEntry& entry : entries) {
+            putVarint(out, entry.valid);
+            if (entry.valid) {
+                putVarint(out, entry.pid);
+                putVarint(out, entry.pageNumber);
+                putVarint(out, entry.frameNumber);
             }
         }
-        
-        tlbMisses++;
-        output << "TLB Miss: Process " << pid << ", Page " << pageNumber << "\n";
-        
-        if (processTable.find(pid) == processTable.end()) {
-            handleInterrupt(INVALID_ACCESS, pid, virtualAddr);
-            return -1;
+        for (int slot : refillIndex) {
+            putVarint(out, slot);
         }
-        
-        PCB* pcb = processTable[pid];
-        
-        if (pageNumber >= pcb->allocatedPages) {
-            handleInterrupt(SEGMENTATION_FAULT, pid, virtualAddr);
-            return -1;
+    }
+    
+    void restore(CheckpointReader& in, int numFrames) {
+        index.clear();
+        reachPages = 0;
+        for (int slot = 0; slot < (int)entries.size(); slot++) {
+            entries[slot] = TLBEntry();
+            if (in.get(0, 2)) {
+                entries[slot].pid = (int)in.get(INT_MIN, (int64_t)INT_MAX + 1);
+                entries[slot].pageNumber = in.get(0, LLONG_MAX);
+                entries[slot].frameNumber = (int)in.get(-1, numFrames);
+                entries[slot].valid = true;
+                reachPages += 1LL << orderOf(entries[slot].pageNumber);
+                if (useIndex) {
+                    index[PageKey{entries[slot].pid, entries[slot].pageNumber}] = slot;
+                }
+            }
         }
-        
-        if (!pcb->pageTable[pageNumber].valid) {
-            handlePageFault(pid, pageNumber);
+        for (int& slot : refillIndex) {
+            slot = (int)in.get(0, ways);
         }
-        
-        int frame = pcb->pageTable[pageNumber].frameNumber;
-        pcb->pageTable[pageNumber].referenced = true;
-        
-        if (write) {
-            pcb->pageTable[pageNumber].dirty = true;
+    }
+};
+
+// Reverse mapping of a physical frame to the page loaded in it. A frame
+// mapped by several page tables (FORK, SHARE) lists the others in
+// MMU::sharers; its referenced and dirty bits are kept in `entry`.
+struct FrameInfo {
+    int pid;
+    int shares;             // Other pages mapping the frame
+    int64_t pageNumber;
+    PageTableEntry* entry;  // nullptr while the frame is free
+    
+    FrameInfo() : pid(-1), shares(0), pageNumber(-1), entry(nullptr) {}
+};
+
+// Frame allocation strategies
+enum FrameAllocatorType {
+    ALLOCATOR_BUDDY,   // Free lists per block size, the last freed first
+    ALLOCATOR_BITMAP   // The lowest free frames first, by scanning a bitmap
+};
+
+// Free physical frames, handed out as aligned blocks of 2^order frames.
+// Whatever the strategy, free memory is described as its maximal aligned
+// free blocks, the blocks a buddy allocator with every buddy merged would
+// hold, so fragmentation reads the same for all of them. Cores share the
+// allocator under the memory lock.
+class FrameAllocator {
+protected:
+    int numFrames;
+    int maxOrder;  // Largest block: the largest power of two frames that fits
+    
+public:
+    explicit FrameAllocator(int frames) : numFrames(frames), maxOrder(0) {
+        while ((2LL << maxOrder) <= frames) {
+            maxOrder++;
         }
-        
-        // Update TLB (FIFO replacement)
-        static int tlbIndex = 0;
-        tlb[tlbIndex].pid = pid;
-        tlb[tlbIndex].pageNumber = pageNumber;
-        tlb[tlbIndex].frameNumber = frame;
-        tlb[tlbIndex].valid = true;
-        tlbIndex = (tlbIndex + 1) % TLB_SIZE;
-        
-        return frame * PAGE_SIZE + offset;
     }
+    virtual ~FrameAllocator() {}
+    virtual const char* name() const = 0;
     
-    // Handle interrupts
-    void handleInterrupt(InterruptType type, int pid, int addr) {
-        output << "\n=== INTERRUPT HANDLER ===\n";
-        
-        switch (type) {
-            case PAGE_FAULT:
-                output << "Type: PAGE FAULT\n";
-                output << "Process: " << pid << ", Address: " << addr << "\n";
-                break;
-                
-            case INVALID_ACCESS:
-                output << "Type: INVALID ACCESS\n";
-                output << "Process: " << pid << " does not exist\n";
+    int maxBlockOrder() const {
+        return maxOrder;
+    }
+    
+    virtual long long freeFrames() const = 0;
+    // First frame of a free block of 2^order frames, or -1
+    virtual int allocate(int order) = 0;
+    virtual void free(int block, int order) = 0;
+    // Maximal free blocks of each order, 0 to maxBlockOrder()
+    virtual vector<long long> freeBlocks() const = 0;
+    
+    // Checkpoints: the free blocks of each order
+    virtual void save(string& out) const = 0;
+    // Calls taken(first, frames) for every restored block, so the caller
+    // can check that none overlap
+    virtual void restore(CheckpointReader& in, const function<void(int, int)>& taken) = 0;
+    
+protected:
+    // The blocks of one order as save() wrote them
+    vector<int> readBlocks(CheckpointReader& in, int order, const function<void(int, int)>& taken) const {
+        vector<int> blocks;
+        for (int64_t n = in.get(0, (numFrames >> order) + 1); n > 0 && !in.failed; n--) {
+            int block = (int)in.get(0, numFrames);
+            if (block % (1 << order) != 0 || block + (1 << order) > numFrames) {
+                in.failed = true;
+                break;
+            }
+            blocks.push_back(block);
+            taken(block, 1 << order);
+        }
+        return blocks;
+    }
+};
+
+// The buddy system. A request splits the smallest free block that fits in
+// halves until it has the size asked for; a freed block merges with its
+// buddy, the other half of the block they were split from, as long as that
+// is free too. Each order keeps its free blocks on a list threaded through
+// the frames, the last freed first, so allocation takes O(orders) and a
+// fresh allocator hands out frames in ascending order.
+class BuddyAllocator : public FrameAllocator {
+private:
+    vector<int> head;          // Per order: first free block, -1 if none
+    vector<int> count;         // Per order: free blocks
+    vector<int> next, prev;    // Per frame heading a free block: its list neighbours
+    vector<int8_t> freeOrder;  // Per frame: order of the free block it heads, -1 if none
+    long long freeCount;
+    
+    void push(int block, int order) {
+        prev[block] = -1;
+        next[block] = head[order];
+        if (head[order] != -1) {
+            prev[head[order]] = block;
+        }
+        head[order] = block;
+        freeOrder[block] = (int8_t)order;
+        count[order]++;
+    }
+    
+    void unlink(int block) {
+        int order = freeOrder[block];
+        if (prev[block] != -1) next[prev[block]] = next[block]; else head[order] = next[block];
+        if (next[block] != -1) prev[next[block]] = prev[block];
+        freeOrder[block] = -1;
+        count[order]--;
+    }
+    
+public:
+    explicit BuddyAllocator(int frames) : FrameAllocator(frames), next(frames, -1), prev(frames, -1),
+                                          freeOrder(frames, -1), freeCount(0) {
+        head.assign(maxOrder + 1, -1);
+        count.assign(maxOrder + 1, 0);
+        for (int block = 0; block < frames;) {
+            int order = maxOrder;
+            while (block % (1 << order) != 0 || block + (1 << order) > frames) {
+                order--;
+            }
+            free(block, order);
+            block += 1 << order;
+        }
+    }
+    
+    const char* name() const override {
+        return "buddy";
+    }
+    
+    long long freeFrames() const override {
+        return freeCount;
+    }
+    
+    int allocate(int order) override {
+        if (freeCount < (1LL << order)) {
+            return -1;
+        }
+        int k = order;
+        while (k <= maxOrder && head[k] == -1) {
+            k++;
+        }
+        if (k > maxOrder) {
+            return -1;
+        }
+        int block = head[k];
+        unlink(block);
+        while (k > order) {
+            k--;
+            push(block + (1 << k), k);
+        }
+        freeCount -= 1LL << order;
+        return block;
+    }
+    
+    void free(int block, int order) override {
+        freeCount += 1LL << order;
+        while (order < maxOrder) {
+            int buddy = block ^ (1 << order);
+            if (buddy >= numFrames || freeOrder[buddy] != order) {
+                break;
+            }
+            unlink(buddy);
+            block = min(block, buddy);
+            order++;
+        }
+        push(block, order);
+    }
+    
+    vector<long long> freeBlocks() const override {
+        return vector<long long>(count.begin(), count.end());
+    }
+    
+    // Each list from its head, so a restore hands out the same frames next
+    void save(string& out) const override {
+        for (int order = 0; order <= maxOrder; order++) {
+            putVarint(out, count[order]);
+            for (int block = head[order]; block != -1; block = next[block]) {
+                putVarint(out, block);
+            }
+        }
+    }
+    
+    void restore(CheckpointReader& in, const function<void(int, int)>& taken) override {
+        fill(head.begin(), head.end(), -1);
+        fill(count.begin(), count.end(), 0);
+        fill(freeOrder.begin(), freeOrder.end(), -1);
+        freeCount = 0;
+        for (int order = 0; order <= maxOrder && !in.failed; order++) {
+            vector<int> blocks = readBlocks(in, order, taken);
+            for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+                push(*it, order);
+            }
+            freeCount += (long long)blocks.size() << order;
+        }
+    }
+};
+
+// A bitmap under a 64-way summary tree: a bit above is set while the word
+// below it has any bit set, so the lowest set bit is found in O(log64 bits)
+// by descending with count-trailing-zeros
+class SummaryTree {
+private:
+    vector<vector<uint64_t>> levels;  // levels[0]: the bits; the last level is one word
+    
+public:
+    explicit SummaryTree(size_t bits) {
+        size_t words = max<size_t>(1, (bits + 63) / 64);
+        while (true) {
+            levels.push_back(vector<uint64_t>(words, 0));
+            if (words == 1) {
+                break;
+            }
+            words = (words + 63) / 64;
+        }
+    }
+    
+    void assign(size_t bit, bool value) {
+        for (vector<uint64_t>& level : levels) {
+            uint64_t& word = level[bit / 64];
+            bool wasEmpty = word == 0;
+            word = value ? word | 1ULL << (bit % 64) : word & ~(1ULL << (bit % 64));
+            if (wasEmpty == (word == 0)) {
+                return;
+            }
+            bit /= 64;
+        }
+    }
+    
+    // Lowest set bit, or -1
+    int64_t first() const {
+        if (levels.back()[0] == 0) {
+            return -1;
+        }
+        size_t index = 0;
+        for (size_t level = levels.size(); level-- > 0;) {
+            index = index * 64 + __builtin_ctzll(levels[level][index]);
+        }
+        return (int64_t)index;
+    }
+};
+
+// One bit per unit, set while it is free. A summary tree per block size up
+// to 32 units marks the words holding a free aligned block of that size.
+// Larger blocks take whole words, so they are found the same way in a
+// bitmap over the words, set while a word is all free.
+class FreeBitmap {
+private:
+    int units;
+    vector<uint64_t> bits;
+    vector<uint8_t> fitting;     // Per word: bit k set while it holds a free aligned block of 2^k units, bit 6 while all free
+    vector<SummaryTree> fits;    // fits[k]: the words with bit k set
+    unique_ptr<FreeBitmap> full; // Over the whole words; nullptr under 64 units
+    
+    // Bits of a word that start a free aligned block of 2^k units
+    static uint64_t blocksIn(uint64_t word, int k) {
+        for (int i = 0; i < k && word != 0; i++) {
+            word &= word >> (1 << i);
+        }
+        return word & ~0ULL / ((1ULL << (1 << k)) - 1);
+    }
+    
+    // Only the trees whose bit changed are touched
+    void update(size_t index) {
+        uint64_t word = bits[index];
+        uint8_t now = word == ~0ULL ? 0x7F : 0;
+        for (int k = 0; k < 6 && word != ~0ULL && blocksIn(word, k) != 0; k++) {
+            now |= 1 << k;
+        }
+        uint8_t changed = now ^ fitting[index];
+        fitting[index] = now;
+        for (int k = 0; k < 6; k++) {
+            if (changed >> k & 1) {
+                fits[k].assign(index, now >> k & 1);
+            }
+        }
+        if ((changed & 0x40) && full && (int)index < units / 64) {
+            full->assign((int)index, 1, word == ~0ULL);
+        }
+    }
+    
+public:
+    explicit FreeBitmap(int units) : units(units), bits((units + 63) / 64, 0), fitting(bits.size(), 0) {
+        size_t words = bits.size();
+        for (int k = 0; k < 6; k++) {
+            fits.push_back(SummaryTree(words));
+        }
+        if (units >= 64) {
+            full.reset(new FreeBitmap(units / 64));
+        }
+    }
+    
+    const vector<uint64_t>& words() const {
+        return bits;
+    }
+    
+    // First unit of the lowest free aligned block of 2^order units, or -1
+    int64_t find(int order) const {
+        if (order < 6) {
+            int64_t index = fits[order].first();
+            return index < 0 ? -1 : index * 64 + __builtin_ctzll(blocksIn(bits[index], order));
+        }
+        int64_t word = full ? full->find(order - 6) : -1;
+        return word < 0 ? -1 : word * 64;
+    }
+    
+    void assign(int first, int count, bool free) {
+        for (int unit = first; unit < first + count;) {
+            int bit = unit % 64;
+            int n = min(64 - bit, first + count - unit);
+            uint64_t mask = (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << bit;
+            uint64_t& word = bits[unit / 64];
+            word = free ? word | mask : word & ~mask;
+            update(unit / 64);
+            unit += n;
+        }
+    }
+};
+
+// The lowest free frames first. Single frames and aligned blocks of every
+// size are found in O(log64 frames) through the summary trees of a
+// FreeBitmap; free blocks are counted by scanning its words.
+class BitmapAllocator : public FrameAllocator {
+private:
+    FreeBitmap map;
+    long long freeCount;
+    
+    bool isFree(int first, int frames) const {
+        const vector<uint64_t>& bits = map.words();
+        if (frames < 64) {
+            uint64_t mask = ((1ULL << frames) - 1) << (first % 64);
+            return (bits[first / 64] & mask) == mask;
+        }
+        for (int word = first / 64; word < (first + frames) / 64; word++) {
+            if (bits[word] != ~0ULL) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Calls visit(block, order) for the maximal free blocks in ascending
+    // order: from each free frame, the largest aligned block that is free
+    void forEachFreeBlock(const function<void(int, int)>& visit) const {
+        const vector<uint64_t>& bits = map.words();
+        for (int frame = 0; frame < numFrames;) {
+            uint64_t word = bits[frame / 64] >> (frame % 64);
+            if (word == 0) {
+                frame = (frame / 64 + 1) * 64;
+                continue;
+            }
+            frame += __builtin_ctzll(word);
+            int order = frame == 0 ? maxOrder : min(maxOrder, __builtin_ctz(frame));
+            while (frame + (1 << order) > numFrames || !isFree(frame, 1 << order)) {
+                order--;
+            }
+            visit(frame, order);
+            frame += 1 << order;
+        }
+    }
+    
+public:
+    explicit BitmapAllocator(int frames) : FrameAllocator(frames), map(frames), freeCount(frames) {
+        map.assign(0, frames, true);
+    }
+    
+    const char* name() const override {
+        return "bitmap";
+    }
+    
+    long long freeFrames() const override {
+        return freeCount;
+    }
+    
+    int allocate(int order) override {
+        if (freeCount < (1LL << order)) {
+            return -1;
+        }
+        int block = (int)map.find(order);
+        if (block == -1) {
+            return -1;
+        }
+        map.assign(block, 1 << order, false);
+        freeCount -= 1LL << order;
+        return block;
+    }
+    
+    void free(int block, int order) override {
+        map.assign(block, 1 << order, true);
+        freeCount += 1LL << order;
+    }
+    
+    vector<long long> freeBlocks() const override {
+        vector<long long> blocks(maxOrder + 1, 0);
+        forEachFreeBlock([&blocks](int block, int order) {
+            blocks[order]++;
+        });
+        return blocks;
+    }
+    
+    // In ascending order; the bitmap has no other state
+    void save(string& out) const override {
+        vector<vector<int>> blocks(maxOrder + 1);
+        forEachFreeBlock([&blocks](int block, int order) {
+            blocks[order].push_back(block);
+        });
+        for (const vector<int>& list : blocks) {
+            putVarint(out, (int64_t)list.size());
+            for (int block : list) {
+                putVarint(out, block);
+            }
+        }
+    }
+    
+    void restore(CheckpointReader& in, const function<void(int, int)>& taken) override {
+        map = FreeBitmap(numFrames);
+        freeCount = 0;
+        for (int order = 0; order <= maxOrder && !in.failed; order++) {
+            for (int block : readBlocks(in, order, taken)) {
+                map.assign(block, 1 << order, true);
+                freeCount += 1LL << order;
+            }
+        }
+    }
+};
+
+unique_ptr<FrameAllocator> createFrameAllocator(FrameAllocatorType type, int frames) {
+    if (type == ALLOCATOR_BITMAP) {
+        return unique_ptr<FrameAllocator>(new BitmapAllocator(frames));
+    }
+    return unique_ptr<FrameAllocator>(new BuddyAllocator(frames));
+}
+
+// Page replacement policies
+enum ReplacementPolicyType {
+    POLICY_FIFO,
+    POLICY_LRU,
+    POLICY_CLOCK,  // Second chance on the referenced bit
+    POLICY_NRU,    // Enhanced second chance on (referenced, dirty)
+    POLICY_LFU,
+    POLICY_OPT     // Belady's optimal, needs the whole trace up front
+};
+
+// A replacement policy tracks the resident frames and picks the victim when
+// memory is full. `now` is the index of the current access in the trace.
+class ReplacementPolicy {
+public:
+    virtual ~ReplacementPolicy() {}
+    virtual const char* name() const = 0;
+    virtual void pageLoaded(int frame, long long now) = 0;
+    virtual void pageReferenced(int, long long) {}
+    virtual void pageFreed(int frame) = 0;
+    // Frame to evict (no longer tracked afterwards), or -1 if none is resident
+    virtual int selectVictim() = 0;
+    // Undo selectVictim: the frame stays resident where it was
+    virtual void keepVictim(int frame) = 0;
+    // Checkpoints: the policy's own state, restored into a fresh policy once
+    // the frame table holds the resident pages again
+    virtual void save(string& out) const = 0;
+    virtual void restore(CheckpointReader& in) = 0;
+};
+
+// FIFO and LRU: resident frames in a doubly linked list threaded through
+// per-frame arrays, victim at the head. LRU moves a frame to the tail on
+// every reference, FIFO never reorders.
+class ListPolicy : public ReplacementPolicy {
+private:
+    vector<int> prev, next;
+    vector<char> linked;
+    int head, tail;
+    bool recency;
+    
+    void unlink(int frame) {
+        if (prev[frame] != -1) next[prev[frame]] = next[frame]; else head = next[frame];
+        if (next[frame] != -1) prev[next[frame]] = prev[frame]; else tail = prev[frame];
+        linked[frame] = false;
+    }
+    
+    void pushBack(int frame) {
+        prev[frame] = tail;
+        next[frame] = -1;
+        if (tail != -1) next[tail] = frame; else head = frame;
+        tail = frame;
+        linked[frame] = true;
+    }
+    
+    void pushFront(int frame) {
+        prev[frame] = -1;
+        next[frame] = head;
+        if (head != -1) prev[head] = frame; else tail = frame;
+        head = frame;
+        linked[frame] = true;
+    }
+    
+public:
+    ListPolicy(int numFrames, bool recency) : prev(numFrames, -1), next(numFrames, -1),
+                                              linked(numFrames, false), head(-1), tail(-1),
+                                              recency(recency) {}
+    
+    const char* name() const override { return recency ? "LRU" : "FIFO"; }
+    
+    void pageLoaded(int frame, long long) override {
+        pushBack(frame);
+    }
+    
+    void pageReferenced(int frame, long long) override {
+        if (recency && linked[frame] && frame != tail) {
+            unlink(frame);
+            pushBack(frame);
+        }
+    }
+    
+    void pageFreed(int frame) override {
+        if (linked[frame]) {
+            unlink(frame);
+        }
+    }
+    
+    int selectVictim() override {
+        int victim = head;
+        if (victim != -1) {
+            unlink(victim);
+        }
+        return victim;
+    }
+    
+    void keepVictim(int frame) override {
+        pushFront(frame);
+    }
+    
+    // The list from the head
+    void save(string& out) const override {
+        vector<int> order;
+        for (int frame = head; frame != -1; frame = next[frame]) {
+            order.push_back(frame);
+        }
+        putVarint(out, (int64_t)order.size());
+        for (int frame : order) {
+            putVarint(out, frame);
+        }
+    }
+    
+    void restore(CheckpointReader& in) override {
+        int numFrames = (int)linked.size();
+        for (int64_t n = in.get(0, numFrames + 1); n > 0 && !in.failed; n--) {
+            int frame = (int)in.get(0, numFrames);
+            if (linked[frame]) {
+                in.failed = true;
+                return;
+            }
+            pushBack(frame);
+        }
+    }
+};
+
+// Clock (second chance) and enhanced NRU. A hand sweeps the frames in
+// order; referenced pages get their bit cleared and are skipped once. The
+// enhanced variant prefers clean pages: it looks for (0,0), then (0,1)
+// while clearing referenced bits, and repeats, so at most four sweeps.
+class ClockPolicy : public ReplacementPolicy {
+private:
+    const vector<FrameInfo>& frames;
+    vector<char> resident;
+    int residentCount;
+    int hand;
+    bool useDirty;
+    
+    int take(int frame) {
+        resident[frame] = false;
+        residentCount--;
+        return frame;
+    }
+    
+    int advance() {
+        int frame = hand;
+        hand = (hand + 1) % (int)resident.size();
+        return frame;
+    }
+    
+public:
+    ClockPolicy(const vector<FrameInfo>& frames, bool useDirty)
+        : frames(frames), resident(frames.size(), false), residentCount(0), hand(0), useDirty(useDirty) {}
+    
+    const char* name() const override { return useDirty ? "Enhanced NRU" : "Clock"; }
+    
+    void pageLoaded(int frame, long long) override {
+        resident[frame] = true;
+        residentCount++;
+    }
+    
+    void pageFreed(int frame) override {
+        if (resident[frame]) {
+            take(frame);
+        }
+    }
+    
+    int selectVictim() override {
+        if (residentCount == 0) {
+            return -1;
+        }
+        
+        if (!useDirty) {
+            while (true) {
+                int frame = advance();
+                if (!resident[frame]) {
+                    continue;
+                }
+                PageTableEntry* entry = frames[frame].entry;
+                if (!entry->referenced) {
+                    return take(frame);
+                }
+                entry->referenced = false;
+            }
+        }
+        
+        for (int pass = 0; pass < 4; pass++) {
+            bool wantDirty = (pass % 2 == 1);
+            for (int i = 0; i < (int)resident.size(); i++) {
+                int frame = advance();
+                if (!resident[frame]) {
+                    continue;
+                }
+                PageTableEntry* entry = frames[frame].entry;
+                if (!entry->referenced && entry->dirty == wantDirty) {
+                    return take(frame);
+                }
+                if (wantDirty) {
+                    entry->referenced = false;
+                }
+            }
+        }
+        return -1;
+    }
+    
+    void keepVictim(int frame) override {
+        resident[frame] = true;
+        residentCount++;
+        hand = frame;
+    }
+    
+    // The hand; the resident frames are those in the frame table
+    void save(string& out) const override {
+        putVarint(out, hand);
+    }
+    
+    void restore(CheckpointReader& in) override {
+        hand = (int)in.get(0, (int64_t)resident.size());
+        residentCount = 0;
+        for (size_t frame = 0; frame < resident.size(); frame++) {
+            resident[frame] = (frames[frame].entry != nullptr);
+            residentCount += resident[frame];
+        }
+    }
+};
+
+// LFU: frames ordered by (reference count, last reference), so ties go to
+// the least recently used page. O(log n) per operation.
+class LFUPolicy : public ReplacementPolicy {
+private:
+    vector<long long> count;
+    vector<long long> lastUse;
+    set<tuple<long long, long long, int>> order;
+    
+public:
+    explicit LFUPolicy(int numFrames) : count(numFrames, 0), lastUse(numFrames, 0) {}
+    
+    const char* name() const override { return "LFU"; }
+    
+    void pageLoaded(int frame, long long now) override {
+        count[frame] = 1;
+        lastUse[frame] = now;
+        order.insert(make_tuple(count[frame], lastUse[frame], frame));
+    }
+    
+    void pageReferenced(int frame, long long now) override {
+        if (order.erase(make_tuple(count[frame], lastUse[frame], frame))) {
+            count[frame]++;
+            lastUse[frame] = now;
+            order.insert(make_tuple(count[frame], lastUse[frame], frame));
+        }
+    }
+    
+    void pageFreed(int frame) override {
+        order.erase(make_tuple(count[frame], lastUse[frame], frame));
+    }
+    
+    int selectVictim() override {
+        if (order.empty()) {
+            return -1;
+        }
+        int victim = get<2>(*order.begin());
+        order.erase(order.begin());
+        return victim;
+    }
+    
+    void keepVictim(int frame) override {
+        order.insert(make_tuple(count[frame], lastUse[frame], frame));
+    }
+    
+    void save(string& out) const override {
+        putVarint(out, (int64_t)order.size());
+        for (const auto& item : order) {
+            putVarint(out, get<2>(item));
+            putVarint(out, get<0>(item));
+            putVarint(out, get<1>(item));
+        }
+    }
+    
+    void restore(CheckpointReader& in) override {
+        int numFrames = (int)count.size();
+        for (int64_t n = in.get(0, numFrames + 1); n > 0 && !in.failed; n--) {
+            int frame = (int)in.get(0, numFrames);
+            count[frame] = in.get();
+            lastUse[frame] = in.get();
+            order.insert(make_tuple(count[frame], lastUse[frame], frame));
+        }
+    }
+};
+
+// Belady's OPT: evict the page whose next use lies furthest in the future.
+// nextUse[i] is the index of the next access to the page touched by access
+// i (NEVER if there is none), precomputed from the whole trace.
+class OptimalPolicy : public ReplacementPolicy {
+private:
+    const vector<long long>& nextUse;
+    vector<long long> key;
+    set<pair<long long, int>> order;
+    
+public:
+    static constexpr long long NEVER = LLONG_MAX;
+    
+    OptimalPolicy(int numFrames, const vector<long long>& nextUse) : nextUse(nextUse), key(numFrames, 0) {}
+    
+    const char* name() const override { return "OPT"; }
+    
+    void pageLoaded(int frame, long long now) override {
+        key[frame] = now < (long long)nextUse.size() ? nextUse[now] : NEVER;
+        order.insert(make_pair(key[frame], frame));
+    }
+    
+    void pageReferenced(int frame, long long now) override {
+        if (order.erase(make_pair(key[frame], frame))) {
+            pageLoaded(frame, now);
+        }
+    }
+    
+    void pageFreed(int frame) override {
+        order.erase(make_pair(key[frame], frame));
+    }
+    
+    int selectVictim() override {
+        if (order.empty()) {
+            return -1;
+        }
+        auto last = prev(order.end());
+        int victim = last->second;
+        order.erase(last);
+        return victim;
+    }
+    
+    void keepVictim(int frame) override {
+        order.insert(make_pair(key[frame], frame));
+    }
+    
+    // The next-use keys; nextUse itself is rebuilt from the trace
+    void save(string& out) const override {
+        putVarint(out, (int64_t)order.size());
+        for (const auto& item : order) {
+            putVarint(out, item.second);
+            putVarint(out, item.first);
+        }
+    }
+    
+    void restore(CheckpointReader& in) override {
+        int numFrames = (int)key.size();
+        for (int64_t n = in.get(0, numFrames + 1); n > 0 && !in.failed; n--) {
+            int frame = (int)in.get(0, numFrames);
+            key[frame] = in.get();
+            order.insert(make_pair(key[frame], frame));
+        }
+    }
+};
+
+unique_ptr<ReplacementPolicy> createPolicy(ReplacementPolicyType type, const vector<FrameInfo>& frames,
+                                           const vector<long long>& nextUse) {
+    int numFrames = (int)frames.size();
+    switch (type) {
+        case POLICY_LRU: return unique_ptr<ReplacementPolicy>(new ListPolicy(numFrames, true));
+        case POLICY_CLOCK: return unique_ptr<ReplacementPolicy>(new ClockPolicy(frames, false));
+        case POLICY_NRU: return unique_ptr<ReplacementPolicy>(new ClockPolicy(frames, true));
+        case POLICY_LFU: return unique_ptr<ReplacementPolicy>(new LFUPolicy(numFrames));
+        case POLICY_OPT: return unique_ptr<ReplacementPolicy>(new OptimalPolicy(numFrames, nextUse));
+        default: return unique_ptr<ReplacementPolicy>(new ListPolicy(numFrames, false));
+    }
+}
+
+// Structured events. In NDJSON every event is an object with a "type" and
+// the fields of its schema. The binary form is a headerless stream of
+// records: the type byte, zigzag varints of the integer fields in schema
+// order, then for events with a text field its length as a varint and the
+// raw bytes. The same verbosity levels apply as for the text log.
+enum EventType : uint8_t {
+    EV_ACCESS,              // pid, addr, write
+    EV_TRANSLATION,         // pid, addr, phys
+    EV_TLB_HIT,             // pid, page
+    EV_TLB_MISS,            // pid, page
+    EV_PAGE_FAULT,          // pid, page
+    EV_FRAME_ALLOCATED,     // pid, page, frame
+    EV_REPLACEMENT,         // pid, page, frame, dirty
+    EV_INTERRUPT,           // kind (InterruptType), pid, addr (the tick for a timer interrupt)
+    EV_PROCESS_CREATED,     // pid, pages
+    EV_PROCESS_TERMINATED,  // pid, faults
+    EV_ERROR,               // pid, arg, text: message
+    EV_STATISTICS,          // tlb_hits, tlb_misses, replacements, free_frames, frames, processes, page_table_bytes
+    EV_PROCESS,             // pid, faults, valid_pages, text: state
+    EV_MAPPING,             // pid, page, frame
+    EV_FINAL,               // Final statistics and memory map follow
+    EV_CPU,                 // cpu, tlb_hits, tlb_misses, shootdowns_received
+    EV_SHOOTDOWNS,          // shootdowns, ipis, total_ns, max_ns, lock_acquired, lock_contended
+    EV_ANALYSIS,            // accesses, skipped, cold, peak_pages, window, wss_mean (thousandths), wss_max
+    EV_WORKING_SET,         // access, size
+    EV_REUSE,               // min, max (both -1 for first uses), count
+    EV_MISS_RATIO,          // frames, misses
+    EV_FAULT_FREQUENCY,     // pid, accesses, pages, faults
+    EV_SWEEP_RESULT,        // index, accesses, tlb_hits, tlb_misses, faults, replacements, text: config
+    EV_DISPATCH,            // pid, tick
+    EV_SCHEDULE,            // completed, ticks, idle_ticks, turnaround, waiting, response, context_switches, timer_interrupts
+    EV_CHECKPOINT,          // commands, bytes
+    EV_RESUME,              // commands
+    EV_PREFETCH,            // pid, page, pages, stride
+    EV_RESCUE,              // pid, page
+    EV_WRITE_BACK,          // pages
+    EV_SWAP,                // slots_used, slots, peak_slots, reads, writes, read_requests, write_requests, lost
+    EV_SWAP_PAGING,         // prefetched, prefetch_hits, prefetch_wasted, prefetch_wait_ns, rescued
+    EV_DISK,                // elapsed_ns, busy_ns, requests, depth_total, max_depth, fault_ns, disk_faults, eat_ns
+    EV_SWEEP_SWAP,          // index, eat_ns, reads, writes
+    EV_FORK,                // parent, child, pages
+    EV_SHARE,               // pid, source, page, pages
+    EV_MMAP,                // pid, page, pages
+    EV_SHARED_FAULT,        // pid, page, frame
+    EV_COPY_ON_WRITE,       // pid, page, frame
+    EV_SHARING,             // forks, forked_pages, shared_frames, mappings, cow_copies, cow_reused, shared_faults, zero_fills
+    EV_SHARED_FRAME,        // frame, mappings, copy_on_write
+    EV_HUGE_PAGE,           // pid, page, frame, pages
+    EV_PROMOTION,           // pid, page, pages, migrated
+    EV_DEMOTION,            // pid, page, pages
+    EV_HUGE_PAGES,          // pages, faults, promotions, migrated, demotions, mapped
+    EV_TLB_REACH,           // mean_bytes, bytes, huge_entries, base_misses
+    EV_FREE_BLOCKS          // frames, blocks, unusable, fragmentation (thousandths)
+};
+
+const EventSchema EVENT_SCHEMAS[] = {
+    {"access", {"pid", "addr", "write"}, nullptr},
+    {"translation", {"pid", "addr", "phys"}, nullptr},
+    {"tlb_hit", {"pid", "page"}, nullptr},
+    {"tlb_miss", {"pid", "page"}, nullptr},
+    {"page_fault", {"pid", "page"}, nullptr},
+    {"frame_allocated", {"pid", "page", "frame"}, nullptr},
+    {"replacement", {"pid", "page", "frame", "dirty"}, nullptr},
+    {"interrupt", {"kind", "pid", "addr"}, nullptr},
+    {"process_created", {"pid", "pages"}, nullptr},
+    {"process_terminated", {"pid", "faults"}, nullptr},
+    {"error", {"pid", "arg"}, "message"},
+    {"statistics", {"tlb_hits", "tlb_misses", "replacements", "free_frames", "frames", "processes",
+                    "page_table_bytes"}, nullptr},
+    {"process", {"pid", "faults", "valid_pages"}, "state"},
+    {"mapping", {"pid", "page", "frame"}, nullptr},
+    {"final", {}, nullptr},
+    {"cpu", {"cpu", "tlb_hits", "tlb_misses", "shootdowns_received"}, nullptr},
+    {"shootdowns", {"shootdowns", "ipis", "total_ns", "max_ns", "lock_acquired", "lock_contended"}, nullptr},
+    {"analysis", {"accesses", "skipped", "cold", "peak_pages", "window", "wss_mean", "wss_max"}, nullptr},
+    {"working_set", {"access", "size"}, nullptr},
+    {"reuse", {"min", "max", "count"}, nullptr},
+    {"miss_ratio", {"frames", "misses"}, nullptr},
+    {"fault_frequency", {"pid", "accesses", "pages", "faults"}, nullptr},
+    {"sweep_result", {"index", "accesses", "tlb_hits", "tlb_misses", "faults", "replacements"}, "config"},
+    {"dispatch", {"pid", "tick"}, nullptr},
+    {"schedule", {"completed", "ticks", "idle_ticks", "turnaround", "waiting", "response", "context_switches",
+                  "timer_interrupts"}, nullptr},
+    {"checkpoint", {"commands", "bytes"}, nullptr},
+    {"resume", {"commands"}, nullptr},
+    {"prefetch", {"pid", "page", "pages", "stride"}, nullptr},
+    {"rescue", {"pid", "page"}, nullptr},
+    {"write_back", {"pages"}, nullptr},
+    {"swap", {"slots_used", "slots", "peak_slots", "reads", "writes", "read_requests", "write_requests", "lost"},
+     nullptr},
+    {"swap_paging", {"prefetched", "prefetch_hits", "prefetch_wasted", "prefetch_wait_ns", "rescued"}, nullptr},
+    {"disk", {"elapsed_ns", "busy_ns", "requests", "depth_total", "max_depth", "fault_ns", "disk_faults", "eat_ns"},
+     nullptr},
+    {"sweep_swap", {"index", "eat_ns", "reads", "writes"}, nullptr},
+    {"fork", {"parent", "child", "pages"}, nullptr},
+    {"share", {"pid", "source", "page", "pages"}, nullptr},
+    {"mmap", {"pid", "page", "pages"}, nullptr},
+    {"shared_fault", {"pid", "page", "frame"}, nullptr},
+    {"copy_on_write", {"pid", "page", "frame"}, nullptr},
+    {"sharing", {"forks", "forked_pages", "shared_frames", "mappings", "cow_copies", "cow_reused", "shared_faults",
+                 "zero_fills"}, nullptr},
+    {"shared_frame", {"frame", "mappings", "copy_on_write"}, nullptr},
+    {"huge_page", {"pid", "page", "frame", "pages"}, nullptr},
+    {"promotion", {"pid", "page", "pages", "migrated"}, nullptr},
+    {"demotion", {"pid", "page", "pages"}, nullptr},
+    {"huge_pages", {"pages", "faults", "promotions", "migrated", "demotions", "mapped"}, nullptr},
+    {"tlb_reach", {"mean_bytes", "bytes", "huge_entries", "base_misses"}, nullptr},
+    {"free_blocks", {"frames", "blocks", "unusable", "fragmentation"}, nullptr}
+};
+
+// Receives each checkpoint with the number of commands it covers
+typedef function<void(long long, const string&)> CheckpointSink;
+
+// How much of the run is logged
+enum Verbosity {
+    VERBOSITY_SUMMARY,  // Only the final statistics and memory map
+    VERBOSITY_EVENTS,   // Plus faults, replacements, interrupts and process events
+    VERBOSITY_FULL      // Plus every command and every translation
+};
+
+// Page table organisation
+enum PageTableType {
+    PAGE_TABLE_RADIX,   // 1 to 4 level radix tree
+    PAGE_TABLE_HASHED   // Hash of resident pages
+};
+
+// CPU scheduling of the trace's processes
+enum SchedulerType {
+    SCHEDULER_NONE,      // Replay the trace in its own order
+    SCHEDULER_FCFS,
+    SCHEDULER_RR,        // Round robin
+    SCHEDULER_PRIORITY,  // Preemptive, round robin within a priority
+    SCHEDULER_MLFQ,
+    SCHEDULER_CFS        // Fair share by virtual runtime
+};
+
+// log2 of a power of two, -1 otherwise
+int log2Exact(long long value) {
+    if (value <= 0 || (value & (value - 1)) != 0) {
+        return -1;
+    }
+    int bits = 0;
+    while ((1LL << bits) < value) {
+        bits++;
+    }
+    return bits;
+}
+
+// Runtime configuration of an MMU
+struct MMUConfig {
+    int tlbSize;
+    int tlbWays;  // 1 = direct-mapped, 0 = fully associative
+    ReplacementPolicyType policy;
+    Verbosity verbosity;
+    OutputFormat format;
+    int pageSize;
+    int vaBits;  // Virtual address width
+    PageTableType pageTableType;
+    int pageTableLevels;  // Radix tree depth
+    int cpus;             // Cores, each with its own TLB and thread
+    int frames;           // Physical memory size
+    SchedulerType scheduler;
+    int quantum;          // Time slice, in ticks
+    int swapSlots;        // Pages of backing store, 0 for none
+    int memoryNanos;      // Memory access time
+    int diskLatency;      // Per disk request, in microseconds
+    int diskBandwidth;    // MB/s
+    int writeBackBatch;   // Dirty pages per background write, 0 writes each one on eviction
+    int prefetch;         // Pages read ahead on a repeated fault stride, 0 for none
+    vector<long long> hugePages;  // Huge page sizes in bytes, none for base pages only
+    FrameAllocatorType allocator;
+    
+    MMUConfig() : tlbSize(TLB_SIZE), tlbWays(0), policy(POLICY_FIFO), verbosity(VERBOSITY_FULL),
+                  format(FORMAT_TEXT), pageSize(PAGE_SIZE), vaBits(VA_BITS),
+                  pageTableType(PAGE_TABLE_RADIX), pageTableLevels(1), cpus(1), frames(PHYSICAL_MEMORY_SIZE),
+                  scheduler(SCHEDULER_NONE), quantum(QUANTUM), swapSlots(0), memoryNanos(MEMORY_NANOS),
+                  diskLatency(DISK_LATENCY_MICROS), diskBandwidth(DISK_BANDWIDTH), writeBackBatch(0), prefetch(0),
+                  allocator(ALLOCATOR_BUDDY) {}
+    
+    // Bits of the virtual page number
+    int pageNumberBits() const {
+        return vaBits - log2Exact(pageSize);
+    }
+    
+    // Empty if the configuration is usable, otherwise what is wrong with it
+    string validate() const {
+        if (tlbSize < 1) {
+            return "TLB size must be at least 1";
+        }
+        if (tlbWays < 0 || tlbWays > tlbSize || (tlbWays > 0 && tlbSize % tlbWays != 0)) {
+            return "TLB ways must divide the TLB size";
+        }
+        int offsetBits = log2Exact(pageSize);
+        if (offsetBits < 4 || offsetBits > 30) {
+            return "Page size must be a power of two from 16 bytes to 1GB";
+        }
+        if (vaBits < offsetBits || vaBits > 62) {
+            return "Virtual address width must be from the page size up to 62 bits";
+        }
+        if (pageTableType == PAGE_TABLE_RADIX) {
+            if (pageTableLevels < 1 || pageTableLevels > 4) {
+                return "Page table levels must be from 1 to 4";
+            }
+            if ((pageNumberBits() + pageTableLevels - 1) / pageTableLevels > MAX_NODE_BITS) {
+                return "Page table needs more levels for this address width";
+            }
+        }
+        if (frames < 1 || frames > MAX_FRAMES) {
+            return "Frames must be from 1 to " + to_string(MAX_FRAMES);
+        }
+        if (cpus < 1 || cpus > MAX_CPUS) {
+            return "CPUs must be from 1 to " + to_string(MAX_CPUS);
+        }
+        if (cpus > 1 && policy == POLICY_OPT) {
+            return "OPT needs a single trace order and cannot run on several CPUs";
+        }
+        if (quantum < 1) {
+            return "Quantum must be at least 1 tick";
+        }
+        if (scheduler != SCHEDULER_NONE && cpus > 1) {
+            return "Schedulers run on a single CPU";
+        }
+        if (scheduler != SCHEDULER_NONE && policy == POLICY_OPT) {
+            return "OPT needs the trace order and cannot follow a scheduler";
+        }
+        if (swapSlots < 0 || swapSlots > MAX_SWAP_SLOTS) {
+            return "Swap slots must be from 0 (no swap) to " + to_string(MAX_SWAP_SLOTS);
+        }
+        if (memoryNanos < 1 || diskLatency < 0 || diskBandwidth < 1) {
+            return "Memory and disk times must be positive";
+        }
+        if (writeBackBatch < 0 || prefetch < 0) {
+            return "Write-back and prefetch pages cannot be negative";
+        }
+        if (swapSlots == 0 && (writeBackBatch > 0 || prefetch > 0)) {
+            return "Write-back and prefetch need a swap device";
+        }
+        if (swapSlots > 0 && cpus > 1) {
+            return "The swap device is modeled on a single CPU";
+        }
+        if (prefetch > 0 && policy == POLICY_OPT) {
+            return "OPT cannot foresee prefetched pages";
+        }
+        for (long long bytes : hugePages) {
+            int order = log2Exact(bytes) - offsetBits;
+            if (log2Exact(bytes) < 0 || order < 1 || order > 24) {
+                return "Huge pages must be powers of two from twice the page size to 2^24 pages";
+            }
+        }
+        if (!hugePages.empty() && cpus > 1) {
+            return "Huge pages are modeled on a single CPU";
+        }
+        if (!hugePages.empty() && policy == POLICY_OPT) {
+            return "OPT cannot foresee the pages of a huge page";
+        }
+        return "";
+    }
+};
+
+// Trace commands
+enum CommandType : uint8_t {
+    CMD_UNKNOWN,
+    CMD_CREATE,
+    CMD_ACCESS,
+    CMD_WRITE,
+    CMD_TERMINATE,
+    CMD_STATS,
+    CMD_MEMMAP,
+    CMD_PRIORITY,
+    CMD_FORK,
+    CMD_SHARE,
+    CMD_MMAP
+};
+
+// One trace command, parsed from a script line or read from a binary trace
+struct TraceRecord {
+    uint8_t op;
+    int32_t pid;
+    int64_t arg;  // Pages for CREATE and MMAP, virtual address for ACCESS/WRITE, the value for PRIORITY,
+                  // the child for FORK, the source process for SHARE
+};
+
+// Keyword lookup, dispatched on the word length and then its first letter
+uint8_t commandOp(string_view word) {
+    switch (word.size()) {
+        case 4:
+            if (word[0] == 'F' && word == "FORK") return CMD_FORK;
+            if (word[0] == 'M' && word == "MMAP") return CMD_MMAP;
+            break;
+        case 5:
+            if (word[0] == 'W' && word == "WRITE") return CMD_WRITE;
+            if (word[0] == 'S' && word == "STATS") return CMD_STATS;
+            if (word[0] == 'S' && word == "SHARE") return CMD_SHARE;
+            break;
+        case 6:
+            if (word[0] == 'A' && word == "ACCESS") return CMD_ACCESS;
+            if (word[0] == 'C' && word == "CREATE") return CMD_CREATE;
+            if (word[0] == 'M' && word == "MEMMAP") return CMD_MEMMAP;
+            break;
+        case 8:
+            if (word == "PRIORITY") return CMD_PRIORITY;
+            break;
+        case 9:
+            if (word == "TERMINATE") return CMD_TERMINATE;
+            break;
+    }
+    return CMD_UNKNOWN;
+}
+
+// Single pass tokenizer over a whole script buffer. Lines, command words
+// and numbers are read in place, nothing is copied or allocated. Follows
+// the getline/operator>> rules the scripts were written against: a failed
+// number reads as 0 and ends the line's arguments.
+class ScriptTokenizer {
+private:
+    const char* pos;
+    const char* end;
+    long long lineNum;
+    
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f' || c == '\n';
+    }
+    
+    static const char* skipSpace(const char* p, const char* lineEnd) {
+        while (p < lineEnd && isSpace(*p)) {
+            p++;
+        }
+        return p;
+    }
+    
+    template <typename T>
+    static bool parseInt(const char*& p, const char* lineEnd, T& value) {
+        p = skipSpace(p, lineEnd);
+        if (p < lineEnd && *p == '+') {
+            p++;
+        }
+        auto result = from_chars(p, lineEnd, value);
+        if (result.ec == errc::result_out_of_range) {
+            value = (*p == '-') ? numeric_limits<T>::min() : numeric_limits<T>::max();
+            return false;
+        }
+        if (result.ec != errc()) {
+            value = 0;
+            return false;
+        }
+        p = result.ptr;
+        return true;
+    }
+    
+public:
+    ScriptTokenizer(const char* data, size_t size) : pos(data), end(data + size), lineNum(0) {}
+    
+    long long lineNumber() const {
+        return lineNum;
+    }
+    
+    // Next command; blank lines and comments are skipped. `line` views the
+    // raw line, `command` its first word. False at the end of the input.
+    bool next(TraceRecord& rec, string_view& line, string_view& command) {
+        while (pos < end) {
+            const char* lineStart = pos;
+            const char* lineEnd = (const char*)memchr(pos, '\n', end - pos);
+            if (lineEnd == nullptr) {
+                lineEnd = end;
+            }
+            pos = (lineEnd < end) ? lineEnd + 1 : end;
+            lineNum++;
+            
+            if (lineStart == lineEnd || *lineStart == '#') {
+                continue;
+            }
+            
+            line = string_view(lineStart, lineEnd - lineStart);
+            const char* p = skipSpace(lineStart, lineEnd);
+            const char* wordEnd = p;
+            while (wordEnd < lineEnd && !isSpace(*wordEnd)) {
+                wordEnd++;
+            }
+            command = string_view(p, wordEnd - p);
+            p = wordEnd;
+            
+            rec.op = commandOp(command);
+            rec.pid = 0;
+            rec.arg = 0;
+            switch (rec.op) {
+                case CMD_CREATE:
+                case CMD_ACCESS:
+                case CMD_WRITE:
+                case CMD_PRIORITY:
+                case CMD_FORK:
+                case CMD_SHARE:
+                case CMD_MMAP:
+                    if (parseInt(p, lineEnd, rec.pid)) {
+                        parseInt(p, lineEnd, rec.arg);
+                    }
+                    break;
+                case CMD_TERMINATE:
+                    parseInt(p, lineEnd, rec.pid);
+                    break;
+            }
+            return true;
+        }
+        return false;
+    }
+};
+
+// Binary trace format, little-endian:
+//   header  "P2TR", uint32 version, uint32 flags, uint32 reserved, uint64 record count
+//   fixed   12-byte records {uint8 op, 3 reserved bytes, int32 pid, int32 arg}
+//   wide    (TRACE_WIDE flag) 16-byte fixed records with an int64 arg, used
+//           when an address or page count does not fit in 32 bits
+//   delta   (TRACE_DELTA flag) per record the op byte, then zigzag varints of
+//           the pid delta and of the arg, which for ACCESS/WRITE is the delta
+//           from the previous address
+const uint32_t TRACE_VERSION = 1;
+const uint32_t TRACE_DELTA = 1;
+const uint32_t TRACE_WIDE = 2;
+
+struct TraceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t recordCount;
+};
+
+struct PackedRecord {
+    uint8_t op;
+    uint8_t reserved[3];
+    int32_t pid;
+    int32_t arg;
+};
+
+struct PackedWideRecord {
+    uint8_t op;
+    uint8_t reserved[3];
+    int32_t pid;
+    int64_t arg;
+};
+
+static_assert(sizeof(TraceHeader) == 24, "TraceHeader must match the file layout");
+static_assert(sizeof(PackedRecord) == 12, "PackedRecord must match the file layout");
+static_assert(sizeof(PackedWideRecord) == 16, "PackedWideRecord must match the file layout");
+
+bool isBinaryTrace(const char* data, size_t size) {
+    return size >= sizeof(TraceHeader) && memcmp(data, "P2TR", 4) == 0;
+}
+
+void putVarint(string& out, int64_t value) {
+    uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);  // Zigzag
+    while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+// Encode a text script as a binary trace; unknown commands are dropped
+string convertTextTrace(const string& inputContent, bool delta, int& skipped) {
+    string body;
+    uint64_t count = 0;
+    int32_t prevPid = 0;
+    int64_t prevAddr = 0;
+    bool wide = false;
+    skipped = 0;
+    
+    ScriptTokenizer tokens(inputContent.data(), inputContent.size());
+    string_view line, command;
+    TraceRecord rec;
+    while (tokens.next(rec, line, command)) {
+        if (rec.op == CMD_UNKNOWN) {
+            skipped++;
+            continue;
+        }
+        
+        if (delta) {
+            body += (char)rec.op;
+            putVarint(body, (int64_t)rec.pid - prevPid);
+            prevPid = rec.pid;
+            if (rec.op == CMD_ACCESS || rec.op == CMD_WRITE) {
+                putVarint(body, rec.arg - prevAddr);
+                prevAddr = rec.arg;
+            } else {
+                putVarint(body, rec.arg);
+            }
+        } else if (!wide && rec.arg != (int32_t)rec.arg) {
+            // Start over with 64-bit records
+            wide = true;
+            body.clear();
+            count = 0;
+            skipped = 0;
+            tokens = ScriptTokenizer(inputContent.data(), inputContent.size());
+            continue;
+        } else if (wide) {
+            PackedWideRecord packed = {rec.op, {0, 0, 0}, rec.pid, rec.arg};
+            body.append((const char*)&packed, sizeof(packed));
+        } else {
+            PackedRecord packed = {rec.op, {0, 0, 0}, rec.pid, (int32_t)rec.arg};
+            body.append((const char*)&packed, sizeof(packed));
+        }
+        count++;
+    }
+    
+    uint32_t flags = (delta ? TRACE_DELTA : 0) | (wide ? TRACE_WIDE : 0);
+    TraceHeader header = {{'P', '2', 'T', 'R'}, TRACE_VERSION, flags, 0, count};
+    return string((const char*)&header, sizeof(header)) + body;
+}
+
+// Decodes records straight out of a (usually memory-mapped) binary trace
+class BinaryTraceReader {
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+    bool delta;
+    bool wide;
+    uint64_t remaining;
+    int32_t prevPid;
+    int64_t prevAddr;
+    
+    bool getVarint(int64_t& value) {
+        uint64_t v = 0;
+        for (int shift = 0; pos < end && shift < 64; shift += 7) {
+            uint8_t byte = *pos++;
+            v |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+                return true;
+            }
+        }
+        return false;
+    }
+    
+public:
+    BinaryTraceReader(const char* data, size_t size) : prevPid(0), prevAddr(0) {
+        TraceHeader header;
+        memcpy(&header, data, sizeof(header));
+        pos = (const uint8_t*)data + sizeof(header);
+        end = (const uint8_t*)data + size;
+        delta = (header.flags & TRACE_DELTA) != 0;
+        wide = (header.flags & TRACE_WIDE) != 0;
+        remaining = header.recordCount;
+    }
+    
+    bool next(TraceRecord& rec) {
+        if (remaining == 0) {
+            return false;
+        }
+        
+        if (delta) {
+            int64_t pidDelta, arg;
+            if (pos >= end) {
+                return false;
+            }
+            rec.op = *pos++;
+            if (!getVarint(pidDelta) || !getVarint(arg)) {
+                return false;
+            }
+            rec.pid = prevPid = (int32_t)(prevPid + pidDelta);
+            if (rec.op == CMD_ACCESS || rec.op == CMD_WRITE) {
+                rec.arg = prevAddr = prevAddr + arg;
+            } else {
+                rec.arg = arg;
+            }
+        } else if (wide) {
+            if (end - pos < (ptrdiff_t)sizeof(PackedWideRecord)) {
+                return false;
+            }
+            PackedWideRecord packed;
+            memcpy(&packed, pos, sizeof(packed));
+            pos += sizeof(packed);
+            rec.op = packed.op;
+            rec.pid = packed.pid;
+            rec.arg = packed.arg;
+        } else {
+            if (end - pos < (ptrdiff_t)sizeof(PackedRecord)) {
+                return false;
+            }
+            PackedRecord packed;
+            memcpy(&packed, pos, sizeof(packed));
+            pos += sizeof(packed);
+            rec.op = packed.op;
+            rec.pid = packed.pid;
+            rec.arg = packed.arg;
+        }
+        remaining--;
+        return true;
+    }
+};
+
+// Every record of a script or binary trace, decoded once so that several
+// runs can share it
+vector<TraceRecord> decodeTrace(const char* data, size_t size) {
+    vector<TraceRecord> records;
+    TraceRecord rec;
+    if (isBinaryTrace(data, size)) {
+        BinaryTraceReader reader(data, size);
+        while (reader.next(rec)) {
+            records.push_back(rec);
+        }
+    } else {
+        string_view line, command;
+        ScriptTokenizer tokens(data, size);
+        while (tokens.next(rec, line, command)) {
+            records.push_back(rec);
+        }
+    }
+    return records;
+}
+
+// Checkpoint format: "P2CK", uint32 version, then zigzag varints: the
+// number of commands run, the configuration it was taken under (as text),
+// the counters, the free lists of the buddy allocator, every live process
+// with its mapped ranges, page table shape and valid entries, the frames
+// shared by several page tables, the TLB and the replacement policy.
+// A fresh MMU restored from it and given the same trace skips the commands
+// it covers and ends exactly as a run from the start would.
+const uint32_t CHECKPOINT_VERSION = 3;
+
+// Totals of a run, as compared across a sweep
+struct RunStatistics {
+    long long accesses;
+    long long tlbHits;
+    long long tlbMisses;
+    long long pageFaults;
+    long long replacements;
+    long long elapsedNanos;  // Simulated access time, with a swap device only
+    long long diskReads;
+    long long diskWrites;
+};
+
+// Pages added to an address space by SHARE or MMAP
+struct MappedRange {
+    int64_t start;  // First page
+    int64_t pages;
+    int source;     // Process whose pages are mapped, -1 for demand-zero pages
+};
+
+// Process Control Block
+class PCB {
+public:
+    int pid;
+    ProcessState state;
+    int programCounter;
+    int priority;
+    unique_ptr<PageTable> pageTable;  // Built lazily, see PageTable; kept when the PCB is recycled
+    int64_t allocatedPages;
+    int pageFaults;
+    uint64_t cpuMask;  // CPUs whose TLB may hold this process's translations
+    int64_t lastFault;    // Read-ahead: page of the last fault, or the end of the last read-ahead
+    int64_t faultStride;  // Read-ahead: distance between the last two faults
+    vector<MappedRange> ranges;  // In the order they were mapped
+    bool shared;                 // Mapped by a SHARE, so a FORK shares its pages instead of copying them
+    unordered_map<int64_t, int> resident;  // Huge pages: valid entries per aligned region, see MMU::countResident
+    
+    PCB() : pid(-1), state(NEW), programCounter(0), priority(0), allocatedPages(0), pageFaults(0), cpuMask(0),
+            lastFault(-1), faultStride(0), shared(false) {}
+    
+    // Start over as a new process, keeping the (empty) page table object
+    void reset(int id, int64_t pages) {
+        pid = id;
+        state = NEW;
+        programCounter = 0;
+        priority = 0;
+        allocatedPages = pages;
+        pageFaults = 0;
+        cpuMask = 0;
+        lastFault = -1;
+        faultStride = 0;
+        ranges.clear();
+        shared = false;
+        resident.clear();
+    }
+};
+
+// Live processes by pid. PCBs come from fixed-size slabs and go back on a
+// free list when terminated, so once the pool has grown to the peak number
+// of live processes, creating and terminating one allocates nothing. The
+// index is an open-addressing hash of pid -> PCB* with linear probing.
+class ProcessTable {
+private:
+    static const size_t SLAB_SIZE = 64;
+    
+    vector<unique_ptr<PCB[]>> slabs;
+    vector<PCB*> freeList;
+    vector<PCB*> slots;  // Power-of-two sized, nullptr when empty
+    size_t count;
+    
+    size_t home(int pid) const {
+        return (size_t)(((uint64_t)(uint32_t)pid * 0x9E3779B97F4A7C15ULL) >> 32) & (slots.size() - 1);
+    }
+    
+    void place(PCB* pcb) {
+        size_t i = home(pcb->pid);
+        while (slots[i] != nullptr) {
+            i = (i + 1) & (slots.size() - 1);
+        }
+        slots[i] = pcb;
+    }
+    
+    void grow() {
+        vector<PCB*> old(slots.size() * 2, nullptr);
+        old.swap(slots);
+        for (PCB* pcb : old) {
+            if (pcb != nullptr) {
+                place(pcb);
+            }
+        }
+    }
+    
+public:
+    ProcessTable() : slots(16, nullptr), count(0) {}
+    
+    PCB* find(int pid) const {
+        for (size_t i = home(pid);; i = (i + 1) & (slots.size() - 1)) {
+            if (slots[i] == nullptr || slots[i]->pid == pid) {
+                return slots[i];
+            }
+        }
+    }
+    
+    // PCB for a pid that is not in the table yet
+    PCB* insert(int pid, int64_t pages) {
+        if (freeList.empty()) {
+            slabs.emplace_back(new PCB[SLAB_SIZE]);
+            for (size_t i = SLAB_SIZE; i > 0; i--) {
+                freeList.push_back(&slabs.back()[i - 1]);
+            }
+        }
+        if ((count + 1) * 4 > slots.size() * 3) {
+            grow();
+        }
+        PCB* pcb = freeList.back();
+        freeList.pop_back();
+        pcb->reset(pid, pages);
+        place(pcb);
+        count++;
+        return pcb;
+    }
+    
+    // Return a PCB to the pool
+    void erase(PCB* pcb) {
+        size_t i = home(pcb->pid);
+        while (slots[i] != pcb) {
+            i = (i + 1) & (slots.size() - 1);
+        }
+        // Backward-shift deletion keeps every probe chain unbroken
+        size_t hole = i;
+        for (size_t j = (i + 1) & (slots.size() - 1); slots[j] != nullptr; j = (j + 1) & (slots.size() - 1)) {
+            size_t want = home(slots[j]->pid);
+            if (((j - want) & (slots.size() - 1)) >= ((j - hole) & (slots.size() - 1))) {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole] = nullptr;
+        freeList.push_back(pcb);
+        count--;
+    }
+    
+    size_t size() const {
+        return count;
+    }
+    
+    // Live PCBs in ascending pid order, for reports
+    vector<PCB*> sorted() const {
+        vector<PCB*> live;
+        live.reserve(count);
+        for (PCB* pcb : slots) {
+            if (pcb != nullptr) {
+                live.push_back(pcb);
+            }
+        }
+        sort(live.begin(), live.end(), [](const PCB* a, const PCB* b) { return a->pid < b->pid; });
+        return live;
+    }
+};
+
+// A process as the scheduler sees it. Its work is the chain of trace
+// records that follow its CREATE, up to its TERMINATE; every ACCESS/WRITE
+// takes one tick.
+struct Task {
+    int pid;
+    int priority;         // Lower runs first; the nice value under CFS
+    long long arrival;    // Tick of the CREATE, counted in trace accesses
+    long long burst;      // Ticks of work
+    long long cursor;     // Next record to run, -1 when done
+    long long firstRun;   // -1 until first dispatched
+    long long finish;     // -1 until done
+    long long successor;  // Task of the same pid created after this one terminates
+    bool held;            // Arrived while its predecessor was still running
+    
+    // Run queue state
+    Task* next;           // Intrusive FIFO link
+    long long order;      // Enqueue sequence, breaks ties first come first served
+    int level;            // MLFQ queue
+    long long epoch;      // MLFQ boost the level belongs to
+    long long vruntime;   // CFS, in 1/1024 ticks at nice 0
+    long long weight;     // CFS load weight
+    
+    Task(int pid, long long arrival, long long cursor)
+        : pid(pid), priority(0), arrival(arrival), burst(0), cursor(cursor), firstRun(-1), finish(-1),
+          successor(-1), held(false), next(nullptr), order(0), level(0), epoch(0), vruntime(0), weight(0) {}
+};
+
+// FIFO of tasks linked through Task::next; O(1) push, pop and append
+struct TaskQueue {
+    Task* head;
+    Task* tail;
+    
+    TaskQueue() : head(nullptr), tail(nullptr) {}
+    
+    bool empty() const {
+        return head == nullptr;
+    }
+    
+    void push(Task* task) {
+        task->next = nullptr;
+        if (tail != nullptr) {
+            tail->next = task;
+        } else {
+            head = task;
+        }
+        tail = task;
+    }
+    
+    Task* pop() {
+        Task* task = head;
+        head = task->next;
+        if (head == nullptr) {
+            tail = nullptr;
+        }
+        return task;
+    }
+    
+    // Move all of `other` to the back of this queue
+    void append(TaskQueue& other) {
+        if (other.empty()) {
+            return;
+        }
+        if (tail != nullptr) {
+            tail->next = other.head;
+        } else {
+            head = other.head;
+        }
+        tail = other.tail;
+        other.head = other.tail = nullptr;
+    }
+};
+
+// A CPU scheduler owns the ready tasks. `now` is the current tick.
+class Scheduler {
+public:
+    virtual ~Scheduler() {}
+    virtual string name() const = 0;
+    // A task became ready: on arrival, or after losing the CPU
+    virtual void enqueue(Task* task, bool arrived, long long now) = 0;
+    // Ready task to run next (no longer queued afterwards), or nullptr
+    virtual Task* pickNext(long long now) = 0;
+    // Ticks until the timer interrupts the task, 0 to let it run to the end
+    virtual long long timeSlice(const Task& task) const = 0;
+    // The task ran that many ticks since its dispatch, and whether its slice
+    // ran out
+    virtual void charge(Task&, long long, bool) {}
+    virtual void finished(Task&) {}
+    // Whether a task that just arrived takes the CPU from the running one
+    virtual bool preempts(const Task&, const Task&) const { return false; }
+};
+
+// FCFS and round robin: one FIFO queue. Round robin puts a task back at
+// the tail when its quantum expires, FCFS never interrupts.
+class FifoScheduler : public Scheduler {
+private:
+    TaskQueue ready;
+    long long quantum;  // 0 for FCFS
+    
+public:
+    explicit FifoScheduler(long long quantum) : quantum(quantum) {}
+    
+    string name() const override {
+        return quantum == 0 ? "FCFS" : "Round Robin (quantum " + to_string(quantum) + ")";
+    }
+    
+    void enqueue(Task* task, bool, long long) override {
+        ready.push(task);
+    }
+    
+    Task* pickNext(long long) override {
+        return ready.empty() ? nullptr : ready.pop();
+    }
+    
+    long long timeSlice(const Task&) const override {
+        return quantum;
+    }
+};
+
+// Ready tasks in a binary heap on (key, enqueue order)
+struct RunQueueEntry {
+    long long key;
+    long long order;
+    Task* task;
+    
+    bool operator>(const RunQueueEntry& other) const {
+        return key != other.key ? key > other.key : order > other.order;
+    }
+};
+
+typedef priority_queue<RunQueueEntry, vector<RunQueueEntry>, greater<RunQueueEntry>> RunQueue;
+
+// Preemptive priority: the lowest priority value runs, an arrival with a
+// lower value than the running task preempts it, and tasks of equal
+// priority take turns by the quantum
+class PriorityScheduler : public Scheduler {
+private:
+    RunQueue ready;
+    long long quantum;
+    long long sequence;
+    
+public:
+    explicit PriorityScheduler(long long quantum) : quantum(quantum), sequence(0) {}
+    
+    string name() const override {
+        return "Priority (preemptive, quantum " + to_string(quantum) + ")";
+    }
+    
+    void enqueue(Task* task, bool, long long) override {
+        ready.push(RunQueueEntry{task->priority, sequence++, task});
+    }
+    
+    Task* pickNext(long long) override {
+        if (ready.empty()) {
+            return nullptr;
+        }
+        Task* task = ready.top().task;
+        ready.pop();
+        return task;
+    }
+    
+    long long timeSlice(const Task&) const override {
+        return quantum;
+    }
+    
+    bool preempts(const Task& arrived, const Task& running) const override {
+        return arrived.priority < running.priority;
+    }
+};
+
+// Multi-level feedback queue: tasks start in the top queue, drop a level
+// whenever they use up their slice, and the slice doubles per level. Every
+// MLFQ_BOOST quanta all tasks go back to the top; the boost is O(1), as
+// the lower queues are spliced onto the top one and a task's level only
+// counts if it was set since the last boost.
+class MLFQScheduler : public Scheduler {
+private:
+    TaskQueue levels[MLFQ_LEVELS];
+    long long quantum;
+    long long epoch;
+    long long nextBoost;
+    
+    int levelOf(const Task& task) const {
+        return task.epoch == epoch ? task.level : 0;
+    }
+    
+public:
+    explicit MLFQScheduler(long long quantum) : quantum(quantum), epoch(0), nextBoost(quantum * MLFQ_BOOST) {}
+    
+    string name() const override {
+        return "MLFQ (" + to_string(MLFQ_LEVELS) + " levels, quantum " + to_string(quantum) + " doubling per level, boost every "
+               + to_string(quantum * MLFQ_BOOST) + " ticks)";
+    }
+    
+    void enqueue(Task* task, bool arrived, long long) override {
+        task->level = arrived ? 0 : levelOf(*task);
+        task->epoch = epoch;
+        levels[task->level].push(task);
+    }
+    
+    Task* pickNext(long long now) override {
+        if (now >= nextBoost) {
+            for (int i = 1; i < MLFQ_LEVELS; i++) {
+                levels[0].append(levels[i]);
+            }
+            epoch++;
+            nextBoost = now + quantum * MLFQ_BOOST;
+        }
+        for (TaskQueue& queue : levels) {
+            if (!queue.empty()) {
+                return queue.pop();
+            }
+        }
+        return nullptr;
+    }
+    
+    long long timeSlice(const Task& task) const override {
+        return quantum << levelOf(task);
+    }
+    
+    void charge(Task& task, long long, bool expired) override {
+        int level = levelOf(task);
+        if (expired && level < MLFQ_LEVELS - 1) {
+            level++;
+        }
+        task.level = level;
+        task.epoch = epoch;
+    }
+    
+    bool preempts(const Task&, const Task& running) const override {
+        return levelOf(running) > 0;
+    }
+};
+
+// CFS-like fair share: the task with the least virtual runtime runs next.
+// Virtual runtime advances inversely to the load weight of the task's nice
+// value (its priority, -20 to 19), so each runnable task gets CPU time in
+// proportion to its weight. A scheduling period of 6 quanta, stretched to
+// give every runnable task at least 3/4 of a quantum, is split among the
+// tasks by weight. New tasks start at the smallest virtual runtime.
+class CFSScheduler : public Scheduler {
+private:
+    RunQueue ready;
+    long long quantum;
+    long long sequence;
+    long long minVruntime;
+    long long runnable;     // Ready or running
+    long long totalWeight;  // Of the runnable tasks
+    
+    // Weight of nice 0 is 1024, and each nice step is worth about 25%
+    static long long weightOf(int nice) {
+        nice = max(-20, min(19, nice));
+        return max(1LL, (long long)(1024 / pow(1.25, nice) + 0.5));
+    }
+    
+public:
+    explicit CFSScheduler(long long quantum)
+        : quantum(quantum), sequence(0), minVruntime(0), runnable(0), totalWeight(0) {}
+    
+    string name() const override {
+        return "CFS (latency " + to_string(quantum * 6) + " ticks, minimum slice " + to_string(max(1LL, quantum * 3 / 4))
+               + ")";
+    }
+    
+    void enqueue(Task* task, bool arrived, long long) override {
+        if (arrived) {
+            task->weight = weightOf(task->priority);
+            task->vruntime = max(task->vruntime, minVruntime);
+            runnable++;
+            totalWeight += task->weight;
+        }
+        ready.push(RunQueueEntry{task->vruntime, sequence++, task});
+    }
+    
+    Task* pickNext(long long) override {
+        if (ready.empty()) {
+            return nullptr;
+        }
+        Task* task = ready.top().task;
+        ready.pop();
+        minVruntime = max(minVruntime, task->vruntime);
+        return task;
+    }
+    
+    long long timeSlice(const Task& task) const override {
+        long long minSlice = max(1LL, quantum * 3 / 4);
+        long long period = max(quantum * 6, runnable * minSlice);
+        return max(minSlice, period * task.weight / max(1LL, totalWeight));
+    }
+    
+    void charge(Task& task, long long ticks, bool) override {
+        task.vruntime += ticks * 1024 * 1024 / task.weight;
+        // A PRIORITY command while running changes the weight from now on
+        long long weight = weightOf(task.priority);
+        totalWeight += weight - task.weight;
+        task.weight = weight;
+    }
+    
+    void finished(Task& task) override {
+        runnable--;
+        totalWeight -= task.weight;
+    }
+};
+
+unique_ptr<Scheduler> createScheduler(SchedulerType type, int quantum) {
+    switch (type) {
+        case SCHEDULER_FCFS: return unique_ptr<Scheduler>(new FifoScheduler(0));
+        case SCHEDULER_RR: return unique_ptr<Scheduler>(new FifoScheduler(quantum));
+        case SCHEDULER_PRIORITY: return unique_ptr<Scheduler>(new PriorityScheduler(quantum));
+        case SCHEDULER_MLFQ: return unique_ptr<Scheduler>(new MLFQScheduler(quantum));
+        case SCHEDULER_CFS: return unique_ptr<Scheduler>(new CFSScheduler(quantum));
+        default: return nullptr;
+    }
+}
+
+// Totals of a scheduled run, all in ticks except the counts
+struct ScheduleStatistics {
+    long long completed;
+    long long ticks;
+    long long idleTicks;
+    long long turnaround;
+    long long waiting;
+    long long response;
+    long long contextSwitches;
+    long long timerInterrupts;
+};
+
+// Simulated swap device: a disk with one FIFO request queue, and a slot
+// for every page swapped out to it. A request of n pages takes the latency
+// plus n page transfers, and starts once the disk has finished the requests
+// queued before it. Times are in ns of simulated time.
+class SwapDevice {
+private:
+    long long latency;
+    long long transfer;                   // Per page
+    int slotCount;
+    int nextSlot;                         // Slots from here on were never used
+    vector<int> freeSlots;                // Released slots, reused last first
+    map<pair<int, int64_t>, int> slots;   // (pid, page) -> slot
+    deque<long long> inFlight;            // Completion times of queued requests
+    long long freeAt;                     // When the last queued request completes
+    
+public:
+    long long reads, writes;              // Pages
+    long long readRequests, writeRequests;
+    long long busy;                       // Time spent serving requests
+    long long depthTotal;                 // Requests queued ahead of each new one
+    long long maxDepth;
+    int peakSlots;
+    
+    SwapDevice(int slotCount, long long latencyNanos, long long transferNanos)
+        : latency(latencyNanos), transfer(transferNanos), slotCount(slotCount), nextSlot(0), freeAt(0), reads(0),
+          writes(0), readRequests(0), writeRequests(0), busy(0), depthTotal(0), maxDepth(0), peakSlots(0) {}
+    
+    // Queue a request of `pages` pages at `now`; returns when it completes
+    long long submit(long long now, int pages, bool write) {
+        while (!inFlight.empty() && inFlight.front() <= now) {
+            inFlight.pop_front();
+        }
+        depthTotal += inFlight.size();
+        maxDepth = max(maxDepth, (long long)inFlight.size());
+        
+        long long start = max(now, freeAt);
+        freeAt = start + submitCost(pages);
+        busy += freeAt - start;
+        inFlight.push_back(freeAt);
+        if (write) {
+            writes += pages;
+            writeRequests++;
+        } else {
+            reads += pages;
+            readRequests++;
+        }
+        return freeAt;
+    }
+    
+    // Slot for a page being swapped out, the one it had before if any; -1
+    // when the device is full
+    int allocate(int pid, int64_t page) {
+        auto it = slots.find(make_pair(pid, page));
+        if (it != slots.end()) {
+            return it->second;
+        }
+        int slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else if (nextSlot < slotCount) {
+            slot = nextSlot++;
+        } else {
+            return -1;
+        }
+        slots.emplace(make_pair(pid, page), slot);
+        peakSlots = max(peakSlots, used());
+        return slot;
+    }
+    
+    // Free the slots of a terminated process
+    void release(int pid) {
+        auto first = slots.lower_bound(make_pair(pid, INT64_MIN));
+        auto last = slots.upper_bound(make_pair(pid, INT64_MAX));
+        for (auto it = first; it != last; ++it) {
+            freeSlots.push_back(it->second);
+        }
+        slots.erase(first, last);
+    }
+    
+    // Whether the page was written out and can be read back
+    bool holds(int pid, int64_t page) const {
+        return slots.count(make_pair(pid, page)) != 0;
+    }
+    
+    int used() const {
+        return (int)slots.size();
+    }
+    
+    int size() const {
+        return slotCount;
+    }
+    
+    long long requests() const {
+        return readRequests + writeRequests;
+    }
+    
+    // Service time of a request for that many pages
+    long long submitCost(int pages) const {
+        return latency + pages * transfer;
+    }
+    
+    // When every queued request is done
+    long long idleAt() const {
+        return freeAt;
+    }
+    
+    void save(string& out) const {
+        for (long long counter : {(long long)nextSlot, freeAt, reads, writes, readRequests, writeRequests, busy,
+                                  depthTotal, maxDepth, (long long)peakSlots}) {
+            putVarint(out, counter);
+        }
+        putVarint(out, (int64_t)inFlight.size());
+        for (long long done : inFlight) {
+            putVarint(out, done);
+        }
+        putVarint(out, (int64_t)freeSlots.size());
+        for (int slot : freeSlots) {
+            putVarint(out, slot);
+        }
+        putVarint(out, (int64_t)slots.size());
+        for (auto& item : slots) {
+            putVarint(out, item.first.first);
+            putVarint(out, item.first.second);
+            putVarint(out, item.second);
+        }
+    }
+    
+    void restore(CheckpointReader& in) {
+        nextSlot = (int)in.get(0, (int64_t)slotCount + 1);
+        freeAt = in.get(0, LLONG_MAX);
+        for (long long* counter : {&reads, &writes, &readRequests, &writeRequests, &busy, &depthTotal, &maxDepth}) {
+            *counter = in.get(0, LLONG_MAX);
+        }
+        peakSlots = (int)in.get(0, (int64_t)slotCount + 1);
+        inFlight.clear();
+        for (int64_t n = in.get(0, LLONG_MAX); n > 0 && !in.failed; n--) {
+            inFlight.push_back(in.get(0, freeAt + 1));
+        }
+        freeSlots.clear();
+        for (int64_t n = in.get(0, (int64_t)nextSlot + 1); n > 0 && !in.failed; n--) {
+            freeSlots.push_back((int)in.get(0, nextSlot));
+        }
+        slots.clear();
+        for (int64_t n = in.get(0, (int64_t)nextSlot + 1); n > 0 && !in.failed; n--) {
+            int pid = (int)in.get(INT_MIN, (int64_t)INT_MAX + 1);
+            int64_t page = in.get(0, LLONG_MAX);
+            slots[make_pair(pid, page)] = (int)in.get(0, nextSlot);
+        }
+        if (slots.size() + freeSlots.size() != (size_t)nextSlot) {
+            in.failed = true;
+        }
+    }
+};
+
+// Counts of the swap subsystem beyond those of the device itself
+struct SwapStatistics {
+    long long faultNanos;        // Time faulting accesses waited for their page
+    long long diskFaults;        // Faults that read their page from the disk
+    long long rescued;           // Faults on pages still queued for write-back
+    long long lost;              // Dirty pages dropped because the device was full
+    long long prefetched;
+    long long prefetchHits;      // Read ahead and then referenced
+    long long prefetchWasted;    // Read ahead and evicted or freed unreferenced
+    long long prefetchWaitNanos; // Time accesses waited for a read ahead in progress
+};
+
+// Counts of FORK, SHARE and MMAP and the faults they lead to
+struct SharingStatistics {
+    long long forks;
+    long long forkedPages;   // Resident pages a child mapped at its FORK
+    long long shares;        // SHARE commands
+    long long mmaps;         // MMAP commands
+    long long sharedFaults;  // Faults served by mapping a frame already resident
+    long long zeroFills;     // Faults on demand-zero pages, which read nothing
+    long long cowCopies;     // Writes that copied a shared page
+    long long cowReused;     // Writes to a copy-on-write page no longer shared
+};
+
+// Per huge page size
+struct HugePageStatistics {
+    long long faults;      // Faults that mapped a whole huge page
+    long long promotions;  // Resident base pages mapped as one huge page
+    long long migrated;    // Pages moved to a free block to be promoted
+    long long demotions;   // Huge pages split back into base pages
+};
+
+// Memory Management Unit
+class MMU {
+private:
+    // A core with its own TLB. Its thread serves TLB hits under `lock` only;
+    // other cores take `lock` to shoot entries down. Lock order is
+    // memoryLock, then a CPU lock.
+    struct CPU {
+        int id;
+        TLB tlb;
+        long long tlbHits;
+        long long tlbMisses;
+        long long shootdownsReceived;
+        unique_ptr<TLB> baseTLB;  // With huge pages: the same TLB holding base pages only
+        long long baseMisses;     // and its misses
+        vector<int> references;   // Multi-core: TLB hits not yet recorded, frame << 1 | write
+        mutex lock;
+        
+        CPU(int id, int tlbSize, int tlbWays) : id(id), tlb(tlbSize, tlbWays), tlbHits(0), tlbMisses(0),
+                                                shootdownsReceived(0), baseMisses(0) {}
+    };
+    
+    int numFrames;
+    FrameAllocatorType allocatorType;
+    unique_ptr<FrameAllocator> frameAllocator;
+    long long totalPageFaults;    // Including those of terminated processes
+    vector<unique_ptr<CPU>> cpus;
+    CPU* boot;                    // CPU 0, which runs everything on a single core
+    ProcessTable processTable;
+    
+    // Multi-core mode: page tables, frames, the policy and the process table
+    // are shared under memoryLock; the TLBs are per core
+    mutex memoryLock;
+    long long lockAcquired;
+    long long lockContended;
+    long long shootdowns;         // Shootdowns that needed an IPI
+    long long shootdownIPIs;      // Remote TLBs reached
+    long long shootdownNanos;
+    long long shootdownMaxNanos;
+    stringstream output;  // Changed from ofstream& to stringstream
+    
+    // Page replacement
+    vector<FrameInfo> frameTable;         // What each physical frame holds
+    vector<long long> nextUse;            // Future knowledge for OPT
+    unique_ptr<ReplacementPolicy> policy;
+    long long accessClock;                // Index of the current access
+    int pageReplacements;
+    
+    // Address space layout
+    int pageSize;
+    int offsetBits;
+    int pageBits;  // Bits of the virtual page number
+    PageTableType pageTableType;
+    int pageTableLevels;
+    
+    // CPU scheduling, when the trace order is not used
+    unique_ptr<Scheduler> scheduler;
+    ScheduleStatistics schedule;
+    
+    // Logging; the hot path checks these before formatting anything
+    Verbosity verbosity;
+    bool traceAccesses() const { return verbosity == VERBOSITY_FULL; }
+    bool traceEvents() const { return verbosity >= VERBOSITY_EVENTS; }
+    EventStream events;  // Replaces the text log unless the format is text
+    OutputSink sink;     // Set when output is streamed instead of returned
+    
+    // Backing store, with a swap device configured. Times are simulated ns.
+    unique_ptr<SwapDevice> swap;
+    long long simNanos;          // Time taken by the accesses so far
+    long long memoryNanos;       // Per memory access
+    long long walkNanos;         // Added by a TLB miss: one memory access per page table level
+    int writeBackBatch;          // Dirty pages per write-back request, 0 writes each on eviction
+    int prefetchPages;           // Read-ahead window, 0 for none
+    vector<PageKey> writeBack;   // Evicted dirty pages not written yet
+    vector<long long> readyAt;   // Per frame: when the read ahead into it completes
+    vector<char> prefetched;     // Per frame: read ahead and not referenced since
+    SwapStatistics swapStats;
+    
+    // Frames mapped by more than one page table: frame -> the pages mapping
+    // it besides the one in frameTable
+    map<int, vector<PageKey>> sharers;
+    SharingStatistics sharing;
+    
+    // Huge pages, as orders of the base page size, largest first; empty for
+    // base pages only
+    vector<int> hugeOrders;
+    vector<HugePageStatistics> hugeStats;  // Same order
+    long long reachTotal;                  // TLB reach summed over the accesses, in pages
+    
+    // Checkpoints of a run in trace order
+    long long checkpointEvery;  // Commands between checkpoints, 0 for none
+    CheckpointSink checkpointSink;
+    long long resumeAt;         // Commands covered by a restored checkpoint
+    long long stopAt;           // Last command to run, -1 for the whole trace
+    
+    // Hand the output logged so far to the sink once a full piece is pending
+    void flushOutput(bool force) {
+        size_t pending = events.enabled() ? events.size() : (size_t)output.tellp();
+        if (pending == 0 || (!force && pending < FLUSH_BYTES)) {
+            return;
+        }
+        if (events.enabled()) {
+            sink(events.take());
+        } else {
+            sink(output.str());
+            output.str("");
+        }
+    }
+    
+    void setupSwap(const MMUConfig& config) {
+        simNanos = 0;
+        swapStats = SwapStatistics();
+        if (config.swapSlots == 0) {
+            return;
+        }
+        long long transfer = (long long)config.pageSize * 1000 / config.diskBandwidth;
+        swap.reset(new SwapDevice(config.swapSlots, config.diskLatency * 1000LL, transfer));
+        memoryNanos = config.memoryNanos;
+        walkNanos = memoryNanos * (pageTableType == PAGE_TABLE_HASHED ? 1 : pageTableLevels);
+        writeBackBatch = config.writeBackBatch;
+        prefetchPages = config.prefetch;
+        readyAt.assign(numFrames, 0);
+        prefetched.assign(numFrames, 0);
+    }
+    
+    void setupHugePages(const MMUConfig& config) {
+        hugeOrders.clear();
+        for (long long bytes : config.hugePages) {
+            hugeOrders.push_back(log2Exact(bytes) - offsetBits);
+        }
+        sort(hugeOrders.rbegin(), hugeOrders.rend());
+        hugeOrders.erase(unique(hugeOrders.begin(), hugeOrders.end()), hugeOrders.end());
+        hugeStats.assign(hugeOrders.size(), HugePageStatistics());
+        reachTotal = 0;
+        if (hugeOrders.empty()) {
+            return;
+        }
+        for (auto& cpu : cpus) {
+            cpu->tlb.setHugeOrders(hugeOrders);
+            cpu->baseTLB.reset(new TLB(config.tlbSize, config.tlbWays));
+        }
+    }
+    
+public:
+    // New constructor for API output
+    explicit MMU(const MMUConfig& config = MMUConfig())
+        : numFrames(config.frames), allocatorType(config.allocator),
+          frameAllocator(createFrameAllocator(config.allocator, config.frames)), totalPageFaults(0),
+          lockAcquired(0), lockContended(0), shootdowns(0), shootdownIPIs(0), shootdownNanos(0), shootdownMaxNanos(0),
+          accessClock(-1), pageReplacements(0), pageSize(config.pageSize),
+          offsetBits(log2Exact(config.pageSize)), pageBits(config.pageNumberBits()),
+          pageTableType(config.pageTableType), pageTableLevels(config.pageTableLevels),
+          verbosity(config.cpus > 1 ? VERBOSITY_SUMMARY : config.verbosity), events(config.format),
+          checkpointEvery(0), resumeAt(0), stopAt(-1) {
+        frameTable.resize(numFrames);
+        policy = createPolicy(config.policy, frameTable, nextUse);
+        scheduler = createScheduler(config.scheduler, config.quantum);
+        schedule = ScheduleStatistics();
+        sharing = SharingStatistics();
+        for (int i = 0; i < config.cpus; i++) {
+            cpus.emplace_back(new CPU(i, config.tlbSize, config.tlbWays));
+        }
+        boot = cpus[0].get();
+        setupSwap(config);
+        setupHugePages(config);
+    }
+    
+    // Original constructor for file output
+    MMU(ofstream&, const MMUConfig& config = MMUConfig()) : MMU(config) {}
+    
+    // Stream output to sink as the run goes; execute* then return ""
+    void setOutputSink(OutputSink outputSink) {
+        sink = move(outputSink);
+    }
+    
+    // Hand a checkpoint to checkpointSink every `every` commands. Only runs
+    // in trace order on one CPU take checkpoints.
+    void setCheckpoints(long long every, CheckpointSink sink) {
+        checkpointEvery = every;
+        checkpointSink = move(sink);
+    }
+    
+    // End the run after that many commands of the trace
+    void setStopAt(long long commands) {
+        stopAt = commands;
+    }
+    
+    // Execute commands from string input (a script, or a binary trace)
+    string executeCommands(const string& inputContent) {
+        return executeInput(inputContent.data(), inputContent.size());
+    }
+    
+    string executeInput(const char* data, size_t size) {
+        if (cpus.size() > 1) {
+            return executeParallel(data, size);
+        }
+        if (scheduler) {
+            return executeScheduled(data, size);
+        }
+        if (isBinaryTrace(data, size)) {
+            return executeTrace(data, size);
+        }
+        return executeScript(data, size);
+    }
+    
+    // Execute a text script in one pass over the buffer
+    string executeScript(const char* data, size_t size) {
+        beginRun();
+        
+        TraceRecord rec;
+        string_view line, command;
+        
+        if (dynamic_cast<OptimalPolicy*>(policy.get())) {
+            vector<PageKey> keys;
+            ScriptTokenizer scan(data, size);
+            while (scan.next(rec, line, command)) {
+                if (rec.op == CMD_ACCESS || rec.op == CMD_WRITE) {
+                    keys.push_back(PageKey{rec.pid, pageOf(rec.arg)});
+                }
+            }
+            computeNextUse(keys);
+        }
+        
+        ScriptTokenizer tokens(data, size);
+        long long commands = 0;
+        while (tokens.next(rec, line, command)) {
+            if (++commands <= resumeAt) {
+                continue;
+            }
+            bool echo = traceAccesses() && !events.enabled();
+            if (echo) {
+                output << "Command [" << tokens.lineNumber() << "]: " << line << "\n";
+            }
+            
+            if (rec.op != CMD_UNKNOWN) {
+                runCommand(rec);
+            } else if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {0, 0}, "Unknown command: " + string(command));
+                } else {
+                    output << "Unknown command: " << command << "\n";
+                }
+            }
+            
+            if (echo) {
+                output << "\n";
+            }
+            if (sink) {
+                flushOutput(false);
+            }
+            if (!commandDone(commands)) {
+                break;
+            }
+        }
+        
+        return finishRun();
+    }
+    
+    // Execute a binary trace, typically straight out of a memory mapping
+    string executeTrace(const char* data, size_t size) {
+        beginRun();
+        
+        TraceRecord rec;
+        if (dynamic_cast<OptimalPolicy*>(policy.get())) {
+            vector<PageKey> keys;
+            BinaryTraceReader scan(data, size);
+            while (scan.next(rec)) {
+                if (rec.op == CMD_ACCESS || rec.op == CMD_WRITE) {
+                    keys.push_back(PageKey{rec.pid, pageOf(rec.arg)});
+                }
+            }
+            computeNextUse(keys);
+        }
+        
+        BinaryTraceReader reader(data, size);
+        long long recordNum = 0;
+        while (reader.next(rec)) {
+            if (++recordNum <= resumeAt) {
+                continue;
+            }
+            bool echo = traceAccesses() && !events.enabled();
+            if (echo) {
+                output << "Command [" << recordNum << "]: ";
+                writeCommandText(rec);
+                output << "\n";
+            }
+            runCommand(rec);
+            if (echo) {
+                output << "\n";
+            }
+            if (sink) {
+                flushOutput(false);
+            }
+            if (!commandDone(recordNum)) {
+                break;
+            }
+        }
+        
+        return finishRun();
+    }
+    
+    // After each command of a run in trace order: takes the checkpoint if
+    // one is due; false once the run should stop
+    bool commandDone(long long commands) {
+        if (checkpointEvery > 0 && commands % checkpointEvery == 0) {
+            string checkpoint = saveCheckpoint(commands);
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_CHECKPOINT, {commands, (long long)checkpoint.size()});
+                } else {
+                    output << "Checkpoint at command " << commands << " (" << checkpoint.size() << " bytes)\n";
+                }
+            }
+            checkpointSink(commands, checkpoint);
+        }
+        return commands != stopAt;
+    }
+    
+    // What a checkpoint must be restored under, as text
+    string checkpointLayout() const {
+        return to_string(numFrames) + " frames of " + to_string(pageSize) + " bytes, " + to_string(1LL << pageBits) +
+               " pages per process, " + describePageTable() + ", TLB of " + to_string(boot->tlb.size()) + " entries " +
+               describeAssociativity() + ", " + policy->name() + (swap ? ", swap of " + describeSwap() : "") +
+               (hugeOrders.empty() ? "" : ", huge pages of " + describeHugePages()) +
+               (allocatorType == ALLOCATOR_BUDDY ? "" : string(", ") + frameAllocator->name() + " allocator");
+    }
+    
+    // Snapshot of the whole MMU after `commands` commands, see CHECKPOINT_VERSION
+    string saveCheckpoint(long long commands) {
+        string out("P2CK", 4);
+        uint32_t version = CHECKPOINT_VERSION;
+        out.append((const char*)&version, sizeof(version));
+        putVarint(out, commands);
+        string layout = checkpointLayout();
+        putVarint(out, (int64_t)layout.size());
+        out += layout;
+        for (long long counter : {accessClock, totalPageFaults, (long long)pageReplacements, boot->tlbHits,
+                                  boot->tlbMisses}) {
+            putVarint(out, counter);
+        }
+        
+        frameAllocator->save(out);
+        
+        vector<PCB*> live = processTable.sorted();
+        putVarint(out, (int64_t)live.size());
+        for (PCB* pcb : live) {
+            for (int64_t field : {(int64_t)pcb->pid, (int64_t)pcb->state, (int64_t)pcb->programCounter,
+                                  (int64_t)pcb->priority, pcb->allocatedPages, (int64_t)pcb->pageFaults,
+                                  (int64_t)pcb->cpuMask}) {
+                putVarint(out, field);
+            }
+            putVarint(out, pcb->shared);
+            putVarint(out, (int64_t)pcb->ranges.size());
+            for (const MappedRange& range : pcb->ranges) {
+                putVarint(out, range.start);
+                putVarint(out, range.pages);
+                putVarint(out, range.source);
+            }
+            pcb->pageTable->saveShape(out);
+            vector<pair<int64_t, PageTableEntry>> valid;
+            pcb->pageTable->forEachValid([&valid](int64_t page, PageTableEntry& entry) {
+                valid.push_back(make_pair(page, entry));
+            });
+            putVarint(out, (int64_t)valid.size());
+            for (auto& item : valid) {
+                putVarint(out, item.first);
+                putVarint(out, item.second.frameNumber);
+                putVarint(out, (item.second.referenced ? 1 : 0) | (item.second.dirty ? 2 : 0) |
+                                   (item.second.copyOnWrite ? 4 : 0) | item.second.order << 3);
+            }
+        }
+        
+        // Which page of a shared frame holds its bits, and the others in order
+        putVarint(out, (int64_t)sharers.size());
+        for (auto& item : sharers) {
+            putVarint(out, item.first);
+            putVarint(out, frameTable[item.first].pid);
+            putVarint(out, frameTable[item.first].pageNumber);
+            putVarint(out, (int64_t)item.second.size());
+            for (const PageKey& key : item.second) {
+                putVarint(out, key.pid);
+                putVarint(out, key.page);
+            }
+        }
+        for (long long counter : {sharing.forks, sharing.forkedPages, sharing.shares, sharing.mmaps,
+                                  sharing.sharedFaults, sharing.zeroFills, sharing.cowCopies, sharing.cowReused}) {
+            putVarint(out, counter);
+        }
+        
+        boot->tlb.save(out);
+        policy->save(out);
+        if (swap) {
+            saveSwap(out, live);
+        }
+        if (!hugeOrders.empty()) {
+            putVarint(out, reachTotal);
+            putVarint(out, boot->baseMisses);
+            for (const HugePageStatistics& counts : hugeStats) {
+                for (long long counter : {counts.faults, counts.promotions, counts.migrated, counts.demotions}) {
+                    putVarint(out, counter);
+                }
+            }
+            boot->baseTLB->save(out);
+        }
+        return out;
+    }
+    
+    // The swap device, write-back queue, read-ahead state and their counts
+    void saveSwap(string& out, const vector<PCB*>& live) {
+        putVarint(out, simNanos);
+        for (long long counter : {swapStats.faultNanos, swapStats.diskFaults, swapStats.rescued, swapStats.lost,
+                                  swapStats.prefetched, swapStats.prefetchHits, swapStats.prefetchWasted,
+                                  swapStats.prefetchWaitNanos}) {
+            putVarint(out, counter);
+        }
+        swap->save(out);
+        putVarint(out, (int64_t)writeBack.size());
+        for (const PageKey& key : writeBack) {
+            putVarint(out, key.pid);
+            putVarint(out, key.page);
+        }
+        vector<int> reading;
+        for (int f = 0; f < numFrames; f++) {
+            if (readyAt[f] > 0 || prefetched[f]) {
+                reading.push_back(f);
+            }
+        }
+        putVarint(out, (int64_t)reading.size());
+        for (int f : reading) {
+            putVarint(out, f);
+            putVarint(out, readyAt[f]);
+            putVarint(out, prefetched[f]);
+        }
+        for (PCB* pcb : live) {
+            putVarint(out, pcb->lastFault);
+            putVarint(out, pcb->faultStride);
+        }
+    }
+    
+    void restoreSwap(CheckpointReader& in) {
+        simNanos = in.get(0, LLONG_MAX);
+        for (long long* counter : {&swapStats.faultNanos, &swapStats.diskFaults, &swapStats.rescued, &swapStats.lost,
+                                   &swapStats.prefetched, &swapStats.prefetchHits, &swapStats.prefetchWasted,
+                                   &swapStats.prefetchWaitNanos}) {
+            *counter = in.get(0, LLONG_MAX);
+        }
+        swap->restore(in);
+        for (int64_t n = in.get(0, INT_MAX); n > 0 && !in.failed; n--) {
+            int pid = (int)in.get(INT_MIN, (int64_t)INT_MAX + 1);
+            writeBack.push_back(PageKey{pid, in.get(0, LLONG_MAX)});
+        }
+        for (int64_t n = in.get(0, (int64_t)numFrames + 1); n > 0 && !in.failed; n--) {
+            int frame = (int)in.get(0, numFrames);
+            readyAt[frame] = in.get(0, LLONG_MAX);
+            prefetched[frame] = (char)in.get(0, 2);
+        }
+        for (PCB* pcb : processTable.sorted()) {
+            pcb->lastFault = in.get(-1, LLONG_MAX);
+            pcb->faultStride = in.get(LLONG_MIN, LLONG_MAX);
+        }
+    }
+    
+    // Load a checkpoint into this fresh MMU, built with the configuration the
+    // checkpoint was taken under. The next run skips the commands it covers.
+    // Returns what is wrong with it, empty on success; after an error the
+    // MMU is not usable.
+    string restoreCheckpoint(const char* data, size_t size) {
+        if (cpus.size() > 1 || scheduler) {
+            return "Checkpoints need a single CPU running the trace order";
+        }
+        uint32_t version = 0;
+        if (size < 8 || memcmp(data, "P2CK", 4) != 0) {
+            return "Not a checkpoint";
+        }
+        memcpy(&version, data + 4, sizeof(version));
+        if (version != CHECKPOINT_VERSION) {
+            return "Unsupported checkpoint version " + to_string(version);
+        }
+        
+        CheckpointReader in(data + 8, size - 8);
+        long long commands = in.get(0, LLONG_MAX);
+        string layout = in.getString();
+        if (!in.failed && layout != checkpointLayout()) {
+            return "Checkpoint was taken with another configuration: " + layout;
+        }
+        accessClock = in.get(-1, LLONG_MAX);
+        totalPageFaults = in.get(0, LLONG_MAX);
+        pageReplacements = (int)in.get(0, INT_MAX);
+        boot->tlbHits = in.get(0, LLONG_MAX);
+        boot->tlbMisses = in.get(0, LLONG_MAX);
+        
+        vector<bool> used(numFrames, true);  // Frames not in a free block
+        frameAllocator->restore(in, [&used, &in](int first, int frames) {
+            for (int frame = first; frame < first + frames; frame++) {
+                if (!used[frame]) {
+                    in.failed = true;
+                }
+                used[frame] = false;
+            }
+        });
+        
+        int frame;
+        int64_t maxPages = (int64_t)1 << pageBits;
+        vector<int> mappings(numFrames, 0);  // Valid entries per frame
+        for (int64_t n = in.get(0, INT_MAX); n > 0 && !in.failed; n--) {
+            int pid = (int)in.get(INT_MIN, (int64_t)INT_MAX + 1);
+            if (processTable.find(pid) != nullptr) {
+                in.failed = true;
+                break;
+            }
+            PCB* pcb = processTable.insert(pid, 0);
+            pcb->state = (ProcessState)in.get(NEW, TERMINATED + 1);
+            pcb->programCounter = (int)in.get(INT_MIN, (int64_t)INT_MAX + 1);
+            pcb->priority = (int)in.get(INT_MIN, (int64_t)INT_MAX + 1);
+            pcb->allocatedPages = in.get(0, maxPages + 1);
+            pcb->pageFaults = (int)in.get(0, INT_MAX);
+            pcb->cpuMask = (uint64_t)in.get(0, 2);
+            pcb->shared = in.get(0, 2) != 0;
+            for (int64_t ranges = in.get(0, maxPages + 1); ranges > 0 && !in.failed; ranges--) {
+                int64_t start = in.get(0, maxPages);
+                int64_t pages = in.get(1, maxPages - start + 1);
+                pcb->ranges.push_back(MappedRange{start, pages, (int)in.get(-1, (int64_t)INT_MAX + 1)});
+            }
+            pcb->pageTable.reset(newPageTable());
+            pcb->pageTable->restoreShape(in);
+            for (int64_t entries = in.get(0, maxPages + 1); entries > 0 && !in.failed; entries--) {
+                int64_t page = in.get(0, maxPages);
+                frame = (int)in.get(0, numFrames);
+                int flags = (int)in.get(0, 8 << 5);
+                int order = flags >> 3;
+                if (in.failed || !used[frame] ||
+                    (order > 0 && find(hugeOrders.begin(), hugeOrders.end(), order) == hugeOrders.end())) {
+                    in.failed = true;
+                    break;
+                }
+                PageTableEntry* entry = pcb->pageTable->entry(page);
+                entry->frameNumber = frame;
+                entry->valid = true;
+                entry->referenced = (flags & 1) != 0;
+                entry->dirty = (flags & 2) != 0;
+                entry->copyOnWrite = (flags & 4) != 0;
+                entry->order = order;
+                countResident(pcb, page, 1);
+                if (mappings[frame]++ == 0) {
+                    frameTable[frame].pid = pid;
+                    frameTable[frame].pageNumber = page;
+                    frameTable[frame].entry = entry;
+                }
+            }
+        }
+        for (PCB* pcb : processTable.sorted()) {
+            for (const MappedRange& range : pcb->ranges) {
+                if (range.source >= 0 && processTable.find(range.source) == nullptr) {
+                    in.failed = true;
+                }
+            }
+        }
+        
+        // Every page of a frame mapped more than once must be listed
+        auto mapsFrame = [this](int pid, int64_t page, int frame) -> PageTableEntry* {
+            PCB* pcb = processTable.find(pid);
+            PageTableEntry* entry = pcb ? pcb->pageTable->find(page) : nullptr;
+            return (entry != nullptr && entry->valid && entry->frameNumber == frame) ? entry : nullptr;
+        };
+        for (int64_t n = in.get(0, numFrames + 1); n > 0 && !in.failed; n--) {
+            frame = (int)in.get(0, numFrames);
+            int pid = (int)in.get(INT_MIN, (int64_t)INT_MAX + 1);
+            int64_t page = in.get(0, maxPages);
+            PageTableEntry* entry = mapsFrame(pid, page, frame);
+            int count = (int)in.get(1, mappings[frame]);
+            if (in.failed || entry == nullptr || sharers.count(frame) || count != mappings[frame] - 1) {
+                in.failed = true;
+                break;
+            }
+            frameTable[frame].pid = pid;
+            frameTable[frame].pageNumber = page;
+            frameTable[frame].entry = entry;
+            frameTable[frame].shares = count;
+            vector<PageKey>& others = sharers[frame];
+            for (int i = 0; i < count && !in.failed; i++) {
+                PageKey key{(int)in.get(INT_MIN, (int64_t)INT_MAX + 1), in.get(0, maxPages)};
+                if (mapsFrame(key.pid, key.page, frame) == nullptr) {
+                    in.failed = true;
+                }
+                others.push_back(key);
+            }
+        }
+        for (int f = 0; f < numFrames && !in.failed; f++) {
+            if (mappings[f] > 1 + frameTable[f].shares) {
+                in.failed = true;
+            }
+        }
+        for (long long* counter : {&sharing.forks, &sharing.forkedPages, &sharing.shares, &sharing.mmaps,
+                                   &sharing.sharedFaults, &sharing.zeroFills, &sharing.cowCopies,
+                                   &sharing.cowReused}) {
+            *counter = in.get(0, LLONG_MAX);
+        }
+        
+        boot->tlb.restore(in, numFrames);
+        policy->restore(in);
+        if (swap) {
+            restoreSwap(in);
+        }
+        if (!hugeOrders.empty()) {
+            reachTotal = in.get(0, LLONG_MAX);
+            boot->baseMisses = in.get(0, LLONG_MAX);
+            for (HugePageStatistics& counts : hugeStats) {
+                for (long long* counter : {&counts.faults, &counts.promotions, &counts.migrated, &counts.demotions}) {
+                    *counter = in.get(0, LLONG_MAX);
+                }
+            }
+            boot->baseTLB->restore(in, numFrames);
+        }
+        if (in.failed || !in.atEnd()) {
+            return "Corrupt checkpoint";
+        }
+        resumeAt = commands;
+        return "";
+    }
+    
+    // Multi-core run: process `pid` is pinned to CPU pid mod N, and every CPU
+    // replays the commands of its processes in trace order on its own
+    // thread. Only the summary is logged, as per-access logs of concurrent
+    // cores have no single order. STATS and MEMMAP are ignored for the same
+    // reason, and PRIORITY, which only a scheduler reads. FORK, SHARE and
+    // MMAP are not run either; each one is reported as an error.
+    string executeParallel(const char* data, size_t size) {
+        beginRun();
+        runParallel(decodeTrace(data, size));
+        return finishRun();
+    }
+    
+    void runParallel(const vector<TraceRecord>& records) {
+        vector<vector<TraceRecord>> slices(cpus.size());
+        int n = (int)cpus.size();
+        for (const TraceRecord& rec : records) {
+            if (rec.op == CMD_CREATE || rec.op == CMD_ACCESS || rec.op == CMD_WRITE || rec.op == CMD_TERMINATE) {
+                slices[((rec.pid % n) + n) % n].push_back(rec);
+            } else if (rec.op == CMD_FORK || rec.op == CMD_SHARE || rec.op == CMD_MMAP) {
+                if (events.enabled()) {
+                    const char* command = rec.op == CMD_FORK ? "FORK" : rec.op == CMD_SHARE ? "SHARE" : "MMAP";
+                    events.emit(EV_ERROR, {rec.pid, rec.arg}, string(command) + " is not supported on several CPUs");
+                } else {
+                    output << "Error: ";
+                    writeCommandText(rec);
+                    output << " is not supported on several CPUs\n";
+                }
+            }
+        }
+        
+        vector<thread> threads;
+        for (size_t i = 0; i < cpus.size(); i++) {
+            threads.emplace_back([this, i, &slices]() {
+                runSlice(*cpus[i], slices[i]);
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        for (auto& cpu : cpus) {
+            flushReferences(*cpu);
+        }
+    }
+    
+    // Run decoded records for their totals alone, at summary verbosity
+    RunStatistics replay(const vector<TraceRecord>& records) {
+        if (cpus.size() > 1) {
+            runParallel(records);
+            return statistics();
+        }
+        if (scheduler) {
+            runSchedule(records);
+            if (swap) {
+                flushWriteBack();
+            }
+            return statistics();
+        }
+        
+        if (dynamic_cast<OptimalPolicy*>(policy.get())) {
+            vector<PageKey> keys;
+            for (const TraceRecord& rec : records) {
+                if (rec.op == CMD_ACCESS || rec.op == CMD_WRITE) {
+                    keys.push_back(PageKey{rec.pid, pageOf(rec.arg)});
+                }
+            }
+            computeNextUse(keys);
+        }
+        
+        for (const TraceRecord& rec : records) {
+            if (rec.op != CMD_STATS && rec.op != CMD_MEMMAP) {
+                runCommand(rec);
+            }
+        }
+        if (swap) {
+            flushWriteBack();
+        }
+        return statistics();
+    }
+    
+    // Scheduled run: the scheduler decides which process runs, instead of
+    // the interleaving written in the trace
+    string executeScheduled(const char* data, size_t size) {
+        beginRun();
+        runSchedule(decodeTrace(data, size));
+        return finishRun();
+    }
+    
+    // Every process arrives at the tick of its CREATE, or of the FORK that
+    // creates it, counting one tick per ACCESS/WRITE of the trace, and from
+    // then on runs its own records one at a time when dispatched. Records of
+    // processes that do not exist at that point are dropped, as are STATS
+    // and MEMMAP. A pid created again after TERMINATE is a new task, held
+    // back until the earlier one is done.
+    void runSchedule(const vector<TraceRecord>& records) {
+        vector<Task> tasks;
+        vector<long long> nextRecord(records.size(), -1);
+        vector<long long> lastRecord;   // Per task, where its chain ends so far
+        vector<long long> predecessor;  // Per task, the earlier task of its pid
+        unordered_map<int, size_t> live, latest;
+        long long traceTick = 0;
+        for (size_t i = 0; i < records.size(); i++) {
+            const TraceRecord& rec = records[i];
+            int pid = (rec.op == CMD_FORK) ? (int)rec.arg : rec.pid;
+            auto it = live.find(pid);
+            if ((rec.op == CMD_CREATE || rec.op == CMD_FORK) && it == live.end()) {
+                auto previous = latest.find(pid);
+                predecessor.push_back(-1);
+                if (previous != latest.end()) {
+                    tasks[previous->second].successor = tasks.size();
+                    predecessor.back() = previous->second;
+                }
+                live[pid] = latest[pid] = tasks.size();
+                tasks.push_back(Task(pid, traceTick, i));
+                lastRecord.push_back(i);
+                continue;
+            }
+            bool access = (rec.op == CMD_ACCESS || rec.op == CMD_WRITE);
+            traceTick += access;
+            if (it == live.end() || rec.op == CMD_STATS || rec.op == CMD_MEMMAP) {
+                continue;
+            }
+            nextRecord[lastRecord[it->second]] = i;
+            lastRecord[it->second] = i;
+            tasks[it->second].burst += access;
+            if (rec.op == CMD_TERMINATE) {
+                live.erase(it);
+            }
+        }
+        
+        schedule = ScheduleStatistics();
+        long long now = 0;
+        size_t arrived = 0;
+        size_t done = 0;
+        Task* running = nullptr;
+        Task* previous = nullptr;  // Last task to have the CPU
+        Task* expired = nullptr;   // Queued again behind this tick's arrivals
+        long long slice = 0, ran = 0;
+        
+        // Runs the task's CREATE or FORK and any PRIORITY right after it, then
+        // queues it; true if the task had nothing else to do
+        auto admit = [&](Task& task) {
+            runCommand(records[task.cursor]);
+            task.cursor = nextRecord[task.cursor];
+            while (task.cursor != -1 && records[task.cursor].op == CMD_PRIORITY) {
+                runCommand(records[task.cursor]);
+                task.priority = (int)records[task.cursor].arg;
+                task.cursor = nextRecord[task.cursor];
+            }
+            if (task.cursor == -1) {
+                task.firstRun = task.finish = now;
+                schedule.completed++;
+                schedule.turnaround += now - task.arrival;
+                schedule.waiting += now - task.arrival;
+                schedule.response += now - task.arrival;
+                done++;
+                return true;
+            }
+            scheduler->enqueue(&task, true, now);
+            return false;
+        };
+        
+        while (done < tasks.size()) {
+            // Arrivals, which may take the CPU from the running task
+            while (arrived < tasks.size() && tasks[arrived].arrival <= now) {
+                Task& task = tasks[arrived++];
+                task.held = (predecessor[arrived - 1] != -1 && tasks[predecessor[arrived - 1]].finish < 0);
+                if (!task.held && !admit(task) && running != nullptr && scheduler->preempts(task, *running)) {
+                    scheduler->charge(*running, ran, false);
+                    scheduler->enqueue(running, false, now);
+                    setState(running->pid, READY);
+                    running = nullptr;
+                }
+            }
+            if (expired != nullptr) {
+                scheduler->enqueue(expired, false, now);
+                expired = nullptr;
+            }
+            
+            if (running == nullptr) {
+                running = scheduler->pickNext(now);
+                if (running == nullptr) {
+                    if (arrived == tasks.size()) {
+                        break;  // Only held tasks left, which cannot happen
+                    }
+                    schedule.idleTicks += tasks[arrived].arrival - now;
+                    now = tasks[arrived].arrival;
+                    continue;
+                }
+                if (running != previous) {
+                    schedule.contextSwitches++;
+                    if (traceEvents()) {
+                        if (events.enabled()) {
+                            events.emit(EV_DISPATCH, {running->pid, now});
+                        } else {
+                            output << "Dispatching process " << running->pid << " at tick " << now << "\n";
+                        }
+                    }
+                }
+                previous = running;
+                if (running->firstRun < 0) {
+                    running->firstRun = now;
+                }
+                slice = scheduler->timeSlice(*running);
+                ran = 0;
+                setState(running->pid, RUNNING);
+            }
+            
+            // One record of the running task
+            const TraceRecord& rec = records[running->cursor];
+            running->cursor = nextRecord[running->cursor];
+            bool echo = traceAccesses() && !events.enabled();
+            if (echo) {
+                output << "Tick [" << now << "]: ";
+                writeCommandText(rec);
+                output << "\n";
+            }
+            runCommand(rec);
+            if (echo) {
+                output << "\n";
+            }
+            if (rec.op == CMD_ACCESS || rec.op == CMD_WRITE) {
+                now++;
+                ran++;
+            } else if (rec.op == CMD_PRIORITY) {
+                running->priority = (int)rec.arg;
+            }
+            if (sink) {
+                flushOutput(false);
+            }
+            
+            if (running->cursor == -1) {
+                Task& task = *running;
+                task.finish = now;
+                scheduler->charge(task, ran, false);
+                scheduler->finished(task);
+                if (rec.op != CMD_TERMINATE) {
+                    setState(task.pid, READY);  // Out of work, but still resident
+                }
+                schedule.completed++;
+                schedule.turnaround += now - task.arrival;
+                schedule.waiting += now - task.arrival - task.burst;
+                schedule.response += task.firstRun - task.arrival;
+                done++;
+                running = nullptr;
+                if (task.successor != -1 && tasks[task.successor].held) {
+                    tasks[task.successor].held = false;
+                    admit(tasks[task.successor]);
+                }
+            } else if (slice > 0 && ran >= slice) {
+                schedule.timerInterrupts++;
+                handleInterrupt(TIMER_INTERRUPT, running->pid, now);
+                scheduler->charge(*running, ran, true);
+                setState(running->pid, READY);
+                expired = running;
+                running = nullptr;
+            }
+        }
+        schedule.ticks = now;
+    }
+    
+    void setState(int pid, ProcessState state) {
+        PCB* pcb = processTable.find(pid);
+        if (pcb != nullptr && pcb->state != TERMINATED) {
+            pcb->state = state;
+        }
+    }
+    
+    // PRIORITY command
+    void setPriority(int pid, int priority) {
+        PCB* pcb = processTable.find(pid);
+        if (pcb == nullptr) {
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {pid, priority}, "Process not found");
+                } else {
+                    output << "Error: Process " << pid << " not found\n";
+                }
+            }
+            return;
+        }
+        pcb->priority = priority;
+    }
+    
+    RunStatistics statistics() const {
+        RunStatistics totals = {accessClock + 1, 0, 0, totalPageFaults, pageReplacements, simNanos, 0, 0};
+        for (auto& cpu : cpus) {
+            totals.tlbHits += cpu->tlbHits;
+            totals.tlbMisses += cpu->tlbMisses;
+        }
+        if (swap) {
+            totals.diskReads = swap->reads;
+            totals.diskWrites = swap->writes;
+        }
+        return totals;
+    }
+    
+    void runSlice(CPU& cpu, const vector<TraceRecord>& slice) {
+        for (const TraceRecord& rec : slice) {
+            if (rec.op == CMD_ACCESS || rec.op == CMD_WRITE) {
+                translate<true>(cpu, rec.pid, rec.arg, rec.op == CMD_WRITE);
+                continue;
+            }
+            unique_lock<mutex> memory = lockMemory(true);
+            {
+                lock_guard<mutex> guard(cpu.lock);
+                flushReferences(cpu);
+            }
+            if (rec.op == CMD_CREATE) {
+                createProcess(rec.pid, rec.arg);
+            } else {
+                terminateProcess(cpu, rec.pid);
+            }
+        }
+    }
+    
+    // Takes memoryLock when several cores share the MMU
+    unique_lock<mutex> lockMemory(bool shared) {
+        unique_lock<mutex> guard(memoryLock, defer_lock);
+        if (shared) {
+            bool contended = !guard.try_lock();
+            if (contended) {
+                guard.lock();
+            }
+            lockAcquired++;
+            lockContended += contended;
+        }
+        return guard;
+    }
+    
+    void beginRun() {
+        output.str(""); // Clear previous output
+        output.clear();
+        events.clear();
+        if (events.enabled()) {
+            if (resumeAt > 0) {
+                events.emit(EV_RESUME, {resumeAt});
+            }
+            return;
+        }
+        
+        output << "=== OS SIMULATOR - PHASE 2 ===\n";
+        output << "Page Size: " << pageSize << " bytes\n";
+        output << "Physical Memory: " << numFrames << " frames, " << frameAllocator->name() << " allocator\n";
+        output << "Virtual Memory: " << (1LL << pageBits) << " pages per process\n";
+        output << "Page Table: " << describePageTable() << "\n";
+        if (cpus.size() > 1) {
+            output << "CPUs: " << cpus.size() << ", processes pinned by pid, summary only\n";
+        }
+        output << "TLB: " << boot->tlb.size() << " entries" << (cpus.size() > 1 ? " per CPU" : "") << ", "
+               << describeAssociativity() << "\n";
+        if (!hugeOrders.empty()) {
+            output << "Huge Pages: " << describeHugePages() << "\n";
+        }
+        output << "Page Replacement: " << policy->name() << "\n";
+        if (scheduler) {
+            output << "Scheduler: " << scheduler->name() << ", one tick per access\n";
+        }
+        if (swap) {
+            output << "Swap: " << describeSwap() << "\n";
+        }
+        if (resumeAt > 0) {
+            output << "Resumed from checkpoint at command " << resumeAt << "\n";
+        }
+        output << "\n";
+    }
+    
+    string finishRun() {
+        if (swap) {
+            flushWriteBack();
+        }
+        if (events.enabled()) {
+            events.emit(EV_FINAL);
+        } else {
+            output << "\n=== FINAL STATISTICS ===\n";
+        }
+        printStatistics();
+        printMemoryMap();
+        
+        if (sink) {
+            flushOutput(true);
+            return "";
+        }
+        return events.enabled() ? events.take() : output.str();
+    }
+    
+    void runCommand(const TraceRecord& rec) {
+        switch (rec.op) {
+            case CMD_CREATE:
+                createProcess(rec.pid, rec.arg);
+                break;
+                
+            case CMD_ACCESS:
+            case CMD_WRITE: {
+                bool write = (rec.op == CMD_WRITE);
+                if (traceAccesses()) {
+                    if (events.enabled()) {
+                        events.emit(EV_ACCESS, {rec.pid, rec.arg, write});
+                    } else {
+                        output << (write ? "Writing to" : "Accessing") << " virtual address " << rec.arg
+                               << " of process " << rec.pid << "\n";
+                    }
+                }
+                int64_t physAddr = translateAddress(rec.pid, rec.arg, write);
+                if (physAddr != -1 && traceAccesses()) {
+                    if (events.enabled()) {
+                        events.emit(EV_TRANSLATION, {rec.pid, rec.arg, physAddr});
+                    } else {
+                        output << "Physical address: " << physAddr << "\n";
+                    }
+                }
+                break;
+            }
+                
+            case CMD_TERMINATE:
+                terminateProcess(rec.pid);
+                break;
+                
+            case CMD_STATS:
+                if (traceEvents()) {
+                    printStatistics();
+                }
+                break;
+                
+            case CMD_MEMMAP:
+                if (traceEvents()) {
+                    printMemoryMap();
+                }
+                break;
+                
+            case CMD_PRIORITY:
+                setPriority(rec.pid, (int)rec.arg);
+                break;
+                
+            case CMD_FORK:
+                forkProcess(rec.pid, (int)rec.arg);
+                break;
+                
+            case CMD_SHARE:
+                shareProcess(rec.pid, (int)rec.arg);
+                break;
+                
+            case CMD_MMAP:
+                mapZeroPages(rec.pid, rec.arg);
+                break;
+                
+            default:
+                if (traceEvents()) {
+                    if (events.enabled()) {
+                        events.emit(EV_ERROR, {rec.pid, rec.arg}, "Unknown command: #" + to_string(rec.op));
+                    } else {
+                        output << "Unknown command: #" << (int)rec.op << "\n";
+                    }
+                }
+                break;
+        }
+    }
+    
+    // Script form of a record, used to echo binary trace commands
+    void writeCommandText(const TraceRecord& rec) {
+        switch (rec.op) {
+            case CMD_CREATE: output << "CREATE " << rec.pid << " " << rec.arg; break;
+            case CMD_ACCESS: output << "ACCESS " << rec.pid << " " << rec.arg; break;
+            case CMD_WRITE: output << "WRITE " << rec.pid << " " << rec.arg; break;
+            case CMD_TERMINATE: output << "TERMINATE " << rec.pid; break;
+            case CMD_STATS: output << "STATS"; break;
+            case CMD_MEMMAP: output << "MEMMAP"; break;
+            case CMD_PRIORITY: output << "PRIORITY " << rec.pid << " " << rec.arg; break;
+            case CMD_FORK: output << "FORK " << rec.pid << " " << rec.arg; break;
+            case CMD_SHARE: output << "SHARE " << rec.pid << " " << rec.arg; break;
+            case CMD_MMAP: output << "MMAP " << rec.pid << " " << rec.arg; break;
+            default: output << "#" << (int)rec.op; break;
+        }
+    }
+    
+    string describeAssociativity() const {
+        const TLB& tlb = boot->tlb;
+        if (tlb.associativity() == tlb.size()) {
+            return "fully associative";
+        }
+        if (tlb.associativity() == 1) {
+            return "direct-mapped";
+        }
+        return to_string(tlb.associativity()) + "-way set associative";
+    }
+    
+    string describePageTable() const {
+        if (pageTableType == PAGE_TABLE_HASHED) {
+            return "hashed, resident pages only";
+        }
+        RadixPageTable layout(pageTableLevels, pageBits);
+        string depth = (pageTableLevels == 1) ? "single-level" : to_string(pageTableLevels) + "-level";
+        return depth + " (" + layout.describeSplit() + "), allocated on demand";
+    }
+    
+    string describeSwap() const {
+        string text = to_string(swap->size()) + " slots, " + to_string(memoryNanos) + " ns per memory access, disk " +
+                      to_string(swap->submitCost(0)) + " ns + " + to_string(swap->submitCost(1) - swap->submitCost(0)) +
+                      " ns per page, write-back ";
+        text += writeBackBatch > 0 ? "in batches of " + to_string(writeBackBatch) : "on eviction";
+        text += prefetchPages > 0 ? ", read-ahead " + to_string(prefetchPages) + " pages" : "";
+        return text;
+    }
+    
+    // "64 KB (64 pages), 2 MB (2048 pages)"
+    string describeHugePages() const {
+        string text;
+        for (int order : hugeOrders) {
+            text += (text.empty() ? "" : ", ") + describeBytes((long long)pageSize << order) + " (" +
+                    to_string(1LL << order) + " pages)";
+        }
+        return text;
+    }
+    
+    static string describeBytes(long long bytes) {
+        static const char* const UNITS[] = {"bytes", "KB", "MB", "GB"};
+        int unit = 0;
+        while (unit < 3 && bytes >= 1024 && bytes % 1024 == 0) {
+            bytes /= 1024;
+            unit++;
+        }
+        return to_string(bytes) + " " + UNITS[unit];
+    }
+    
+    PageTable* newPageTable() const {
+        if (pageTableType == PAGE_TABLE_HASHED) {
+            return new HashedPageTable();
+        }
+        return new RadixPageTable(pageTableLevels, pageBits);
+    }
+    
+    int64_t pageOf(int64_t virtualAddr) const {
+        return virtualAddr >> offsetBits;
+    }
+    
+    // Create a new process
+    void createProcess(int pid, int64_t pages) {
+        if (processTable.find(pid) != nullptr) {
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {pid, pages}, "Process already exists");
+                } else {
+                    output << "Error: Process " << pid << " already exists\n";
+                }
+            }
+            return;
+        }
+        
+        // Pages beyond the address space could never be mapped
+        int64_t maxPages = (int64_t)1 << pageBits;
+        PCB* pcb = processTable.insert(pid, min(pages, maxPages));
+        if (!pcb->pageTable) {
+            pcb->pageTable.reset(newPageTable());
+        }
+        pcb->state = READY;
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_PROCESS_CREATED, {pid, pages});
+            } else {
+                output << "Process " << pid << " created with " << pages << " pages\n";
+            }
+        }
+    }
+    
+    // FORK: the child gets a copy of the parent's address space in O(resident
+    // pages), by mapping the parent's frames instead of copying them. Private
+    // pages become copy-on-write in both processes; frames shared through
+    // SHARE stay shared. Pages that are not resident are faulted in by each
+    // process on its own.
+    void forkProcess(int parentPid, int childPid) {
+        PCB* parent = processTable.find(parentPid);
+        if (parent == nullptr) {
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {parentPid, childPid}, "Process not found");
+                } else {
+                    output << "Error: Process " << parentPid << " not found\n";
+                }
+            }
+            return;
+        }
+        if (processTable.find(childPid) != nullptr) {
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {childPid, parentPid}, "Process already exists");
+                } else {
+                    output << "Error: Process " << childPid << " already exists\n";
+                }
+            }
+            return;
+        }
+        
+        PCB* child = processTable.insert(childPid, parent->allocatedPages);
+        if (!child->pageTable) {
+            child->pageTable.reset(newPageTable());
+        }
+        child->state = READY;
+        child->priority = parent->priority;
+        child->ranges = parent->ranges;
+        
+        // A copy-on-write fault copies one base page, so huge pages are split
+        if (!hugeOrders.empty()) {
+            parent->pageTable->forEachValid([this, parent](int64_t page, PageTableEntry& entry) {
+                if (entry.order > 0) {
+                    demote(*boot, parent, page);
+                }
+            });
+        }
+        
+        long long pages = 0;
+        parent->pageTable->forEachValid([this, parent, child, &pages](int64_t page, PageTableEntry& entry) {
+            if (!parent->shared && frameTable[entry.frameNumber].shares == 0) {
+                entry.copyOnWrite = true;
+            }
+            mapShared(entry.frameNumber, child, page, entry.copyOnWrite);
+            pages++;
+        });
+        sharing.forks++;
+        sharing.forkedPages += pages;
+        
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_FORK, {parentPid, childPid, pages});
+            } else {
+                output << "Process " << childPid << " forked from process " << parentPid << ", sharing " << pages
+                       << " resident pages\n";
+            }
+        }
+    }
+    
+    // SHARE: map every page of `source` after the pages of `pid`, as a shared
+    // library or segment would be. Both processes see the same frames, and a
+    // page is brought in once, by whichever of them touches it first.
+    void shareProcess(int pid, int sourcePid) {
+        PCB* pcb = processTable.find(pid);
+        PCB* source = processTable.find(sourcePid);
+        if (pcb == nullptr || source == nullptr) {
+            int missing = (pcb == nullptr) ? pid : sourcePid;
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {missing, pid == missing ? sourcePid : pid}, "Process not found");
+                } else {
+                    output << "Error: Process " << missing << " not found\n";
+                }
+            }
+            return;
+        }
+        if (pcb == source || !addRange(pcb, source->allocatedPages, sourcePid)) {
+            return;
+        }
+        source->shared = true;
+        sharing.shares++;
+        
+        if (traceEvents()) {
+            const MappedRange& range = pcb->ranges.back();
+            if (events.enabled()) {
+                events.emit(EV_SHARE, {pid, sourcePid, range.start, range.pages});
+            } else {
+                output << "Process " << pid << " maps the " << range.pages << " pages of process " << sourcePid
+                       << " at page " << range.start << "\n";
+            }
+        }
+    }
+    
+    // MMAP: grow the address space by pages that read as zeros until written,
+    // so their first fault needs no read from the disk
+    void mapZeroPages(int pid, int64_t pages) {
+        PCB* pcb = processTable.find(pid);
+        if (pcb == nullptr) {
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {pid, pages}, "Process not found");
+                } else {
+                    output << "Error: Process " << pid << " not found\n";
+                }
+            }
+            return;
+        }
+        if (!addRange(pcb, pages, -1)) {
+            return;
+        }
+        sharing.mmaps++;
+        
+        if (traceEvents()) {
+            const MappedRange& range = pcb->ranges.back();
+            if (events.enabled()) {
+                events.emit(EV_MMAP, {pid, range.start, range.pages});
+            } else {
+                output << "Process " << pid << " maps " << range.pages << " demand-zero pages at page " << range.start
+                       << "\n";
+            }
+        }
+    }
+    
+    // Append a range to the address space; false if it does not fit
+    bool addRange(PCB* pcb, int64_t pages, int source) {
+        int64_t maxPages = (int64_t)1 << pageBits;
+        if (pages < 1 || pages > maxPages - pcb->allocatedPages) {
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {pcb->pid, pages}, "Cannot map pages");
+                } else {
+                    output << "Error: Cannot map " << pages << " pages into process " << pcb->pid << "\n";
+                }
+            }
+            return false;
+        }
+        pcb->ranges.push_back(MappedRange{pcb->allocatedPages, pages, source});
+        pcb->allocatedPages += pages;
+        return true;
+    }
+    
+    // The SHARE or MMAP range holding a page, or nullptr
+    static const MappedRange* rangeOf(const PCB* pcb, int64_t page) {
+        for (const MappedRange& range : pcb->ranges) {
+            if (page >= range.start && page - range.start < range.pages) {
+                return &range;
+            }
+        }
+        return nullptr;
+    }
+    
+    // Map a resident frame into one more page table
+    PageTableEntry* mapShared(int frame, PCB* pcb, int64_t page, bool copyOnWrite) {
+        PageTableEntry* entry = pcb->pageTable->entry(page);
+        entry->frameNumber = frame;
+        entry->valid = true;
+        entry->referenced = false;
+        entry->dirty = false;
+        entry->copyOnWrite = copyOnWrite;
+        entry->order = 0;
+        frameTable[frame].shares++;
+        sharers[frame].push_back(PageKey{pcb->pid, page});
+        countResident(pcb, page, 1);
+        return entry;
+    }
+    
+    // Drop one of several pages mapping a frame. When it is the page in
+    // frameTable, another takes its place along with the frame's
+    // referenced and dirty bits.
+    void unmapShared(int frame, int pid, int64_t page) {
+        FrameInfo& info = frameTable[frame];
+        auto shared = sharers.find(frame);
+        vector<PageKey>& others = shared->second;
+        if (info.pid == pid && info.pageNumber == page) {
+            PageKey next = others.back();
+            others.pop_back();
+            PageTableEntry* entry = processTable.find(next.pid)->pageTable->find(next.page);
+            entry->referenced = info.entry->referenced;
+            entry->dirty = info.entry->dirty;
+            info.pid = next.pid;
+            info.pageNumber = next.page;
+            info.entry = entry;
+        } else {
+            auto it = find(others.begin(), others.end(), PageKey{pid, page});
+            *it = others.back();
+            others.pop_back();
+        }
+        if (--info.shares == 0) {
+            sharers.erase(shared);
+        }
+        if (!hugeOrders.empty()) {
+            countResident(processTable.find(pid), page, -1);
+        }
+    }
+    
+    // A write to a copy-on-write page. The last page still mapping the frame
+    // takes it over; any other gets a copy in a frame of its own. Returns the
+    // frame now mapped, -1 if none could be had.
+    int copyOnWrite(CPU& cpu, PCB* pcb, int64_t pageNumber, PageTableEntry* entry) {
+        int shared = entry->frameNumber;
+        entry->copyOnWrite = false;
+        if (frameTable[shared].shares == 0) {
+            sharing.cowReused++;
+            return shared;
+        }
+        
+        unmapShared(shared, pcb->pid, pageNumber);
+        entry->valid = false;
+        entry->frameNumber = -1;
+        shootdown(cpu, pcb, pageNumber);
+        
+        int frame = allocateFrame();
+        if (frame == -1) {
+            frame = replacePage(cpu);
+            if (frame == -1) {
+                if (traceEvents()) {
+                    if (events.enabled()) {
+                        events.emit(EV_ERROR, {pcb->pid, pageNumber}, "Cannot allocate frame");
+                    } else {
+                        output << "Error: Cannot allocate frame for page " << pageNumber << "\n";
+                    }
+                }
+                return -1;
+            }
+        }
+        entry->frameNumber = frame;
+        entry->valid = true;
+        entry->referenced = true;
+        entry->dirty = true;
+        frameTable[frame].pid = pcb->pid;
+        frameTable[frame].pageNumber = pageNumber;
+        frameTable[frame].entry = entry;
+        policy->pageLoaded(frame, accessClock);
+        countResident(pcb, pageNumber, 1);
+        sharing.cowCopies++;
+        
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_COPY_ON_WRITE, {pcb->pid, pageNumber, frame});
+            } else {
+                output << "Copy-on-write: page " << pageNumber << " of process " << pcb->pid << " copied to frame "
+                       << frame << "\n";
+            }
+        }
+        return frame;
+    }
+    
+    // Huge pages: valid entries per aligned region of every huge page size,
+    // so a fault tells in O(sizes) whether its region is untouched or full
+    void countResident(PCB* pcb, int64_t page, int delta) {
+        if (hugeOrders.empty()) {
+            return;
+        }
+        for (int order : hugeOrders) {
+            auto it = pcb->resident.emplace((page >> order) << 5 | order, 0).first;
+            it->second += delta;
+            if (it->second == 0) {
+                pcb->resident.erase(it);
+            }
+        }
+    }
+    
+    static int64_t residentIn(const PCB* pcb, int64_t start, int order) {
+        auto it = pcb->resident.find((start >> order) << 5 | order);
+        return it == pcb->resident.end() ? 0 : it->second;
+    }
+    
+    // No page of [start, start + pages) is mapped from another process by SHARE
+    static bool privateRange(const PCB* pcb, int64_t start, int64_t pages) {
+        for (const MappedRange& range : pcb->ranges) {
+            if (range.source >= 0 && range.start < start + pages && start < range.start + range.pages) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    HugePageStatistics& hugeCounts(int order) {
+        return hugeStats[find(hugeOrders.begin(), hugeOrders.end(), order) - hugeOrders.begin()];
+    }
+    
+    // A fault in an aligned region with no page resident maps all of it as
+    // one huge page: the largest size that fits the address space and has a
+    // free block of frames, without evicting anything for it. Regions that
+    // overlap a SHARE or hold a page queued for write-back take base pages.
+    // nullptr when no size fits.
+    PageTableEntry* hugePageFault(PCB* pcb, int64_t pageNumber) {
+        int pid = pcb->pid;
+        for (int order : hugeOrders) {
+            int64_t pages = 1LL << order;
+            int64_t start = pageNumber & -pages;
+            if (start + pages > pcb->allocatedPages || residentIn(pcb, start, order) > 0 ||
+                !privateRange(pcb, start, pages) ||
+                any_of(writeBack.begin(), writeBack.end(), [pid, start, pages](const PageKey& key) {
+                    return key.pid == pid && key.page >= start && key.page < start + pages;
+                })) {
+                continue;
+            }
+            int first = frameAllocator->allocate(order);
+            if (first == -1) {
+                continue;
+            }
+            
+            int reads = 0;
+            for (int64_t i = 0; i < pages; i++) {
+                int frame = first + (int)i;
+                int64_t page = start + i;
+                PageTableEntry* entry = pcb->pageTable->entry(page);
+                entry->frameNumber = frame;
+                entry->valid = true;
+                entry->referenced = (page == pageNumber);
+                entry->dirty = false;
+                entry->copyOnWrite = false;
+                entry->order = order;
+                frameTable[frame].pid = pid;
+                frameTable[frame].pageNumber = page;
+                frameTable[frame].entry = entry;
+                policy->pageLoaded(frame, accessClock);
+                countResident(pcb, page, 1);
+                if (rangeOf(pcb, page) != nullptr && !(swap && swap->holds(pid, page))) {
+                    sharing.zeroFills++;
+                } else {
+                    reads++;
+                }
+            }
+            
+            // The pages that are not demand-zero come in one read
+            if (swap && reads > 0) {
+                long long done = swap->submit(simNanos, reads, false);
+                swapStats.faultNanos += done - simNanos;
+                swapStats.diskFaults++;
+                simNanos = done;
+                if (writeBackBatch > 0 && (int)writeBack.size() >= writeBackBatch) {
+                    flushWriteBack();
+                }
+            }
+            hugeCounts(order).faults++;
+            
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_HUGE_PAGE, {pid, start, first, pages});
+                } else {
+                    output << "Allocated huge page of " << pages << " frames at frame " << first << " to pages "
+                           << start << "-" << start + pages - 1 << " of process " << pid << "\n";
+                }
+            }
+            return pcb->pageTable->find(pageNumber);
+        }
+        return nullptr;
+    }
+    
+    // Promotion, after a base-page fault: once every page of an aligned
+    // region is resident, private and not copy-on-write, map the region as
+    // one huge page. Frames that already form the aligned block are kept;
+    // otherwise the pages move to a free block, if there is one, and start
+    // over with the replacement policy.
+    void promote(CPU& cpu, PCB* pcb, int64_t pageNumber) {
+        for (int order : hugeOrders) {
+            int64_t pages = 1LL << order;
+            int64_t start = pageNumber & -pages;
+            if (residentIn(pcb, start, order) != pages || !privateRange(pcb, start, pages)) {
+                continue;
+            }
+            int first = pcb->pageTable->find(start)->frameNumber;
+            bool inPlace = (first & (pages - 1)) == 0;
+            bool eligible = true;
+            for (int64_t i = 0; i < pages && eligible; i++) {
+                const PageTableEntry* entry = pcb->pageTable->find(start + i);
+                eligible = entry->order < order && !entry->copyOnWrite && frameTable[entry->frameNumber].shares == 0;
+                inPlace = inPlace && entry->frameNumber == first + i;
+            }
+            if (!eligible) {
+                continue;
+            }
+            
+            if (!inPlace) {
+                int block = frameAllocator->allocate(order);
+                if (block == -1) {
+                    continue;
+                }
+                for (int64_t i = 0; i < pages; i++) {
+                    PageTableEntry* entry = pcb->pageTable->find(start + i);
+                    int from = entry->frameNumber, to = block + (int)i;
+                    frameTable[to] = frameTable[from];
+                    frameTable[from] = FrameInfo();
+                    policy->pageFreed(from);
+                    policy->pageLoaded(to, accessClock);
+                    if (swap) {
+                        readyAt[to] = readyAt[from];
+                        prefetched[to] = prefetched[from];
+                        readyAt[from] = 0;
+                        prefetched[from] = 0;
+                    }
+                    freeFrame(from);
+                    entry->frameNumber = to;
+                }
+                hugeCounts(order).migrated += pages;
+            }
+            for (int64_t i = 0; i < pages; i++) {
+                PageTableEntry* entry = pcb->pageTable->find(start + i);
+                cpu.tlb.invalidate(pcb->pid, start + i, entry->order);
+                entry->order = order;
+            }
+            hugeCounts(order).promotions++;
+            
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_PROMOTION, {pcb->pid, start, pages, inPlace ? 0 : pages});
+                } else {
+                    output << "Promoted pages " << start << "-" << start + pages - 1 << " of process " << pcb->pid
+                           << " to a huge page" << (inPlace ? " in place" : ", moved to frame " +
+                                                    to_string(pcb->pageTable->find(start)->frameNumber)) << "\n";
+                }
+            }
+            return;
+        }
+    }
+    
+    // Split a huge page back into base pages, which keep their frames
+    void demote(CPU& cpu, PCB* pcb, int64_t pageNumber) {
+        int order = pcb->pageTable->find(pageNumber)->order;
+        int64_t pages = 1LL << order;
+        int64_t start = pageNumber & -pages;
+        cpu.tlb.invalidate(pcb->pid, start, order);
+        for (int64_t page = start; page < start + pages; page++) {
+            pcb->pageTable->find(page)->order = 0;
+        }
+        hugeCounts(order).demotions++;
+        
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_DEMOTION, {pcb->pid, start, pages});
+            } else {
+                output << "Split huge page at pages " << start << "-" << start + pages - 1 << " of process "
+                       << pcb->pid << " into base pages\n";
+            }
+        }
+    }
+    
+    // Allocate a frame
+    int allocateFrame() {
+        return frameAllocator->allocate(0);  // -1 if no frame is free
+    }
+    
+    // Free a frame
+    void freeFrame(int frame) {
+        if (frame >= 0 && frame < numFrames) {
+            frameAllocator->free(frame, 0);
+        }
+    }
+    
+    // Evict the page chosen by the replacement policy and reuse its frame.
+    // Returns -1 if nothing is resident or the victim is one of `pinned`,
+    // which then stays resident.
+    int replacePage(CPU& cpu, const vector<int>& pinned = vector<int>()) {
+        int frame = policy->selectVictim();
+        if (frame == -1) {
+            return -1;
+        }
+        if (find(pinned.begin(), pinned.end(), frame) != pinned.end()) {
+            policy->keepVictim(frame);
+            return -1;
+        }
+        
+        FrameInfo& victim = frameTable[frame];
+        if (traceEvents() && events.enabled()) {
+            events.emit(EV_REPLACEMENT, {victim.pid, victim.pageNumber, frame, victim.entry->dirty});
+        } else if (traceEvents()) {
+            output << "Replacing page " << victim.pageNumber << " of process " << victim.pid;
+            if (victim.entry->dirty) {
+                output << " (dirty - writing back to disk)";
+            }
+            output << "\n";
+        }
+        if (swap) {
+            swapOut(frame);
+        }
+        
+        PCB* owner = processTable.find(victim.pid);
+        if (victim.entry->order > 0) {
+            demote(cpu, owner, victim.pageNumber);
+        }
+        victim.entry->valid = false;
+        victim.entry->frameNumber = -1;
+        owner->pageTable->release(victim.pageNumber);
+        countResident(owner, victim.pageNumber, -1);
+        
+        // Invalidate TLB entry
+        shootdown(cpu, owner, victim.pageNumber);
+        
+        // and the other pages mapping a shared frame
+        if (victim.shares > 0) {
+            auto shared = sharers.find(frame);
+            for (const PageKey& key : shared->second) {
+                PCB* pcb = processTable.find(key.pid);
+                PageTableEntry* entry = pcb->pageTable->find(key.page);
+                entry->valid = false;
+                entry->frameNumber = -1;
+                pcb->pageTable->release(key.page);
+                countResident(pcb, key.page, -1);
+                shootdown(cpu, pcb, key.page);
+            }
+            sharers.erase(shared);
+        }
+        
+        victim = FrameInfo();
+        pageReplacements++;
+        return frame;
+    }
+    
+    // Drop a page of a process, or with pageNumber -1 all of its pages, from
+    // every TLB that may cache it. Other CPUs are reached by IPI: the
+    // initiator takes each remote TLB lock in turn, and the time until the
+    // last one is done is the shootdown latency.
+    void shootdown(CPU& initiator, PCB* pcb, int64_t pageNumber) {
+        uint64_t self = 1ULL << initiator.id;
+        if (pcb->cpuMask & self) {
+            invalidateOn(initiator, pcb->pid, pageNumber);
+        }
+        uint64_t remote = pcb->cpuMask & ~self;
+        if (remote == 0) {
+            return;
+        }
+        
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < cpus.size(); i++) {
+            if (remote & (1ULL << i)) {
+                CPU& target = *cpus[i];
+                lock_guard<mutex> guard(target.lock);
+                flushReferences(target);
+                invalidateOn(target, pcb->pid, pageNumber);
+                target.shootdownsReceived++;
+                shootdownIPIs++;
+            }
+        }
+        long long nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        shootdowns++;
+        shootdownNanos += nanos;
+        shootdownMaxNanos = max(shootdownMaxNanos, nanos);
+    }
+    
+    static void invalidateOn(CPU& cpu, int pid, int64_t pageNumber) {
+        if (pageNumber == -1) {
+            cpu.tlb.invalidateProcess(pid);
+        } else {
+            cpu.tlb.invalidate(pid, pageNumber);
+        }
+        if (cpu.baseTLB && pageNumber == -1) {
+            cpu.baseTLB->invalidateProcess(pid);
+        } else if (cpu.baseTLB) {
+            cpu.baseTLB->invalidate(pid, pageNumber);
+        }
+    }
+    
+    // Multi-core: record the TLB hits a core made without memoryLock with
+    // the policy and the pages' bits, in the order it made them. Needs
+    // memoryLock and the core's lock. Runs before the core's next miss or
+    // command, when its batch is full, and when a shootdown reaches it, so
+    // the hits on a frame are recorded before the frame is reused; frames
+    // evicted in between are skipped.
+    void flushReferences(CPU& cpu) {
+        for (int reference : cpu.references) {
+            accessClock++;
+            int frame = reference >> 1;
+            if (frameTable[frame].entry != nullptr && frameTable[frame].entry->valid) {
+                touchFrame(frame, (reference & 1) != 0);
+            }
+        }
+        cpu.references.clear();
+    }
+    
+    // Record every access with the policy and the page's referenced/dirty bits
+    void touchFrame(int frame, bool write) {
+        if (frame < 0 || frameTable[frame].entry == nullptr) {
+            return;
+        }
+        PageTableEntry* entry = frameTable[frame].entry;
+        entry->referenced = true;
+        if (write) {
+            entry->dirty = true;
+        }
+        policy->pageReferenced(frame, accessClock);
+        if (swap && (prefetched[frame] || readyAt[frame] > simNanos)) {
+            usePrefetched(frame);
+        }
+    }
+    
+    // OPT needs, for every access, the index of the next access to the same page
+    void computeNextUse(const vector<PageKey>& keys) {
+        nextUse.assign(keys.size(), OptimalPolicy::NEVER);
+        unordered_map<PageKey, long long, PageKeyHash> seen;
+        for (long long i = (long long)keys.size() - 1; i >= 0; i--) {
+            auto it = seen.find(keys[i]);
+            if (it != seen.end()) {
+                nextUse[i] = it->second;
+                it->second = i;
+            } else {
+                seen.emplace(keys[i], i);
+            }
+        }
+    }
+    
+    // Handle page fault; returns the entry now mapping the page, or nullptr
+    PageTableEntry* handlePageFault(CPU& cpu, PCB* pcb, int64_t pageNumber) {
+        int pid = pcb->pid;
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_PAGE_FAULT, {pid, pageNumber});
+            } else {
+                output << "PAGE FAULT: Process " << pid << ", Page " << pageNumber << "\n";
+            }
+        }
+        
+        pcb->pageFaults++;
+        totalPageFaults++;
+        
+        if (pageNumber >= pcb->allocatedPages) {
+            handleInterrupt(SEGMENTATION_FAULT, pid, pageNumber, pcb);
+            return nullptr;
+        }
+        
+        // A page of a SHARE belongs to the process it comes from: map its
+        // frame if it is resident, otherwise load it there first
+        PCB* home = pcb;
+        int64_t homePage = pageNumber;
+        for (const MappedRange* range = rangeOf(home, homePage); range != nullptr && range->source >= 0;
+             range = rangeOf(home, homePage)) {
+            homePage -= range->start;
+            home = processTable.find(range->source);
+        }
+        if (home != pcb) {
+            PageTableEntry* resident = home->pageTable->find(homePage);
+            if (resident != nullptr && resident->valid) {
+                sharing.sharedFaults++;
+                if (traceEvents()) {
+                    if (events.enabled()) {
+                        events.emit(EV_SHARED_FAULT, {pid, pageNumber, resident->frameNumber});
+                    } else {
+                        output << "Mapped shared frame " << resident->frameNumber << " to page " << pageNumber
+                               << " of process " << pid << "\n";
+                    }
+                }
+                return mapShared(resident->frameNumber, pcb, pageNumber, resident->copyOnWrite);
+            }
+        }
+        if (!hugeOrders.empty() && home == pcb) {
+            PageTableEntry* entry = hugePageFault(pcb, pageNumber);
+            if (entry != nullptr) {
+                return entry;
+            }
+        }
+        
+        int frame = allocateFrame();
+        if (frame == -1) {
+            frame = replacePage(cpu);
+            if (frame == -1) {
+                if (traceEvents()) {
+                    if (events.enabled()) {
+                        events.emit(EV_ERROR, {pid, pageNumber}, "Cannot allocate frame");
+                    } else {
+                        output << "Error: Cannot allocate frame for page " << pageNumber << "\n";
+                    }
+                }
+                return nullptr;
+            }
+        }
+        
+        PageTableEntry* entry = home->pageTable->entry(homePage);
+        entry->frameNumber = frame;
+        entry->valid = true;
+        entry->referenced = true;
+        entry->dirty = false;
+        entry->copyOnWrite = false;
+        entry->order = 0;
+        
+        frameTable[frame].pid = home->pid;
+        frameTable[frame].pageNumber = homePage;
+        frameTable[frame].entry = entry;
+        policy->pageLoaded(frame, accessClock);
+        countResident(home, homePage, 1);
+        
+        // Demand-zero pages are read only once they were written out
+        if (rangeOf(home, homePage) != nullptr && !(swap && swap->holds(home->pid, homePage))) {
+            sharing.zeroFills++;
+        } else if (swap) {
+            swapIn(home->pid, homePage, frame);
+        }
+        
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_FRAME_ALLOCATED, {pid, pageNumber, frame});
+            } else {
+                output << "Allocated frame " << frame << " to page " << pageNumber << " of process " << pid << "\n";
+            }
+        }
+        if (home != pcb) {
+            entry = mapShared(frame, pcb, pageNumber, false);
+        } else if (!hugeOrders.empty()) {
+            promote(cpu, pcb, pageNumber);
+        }
+        return entry;
+    }
+    
+    // A faulting page is read from the swap device, or from the process
+    // image if it was never swapped out; either way the access waits for the
+    // read. A page still queued for write-back is taken back without I/O.
+    void swapIn(int pid, int64_t pageNumber, int frame) {
+        readyAt[frame] = 0;
+        prefetched[frame] = 0;
+        auto queued = find(writeBack.begin(), writeBack.end(), PageKey{pid, pageNumber});
+        if (queued != writeBack.end()) {
+            writeBack.erase(queued);
+            frameTable[frame].entry->dirty = true;
+            swapStats.rescued++;
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_RESCUE, {pid, pageNumber});
+                } else {
+                    output << "Page " << pageNumber << " of process " << pid << " taken back from the write-back queue\n";
+                }
+            }
+            return;
+        }
+        
+        long long done = swap->submit(simNanos, 1, false);
+        swapStats.faultNanos += done - simNanos;
+        swapStats.diskFaults++;
+        simNanos = done;
+        
+        // Background writes go behind the read, so the fault does not wait for them
+        if (writeBackBatch > 0 && (int)writeBack.size() >= writeBackBatch) {
+            flushWriteBack();
+        }
+    }
+    
+    // A dirty victim is written to its swap slot: at once, so the read that
+    // follows waits for it, or queued for a batched background write
+    void swapOut(int frame) {
+        FrameInfo& victim = frameTable[frame];
+        if (prefetched[frame]) {
+            swapStats.prefetchWasted++;
+        }
+        prefetched[frame] = 0;
+        readyAt[frame] = 0;
+        if (!victim.entry->dirty) {
+            return;
+        }
+        if (swap->allocate(victim.pid, victim.pageNumber) < 0) {
+            swapStats.lost++;
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {victim.pid, victim.pageNumber}, "Swap device full");
+                } else {
+                    output << "Error: Swap device full, page " << victim.pageNumber << " of process " << victim.pid
+                           << " lost\n";
+                }
+            }
+            return;
+        }
+        if (writeBackBatch == 0) {
+            swap->submit(simNanos, 1, true);
+        } else {
+            writeBack.push_back(PageKey{victim.pid, victim.pageNumber});
+        }
+    }
+    
+    // Write the queued dirty pages in one request
+    void flushWriteBack() {
+        if (writeBack.empty()) {
+            return;
+        }
+        swap->submit(simNanos, (int)writeBack.size(), true);
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_WRITE_BACK, {(long long)writeBack.size()});
+            } else {
+                output << "Writing back " << writeBack.size() << " dirty pages\n";
+            }
+        }
+        writeBack.clear();
+    }
+    
+    // First reference to a page read ahead, which waits if the read is
+    // still in progress
+    void usePrefetched(int frame) {
+        if (prefetched[frame]) {
+            swapStats.prefetchHits++;
+            prefetched[frame] = 0;
+        }
+        if (readyAt[frame] > simNanos) {
+            swapStats.prefetchWaitNanos += readyAt[frame] - simNanos;
+            simNanos = readyAt[frame];
+        }
+    }
+    
+    // After a fault: when the distance to the previous fault repeats, read
+    // the next pages along that stride ahead, up to the window. Contiguous
+    // pages come in one request, others one request each; none of them
+    // holds up the faulting access. The faulting page's frame and the pages
+    // already read are pinned: once the policy would evict one of them, the
+    // read ahead stops.
+    void readAhead(CPU& cpu, PCB* pcb, int64_t pageNumber, int faultFrame) {
+        int64_t stride = pageNumber - pcb->lastFault;
+        bool repeated = stride != 0 && stride == pcb->faultStride;
+        pcb->faultStride = stride;
+        pcb->lastFault = pageNumber;
+        if (!repeated) {
+            return;
+        }
+        
+        int window = min(prefetchPages, numFrames - 1);
+        vector<int> frames;
+        vector<int> pinned(1, faultFrame);
+        for (int i = 1; i <= window; i++) {
+            int64_t page = pageNumber + stride * i;
+            if (page < 0 || page >= pcb->allocatedPages) {
+                break;
+            }
+            if (rangeOf(pcb, page) != nullptr) {
+                break;  // Shared and demand-zero pages are not read ahead
+            }
+            pcb->lastFault = page;
+            PageTableEntry* entry = pcb->pageTable->find(page);
+            if ((entry != nullptr && entry->valid) ||
+                find(writeBack.begin(), writeBack.end(), PageKey{pcb->pid, page}) != writeBack.end()) {
+                continue;
+            }
+            int frame = allocateFrame();
+            if (frame == -1) {
+                frame = replacePage(cpu, pinned);
+                if (frame == -1) {
+                    break;
+                }
+            }
+            entry = pcb->pageTable->entry(page);
+            entry->frameNumber = frame;
+            entry->valid = true;
+            entry->referenced = false;
+            entry->dirty = false;
+            entry->copyOnWrite = false;
+            entry->order = 0;
+            frameTable[frame].pid = pcb->pid;
+            frameTable[frame].pageNumber = page;
+            frameTable[frame].entry = entry;
+            policy->pageLoaded(frame, accessClock);
+            countResident(pcb, page, 1);
+            prefetched[frame] = 1;
+            frames.push_back(frame);
+            pinned.push_back(frame);
+        }
+        if (frames.empty()) {
+            return;
+        }
+        
+        if (stride == 1) {
+            long long done = swap->submit(simNanos, (int)frames.size(), false);
+            for (int frame : frames) {
+                readyAt[frame] = done;
+            }
+        } else {
+            for (int frame : frames) {
+                readyAt[frame] = swap->submit(simNanos, 1, false);
+            }
+        }
+        swapStats.prefetched += frames.size();
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_PREFETCH, {pcb->pid, pageNumber, (long long)frames.size(), stride});
+            } else {
+                output << "Reading ahead " << frames.size() << " pages of process " << pcb->pid << " after page "
+                       << pageNumber << " (stride " << stride << ")\n";
+            }
+        }
+    }
+    
+    // Translate virtual address to physical address
+    int64_t translateAddress(int pid, int64_t virtualAddr, bool write = false) {
+        return translate<false>(*boot, pid, virtualAddr, write);
+    }
+    
+    // Translation on one CPU; SHARED when other cores run at the same time
+    template <bool SHARED>
+    int64_t translate(CPU& cpu, int pid, int64_t virtualAddr, bool write) {
+        int64_t pageNumber = pageOf(virtualAddr);
+        int64_t offset = virtualAddr & (pageSize - 1);
+        
+        // Check TLB first. On several cores a hit takes only this core's
+        // lock, which a shootdown needs before the frame can be reused, and
+        // leaves the reference to be recorded later, see flushReferences.
+        int cachedFrame = -1;
+        bool hit;
+        if (SHARED) {
+            unique_lock<mutex> guard(cpu.lock);
+            if (cpu.tlb.lookup(pid, pageNumber, cachedFrame)) {
+                cpu.tlbHits++;
+                if (cachedFrame >= 0) {
+                    cpu.references.push_back(cachedFrame << 1 | (write ? 1 : 0));
+                }
+                bool full = cpu.references.size() >= REFERENCE_BATCH;
+                guard.unlock();
+                if (full) {
+                    unique_lock<mutex> memory = lockMemory(true);
+                    lock_guard<mutex> relock(cpu.lock);
+                    flushReferences(cpu);
+                }
+                return (int64_t)cachedFrame * pageSize + offset;
+            }
+            hit = false;
+        } else {
+            hit = cpu.tlb.lookup(pid, pageNumber, cachedFrame);
+        }
+        
+        unique_lock<mutex> memory = lockMemory(SHARED);
+        if (SHARED) {
+            lock_guard<mutex> guard(cpu.lock);
+            flushReferences(cpu);
+        }
+        accessClock++;
+        if (swap) {
+            simNanos += memoryNanos;
+        }
+        
+        // With huge pages: the TLB reach, and whether a TLB of base pages
+        // only would have hit
+        bool baseHit = true;
+        if (!SHARED && cpu.baseTLB) {
+            int baseFrame;
+            baseHit = cpu.baseTLB->lookup(pid, pageNumber, baseFrame);
+            cpu.baseMisses += !baseHit;
+            reachTotal += cpu.tlb.reach();
+        }
+        
+        if (hit) {
+            cpu.tlbHits++;
+            if (traceAccesses()) {
+                if (events.enabled()) {
+                    events.emit(EV_TLB_HIT, {pid, pageNumber});
+                } else {
+                    output << "TLB Hit: Process " << pid << ", Page " << pageNumber << "\n";
+                }
+            }
+            
+            // Shared frames are written through the page table, which may
+            // hold a copy-on-write mapping
+            if (write && cachedFrame >= 0 && frameTable[cachedFrame].shares > 0) {
+                PCB* pcb = processTable.find(pid);
+                PageTableEntry* entry = pcb->pageTable->find(pageNumber);
+                if (entry->copyOnWrite) {
+                    cachedFrame = copyOnWrite(cpu, pcb, pageNumber, entry);
+                    cpu.tlb.insert(pid, pageNumber, cachedFrame);
+                }
+            }
+            if (!baseHit) {
+                cpu.baseTLB->insert(pid, pageNumber, cachedFrame);
+            }
+            
+            touchFrame(cachedFrame, write);
+            
+            return (int64_t)cachedFrame * pageSize + offset;
+        }
+        
+        cpu.tlbMisses++;
+        if (swap) {
+            simNanos += walkNanos;
+        }
+        if (traceAccesses()) {
+            if (events.enabled()) {
+                events.emit(EV_TLB_MISS, {pid, pageNumber});
+            } else {
+                output << "TLB Miss: Process " << pid << ", Page " << pageNumber << "\n";
+            }
+        }
+        
+        PCB* pcb = processTable.find(pid);
+        if (pcb == nullptr) {
+            handleInterrupt(INVALID_ACCESS, pid, virtualAddr);
+            return -1;
+        }
+        
+        if (pageNumber < 0 || pageNumber >= pcb->allocatedPages) {
+            handleInterrupt(SEGMENTATION_FAULT, pid, virtualAddr, pcb);
+            return -1;
+        }
+        
+        PageTableEntry* entry = pcb->pageTable->find(pageNumber);
+        bool faulted = (entry == nullptr || !entry->valid);
+        if (faulted) {
+            entry = handlePageFault(cpu, pcb, pageNumber);
+        }
+        
+        int frame = entry ? entry->frameNumber : -1;
+        if (write && entry != nullptr && entry->copyOnWrite) {
+            frame = copyOnWrite(cpu, pcb, pageNumber, entry);
+        }
+        touchFrame(frame, write);
+        
+        // Update TLB (FIFO replacement within the set). Only this thread
+        // writes its TLB, and shootdowns need memoryLock, which it holds.
+        cpu.tlb.insert(pid, pageNumber, frame, entry != nullptr ? entry->order : 0);
+        if (!baseHit) {
+            cpu.baseTLB->insert(pid, pageNumber, frame);
+        }
+        pcb->cpuMask |= 1ULL << cpu.id;
+        
+        // After the TLB insert, so evicting for a read ahead shoots it down
+        if (swap && prefetchPages > 0 && faulted && entry != nullptr) {
+            readAhead(cpu, pcb, pageNumber, frame);
+        }
+        
+        return (int64_t)frame * pageSize + offset;
+    }
+    
+    // Handle interrupts
+    void handleInterrupt(InterruptType type, int pid, int64_t addr, PCB* pcb = nullptr) {
+        if (type == SEGMENTATION_FAULT && pcb != nullptr) {
+            pcb->state = TERMINATED;
+        }
+        if (!traceEvents()) {
+            return;
+        }
+        if (events.enabled()) {
+            events.emit(EV_INTERRUPT, {type, pid, addr});
+            return;
+        }
+        
+        output << "\n=== INTERRUPT HANDLER ===\n";
+        
+        switch (type) {
+            case PAGE_FAULT:
+                output << "Type: PAGE FAULT\n";
+                output << "Process: " << pid << ", Address: " << addr << "\n";
+                break;
+                
+            case INVALID_ACCESS:
+                output << "Type: INVALID ACCESS\n";
+                output << "Process: " << pid << " does not exist\n";
                 break;
                 
             case SEGMENTATION_FAULT:
                 output << "Type: SEGMENTATION FAULT\n";
                 output << "Process: " << pid << ", Invalid address: " << addr << "\n";
-                if (processTable.find(pid) != processTable.end()) {
-                    processTable[pid]->state = TERMINATED;
+                break;
+                
+            case TIMER_INTERRUPT:
+                output << "Type: TIMER INTERRUPT\n";
+                output << "Context switch triggered\n";
+                break;
+        }
+        
+        output << "=========================\n\n";
+    }
+    
+    // Terminate process
+    void terminateProcess(int pid) {
+        terminateProcess(*boot, pid);
+    }
+    
+    void terminateProcess(CPU& cpu, int pid) {
+        PCB* pcb = processTable.find(pid);
+        if (pcb == nullptr) {
+            if (traceEvents()) {
+                if (events.enabled()) {
+                    events.emit(EV_ERROR, {pid, 0}, "Process not found");
+                } else {
+                    output << "Error: Process " << pid << " not found\n";
+                }
+            }
+            return;
+        }
+        
+        // Free all allocated frames, then the page table itself. Frames other
+        // processes still map only lose this mapping.
+        pcb->pageTable->forEachValid([this, pid](int64_t page, PageTableEntry& entry) {
+            int frame = entry.frameNumber;
+            if (frameTable[frame].shares > 0) {
+                unmapShared(frame, pid, page);
+                return;
+            }
+            policy->pageFreed(frame);
+            frameTable[frame] = FrameInfo();
+            freeFrame(frame);
+            if (swap) {
+                swapStats.prefetchWasted += prefetched[frame];
+                prefetched[frame] = 0;
+                readyAt[frame] = 0;
+            }
+        });
+        pcb->pageTable->clear();
+        
+        // Pages mapped from it by SHARE become private to the processes that
+        // map them, so a new process with its pid is not shared by mistake
+        if (pcb->shared) {
+            for (PCB* other : processTable.sorted()) {
+                auto& ranges = other->ranges;
+                ranges.erase(remove_if(ranges.begin(), ranges.end(), [pid](const MappedRange& range) {
+                    return range.source == pid;
+                }), ranges.end());
+            }
+        }
+        
+        // Its swap slots, and dirty pages no one will read again
+        if (swap) {
+            swap->release(pid);
+            writeBack.erase(remove_if(writeBack.begin(), writeBack.end(), [pid](const PageKey& key) {
+                return key.pid == pid;
+            }), writeBack.end());
+        }
+        
+        // Clear TLB entries
+        shootdown(cpu, pcb, -1);
+        
+        pcb->state = TERMINATED;
+        if (traceEvents()) {
+            if (events.enabled()) {
+                events.emit(EV_PROCESS_TERMINATED, {pid, pcb->pageFaults});
+            } else {
+                output << "Process " << pid << " terminated. Page faults: " << pcb->pageFaults << "\n";
+            }
+        }
+        
+        processTable.erase(pcb);
+    }
+    
+    // Print statistics
+    void printStatistics() {
+        long long pageTableBytes = 0;
+        for (PCB* pcb : processTable.sorted()) {
+            pageTableBytes += pcb->pageTable->memoryBytes();
+        }
+        long long tlbHits = 0, tlbMisses = 0;
+        for (auto& cpu : cpus) {
+            tlbHits += cpu->tlbHits;
+            tlbMisses += cpu->tlbMisses;
+        }
+        
+        if (events.enabled()) {
+            events.emit(EV_STATISTICS, {tlbHits, tlbMisses, pageReplacements, frameAllocator->freeFrames(),
+                                        numFrames, (long long)processTable.size(), pageTableBytes});
+            vector<long long> blocks = frameAllocator->freeBlocks();
+            for (int order = 0; order < (int)blocks.size(); order++) {
+                double unusable, index;
+                fragmentation(blocks, order, unusable, index);
+                events.emit(EV_FREE_BLOCKS, {1LL << order, blocks[order], llround(unusable * 1000),
+                                             llround(index * 1000)});
+            }
+            if (cpus.size() > 1) {
+                for (auto& cpu : cpus) {
+                    events.emit(EV_CPU, {cpu->id, cpu->tlbHits, cpu->tlbMisses, cpu->shootdownsReceived});
+                }
+                events.emit(EV_SHOOTDOWNS, {shootdowns, shootdownIPIs, shootdownNanos, shootdownMaxNanos,
+                                            lockAcquired, lockContended});
+            }
+            if (scheduler) {
+                events.emit(EV_SCHEDULE, {schedule.completed, schedule.ticks, schedule.idleTicks, schedule.turnaround,
+                                          schedule.waiting, schedule.response, schedule.contextSwitches,
+                                          schedule.timerInterrupts});
+            }
+            if (sharingUsed()) {
+                long long frames = 0, mappings = 0;
+                sharedFrameCounts(frames, mappings);
+                events.emit(EV_SHARING, {sharing.forks, sharing.forkedPages, frames, mappings, sharing.cowCopies,
+                                         sharing.cowReused, sharing.sharedFaults, sharing.zeroFills});
+            }
+            if (!hugeOrders.empty()) {
+                vector<long long> mapped = hugePagesMapped();
+                for (size_t i = 0; i < hugeOrders.size(); i++) {
+                    const HugePageStatistics& counts = hugeStats[i];
+                    events.emit(EV_HUGE_PAGES, {1LL << hugeOrders[i], counts.faults, counts.promotions,
+                                                counts.migrated, counts.demotions, mapped[i]});
+                }
+                long long accesses = accessClock + 1;
+                events.emit(EV_TLB_REACH, {accesses > 0 ? reachTotal * pageSize / accesses : 0,
+                                           boot->tlb.reach() * pageSize, boot->tlb.hugeEntries(), boot->baseMisses});
+            }
+            if (swap) {
+                long long accesses = accessClock + 1;
+                events.emit(EV_SWAP, {swap->used(), swap->size(), swap->peakSlots, swap->reads, swap->writes,
+                                      swap->readRequests, swap->writeRequests, swapStats.lost});
+                events.emit(EV_SWAP_PAGING, {swapStats.prefetched, swapStats.prefetchHits, swapStats.prefetchWasted,
+                                             swapStats.prefetchWaitNanos, swapStats.rescued});
+                events.emit(EV_DISK, {max(simNanos, swap->idleAt()), swap->busy, swap->requests(), swap->depthTotal,
+                                      swap->maxDepth, swapStats.faultNanos, swapStats.diskFaults,
+                                      accesses > 0 ? simNanos / accesses : 0});
+            }
+            return;
+        }
+        
+        output << "\n=== SYSTEM STATISTICS ===\n";
+        output << "TLB Hits: " << tlbHits << "\n";
+        output << "TLB Misses: " << tlbMisses << "\n";
+        
+        if (tlbHits + tlbMisses > 0) {
+            double hitRate = (double)tlbHits / (tlbHits + tlbMisses) * 100;
+            output << "TLB Hit Rate: " << fixed << setprecision(2) << hitRate << "%\n";
+        }
+        
+        output << "Page Replacements: " << pageReplacements << "\n";
+        output << "Free Frames: " << frameAllocator->freeFrames() << "/" << numFrames << "\n";
+        printFragmentation();
+        output << "Active Processes: " << processTable.size() << "\n";
+        output << "Page Table Memory: " << pageTableBytes << " bytes\n";
+        if (cpus.size() > 1) {
+            for (auto& cpu : cpus) {
+                output << "CPU " << cpu->id << ": TLB Hits " << cpu->tlbHits << ", Misses " << cpu->tlbMisses
+                       << ", Shootdowns Received " << cpu->shootdownsReceived << "\n";
+            }
+            output << "TLB Shootdowns: " << shootdowns << " (" << shootdownIPIs << " IPIs)";
+            if (shootdowns > 0) {
+                output << ", mean latency " << shootdownNanos / shootdowns << " ns, max " << shootdownMaxNanos << " ns";
+            }
+            output << "\n";
+            output << "Memory Lock: " << lockContended << " of " << lockAcquired << " acquisitions contended\n";
+        }
+        if (scheduler) {
+            output << "Completed Processes: " << schedule.completed << "\n";
+            output << "Ticks: " << schedule.ticks << " (" << schedule.idleTicks << " idle)\n";
+            output << "Context Switches: " << schedule.contextSwitches << " (" << schedule.timerInterrupts
+                   << " timer interrupts)\n";
+            if (schedule.ticks > 0) {
+                output << "Throughput: " << fixed << setprecision(2)
+                       << (double)schedule.completed / schedule.ticks * 1000 << " processes per 1000 ticks\n";
+            }
+            if (schedule.completed > 0) {
+                double n = (double)schedule.completed;
+                output << "Average Turnaround: " << fixed << setprecision(2) << schedule.turnaround / n << " ticks\n";
+                output << "Average Waiting: " << schedule.waiting / n << " ticks\n";
+                output << "Average Response: " << schedule.response / n << " ticks\n";
+            }
+        }
+        if (sharingUsed()) {
+            printSharingStatistics();
+        }
+        if (!hugeOrders.empty()) {
+            printHugePageStatistics(tlbMisses);
+        }
+        if (swap) {
+            printSwapStatistics();
+        }
+        output << "=========================\n";
+    }
+    
+    void printSwapStatistics() {
+        output << fixed << setprecision(2);
+        output << "Swap Slots: " << swap->used() << "/" << swap->size() << " used (peak " << swap->peakSlots << ")\n";
+        output << "Disk Reads: " << swap->reads << " pages in " << swap->readRequests << " requests\n";
+        output << "Disk Writes: " << swap->writes << " pages in " << swap->writeRequests << " requests\n";
+        if (writeBackBatch > 0) {
+            output << "Taken Back From Write-Back Queue: " << swapStats.rescued << " pages\n";
+        }
+        if (swapStats.lost > 0) {
+            output << "Dirty Pages Lost To A Full Swap Device: " << swapStats.lost << "\n";
+        }
+        if (prefetchPages > 0) {
+            output << "Read-Ahead: " << swapStats.prefetched << " pages, " << swapStats.prefetchHits << " used, "
+                   << swapStats.prefetchWasted << " evicted unused, " << swapStats.prefetchWaitNanos / 1000.0
+                   << " us waited\n";
+        }
+        long long elapsed = max(simNanos, swap->idleAt());
+        if (elapsed > 0) {
+            output << "Disk Utilisation: " << (double)swap->busy / elapsed * 100 << "% of " << elapsed / 1e6 << " ms\n";
+        }
+        if (swap->requests() > 0) {
+            output << "Disk Queue Depth: average " << (double)swap->depthTotal / swap->requests() << ", max "
+                   << swap->maxDepth << "\n";
+        }
+        if (swapStats.diskFaults > 0) {
+            output << "Fault Service Time: average " << swapStats.faultNanos / 1000.0 / swapStats.diskFaults
+                   << " us over " << swapStats.diskFaults << " disk reads\n";
+        }
+        long long accesses = accessClock + 1;
+        if (accesses > 0) {
+            output << "Effective Access Time: " << (double)simNanos / accesses << " ns\n";
+        }
+    }
+    
+    // Huge pages mapped at the end of the run, per size
+    vector<long long> hugePagesMapped() const {
+        vector<long long> mapped(hugeOrders.size(), 0);
+        for (PCB* pcb : processTable.sorted()) {
+            pcb->pageTable->forEachValid([this, &mapped](int64_t page, PageTableEntry& entry) {
+                if (entry.order > 0 && (page & ((1LL << entry.order) - 1)) == 0) {
+                    mapped[find(hugeOrders.begin(), hugeOrders.end(), (int)entry.order) - hugeOrders.begin()]++;
+                }
+            });
+        }
+        return mapped;
+    }
+    
+    // Fragmentation of free memory for a block of 2^order frames, from the
+    // maximal free blocks. The unusable free space index is the share of
+    // free frames in blocks too small for it. The fragmentation index is -1
+    // while such a block is free; otherwise it is 0 when the request fails
+    // for lack of free frames and tends to 1 when it fails for fragmentation.
+    static void fragmentation(const vector<long long>& blocks, int order, double& unusable, double& index) {
+        long long free = 0, usable = 0, count = 0;
+        for (int k = 0; k < (int)blocks.size(); k++) {
+            free += blocks[k] << k;
+            count += blocks[k];
+            if (k >= order) {
+                usable += blocks[k] << k;
+            }
+        }
+        unusable = free > 0 ? (double)(free - usable) / free : 0;
+        index = usable > 0 ? -1 : count > 0 ? max(0.0, 1 - (1 + (double)free / (1LL << order)) / count) : 0;
+    }
+    
+    // Free blocks by size, the unusable free space index up to the first
+    // size with no free block, and the fragmentation index there
+    void printFragmentation() {
+        vector<long long> blocks = frameAllocator->freeBlocks();
+        int largest = -1;
+        output << "Free Blocks:";
+        for (int order = 0; order < (int)blocks.size(); order++) {
+            if (blocks[order] > 0) {
+                output << (largest >= 0 ? ", " : " ") << blocks[order] << " x " << (1LL << order);
+                largest = order;
+            }
+        }
+        if (largest < 0) {
+            output << " none\n";
+            return;
+        }
+        output << " frames\n";
+        output << fixed << setprecision(2);
+        int last = min(largest + 1, frameAllocator->maxBlockOrder());
+        double unusable, index;
+        if (last > 0) {
+            output << "Unusable Free Space:";
+            for (int order = 1; order <= last; order++) {
+                fragmentation(blocks, order, unusable, index);
+                output << (order > 1 ? ", " : " ") << unusable << " for " << (1LL << order);
+            }
+            output << " frames\n";
+        }
+        if (largest < frameAllocator->maxBlockOrder()) {
+            fragmentation(blocks, largest + 1, unusable, index);
+            output << "Fragmentation Index: " << index << " for " << (1LL << (largest + 1)) << " frames\n";
+        }
+    }
+    
+    void printHugePageStatistics(long long tlbMisses) {
+        vector<long long> mapped = hugePagesMapped();
+        for (size_t i = 0; i < hugeOrders.size(); i++) {
+            const HugePageStatistics& counts = hugeStats[i];
+            output << "Huge Pages of " << describeBytes((long long)pageSize << hugeOrders[i]) << ": " << counts.faults
+                   << " faults, " << counts.promotions << " promotions (" << counts.migrated << " pages moved), "
+                   << counts.demotions << " demotions, " << mapped[i] << " mapped\n";
+        }
+        output << fixed << setprecision(2);
+        long long accesses = accessClock + 1;
+        if (accesses > 0) {
+            output << "TLB Reach: " << (double)reachTotal * pageSize / accesses / 1024 << " KB average, "
+                   << (double)boot->tlb.reach() * pageSize / 1024 << " KB at the end (" << boot->tlb.hugeEntries()
+                   << " of " << boot->tlb.size() << " entries huge)\n";
+        }
+        output << "TLB Misses With Base Pages Only: " << boot->baseMisses;
+        if (boot->baseMisses > 0) {
+            output << " (" << (double)(boot->baseMisses - tlbMisses) / boot->baseMisses * 100
+                   << "% saved by huge pages)";
+        }
+        output << "\n";
+    }
+    
+    bool sharingUsed() const {
+        return sharing.forks + sharing.shares + sharing.mmaps > 0;
+    }
+    
+    // Frames mapped by several pages, and the pages mapping them
+    void sharedFrameCounts(long long& frames, long long& mappings) const {
+        frames = (long long)sharers.size();
+        mappings = 0;
+        for (auto& item : sharers) {
+            mappings += 1 + (long long)item.second.size();
+        }
+    }
+    
+    void printSharingStatistics() {
+        long long frames, mappings;
+        sharedFrameCounts(frames, mappings);
+        output << "Forks: " << sharing.forks << ", sharing " << sharing.forkedPages << " resident pages\n";
+        output << "Shared Frames: " << frames << " mapped by " << mappings << " pages (" << mappings - frames
+               << " frames saved)\n";
+        output << "Copy-On-Write: " << sharing.cowCopies << " pages copied, " << sharing.cowReused
+               << " taken over by their last mapping\n";
+        output << "Shared Page Faults: " << sharing.sharedFaults << " served by a resident frame\n";
+        output << "Zero-Fill Faults: " << sharing.zeroFills << "\n";
+    }
+    
+    // Print memory map
+    void printMemoryMap() {
+        if (events.enabled()) {
+            static const char* const STATE_NAMES[] = {"NEW", "READY", "RUNNING", "WAITING", "TERMINATED"};
+            for (PCB* pcb : processTable.sorted()) {
+                int validCount = 0;
+                pcb->pageTable->forEachValid([&validCount](int64_t, PageTableEntry&) {
+                    validCount++;
+                });
+                events.emit(EV_PROCESS, {pcb->pid, pcb->pageFaults, validCount}, STATE_NAMES[pcb->state]);
+                pcb->pageTable->forEachValid([this, pcb](int64_t page, PageTableEntry& entry) {
+                    events.emit(EV_MAPPING, {pcb->pid, page, entry.frameNumber});
+                });
+            }
+            for (auto& item : sharers) {
+                events.emit(EV_SHARED_FRAME, {item.first, 1 + (long long)item.second.size(),
+                                              frameTable[item.first].entry->copyOnWrite});
+            }
+            return;
+        }
+        
+        output << "\n=== MEMORY MAP ===\n";
+        for (PCB* pcb : processTable.sorted()) {
+            output << "Process " << pcb->pid << " (State: ";
+            
+            switch (pcb->state) {
+                case NEW: output << "NEW"; break;
+                case READY: output << "READY"; break;
+                case RUNNING: output << "RUNNING"; break;
+                case WAITING: output << "WAITING"; break;
+                case TERMINATED: output << "TERMINATED"; break;
+            }
+            
+            output << ")\n";
+            output << "  Page Faults: " << pcb->pageFaults << "\n";
+            output << "  Valid Pages: ";
+            
+            // Shared frames are marked s, or c while copy-on-write
+            int validCount = 0, sharedCount = 0, cowCount = 0;
+            pcb->pageTable->forEachValid([&](int64_t page, PageTableEntry& entry) {
+                output << page << "->" << entry.frameNumber;
+                if (frameTable[entry.frameNumber].shares > 0) {
+                    output << (entry.copyOnWrite ? "c" : "s");
+                    sharedCount++;
+                    cowCount += entry.copyOnWrite;
+                }
+                output << " ";
+                validCount++;
+            });
+            
+            if (validCount == 0) {
+                output << "None";
+            }
+            output << "\n";
+            if (sharedCount > 0) {
+                output << "  Shared Pages: " << sharedCount << " (" << cowCount << " copy-on-write)\n";
+            }
+        }
+        if (!sharers.empty()) {
+            long long frames, mappings;
+            sharedFrameCounts(frames, mappings);
+            output << "Shared Frames: " << frames << " mapped by " << mappings << " pages (" << mappings - frames
+                   << " frames saved)\n";
+        }
+        output << "==================\n";
+    }
+};
+
+// Trace analysis, without simulating the MMU. Every access gets its reuse
+// distance: the number of distinct pages touched since the last access to
+// the same page. A Fenwick tree over access positions, holding a mark at
+// the latest access of every live page, counts them in O(log n). By the
+// LRU stack property (Mattson et al.) an access hits in M frames exactly
+// when its distance is below M, so one histogram of distances gives the
+// miss-ratio curve for every memory size. CREATE and TERMINATE are
+// followed as the MMU does: accesses outside a process are skipped and a
+// terminated process's pages start cold again. Frames freed by TERMINATE
+// break the stack property for a while, so with terminations the curve can
+// show slightly fewer misses than the simulator. FORK, SHARE and MMAP size
+// the address spaces as in the MMU, but every page counts as the
+// process's own: sharing is not modeled here.
+class TraceAnalyzer {
+private:
+    int offsetBits;
+    int64_t maxPages;
+    int frames;       // Memory size for the per-process fault counts
+    long long window; // Working-set window, in accesses
+    OutputFormat format;
+    
+    // Fenwick tree over access positions, 1-based
+    vector<int> marks;
+    
+    void mark(long long pos, int delta) {
+        for (long long i = pos + 1; i < (long long)marks.size(); i += i & -i) {
+            marks[i] += delta;
+        }
+    }
+    
+    long long marksUpTo(long long pos) const {
+        long long sum = 0;
+        for (long long i = pos + 1; i > 0; i -= i & -i) {
+            sum += marks[i];
+        }
+        return sum;
+    }
+    
+    struct LiveProcess {
+        int64_t pages;            // As allocated by CREATE, FORK, SHARE and MMAP
+        vector<int64_t> touched;  // Pages with a mark in the tree
+    };
+    
+    // Per pid, summed over every process that had it
+    struct FaultFrequency {
+        long long accesses;
+        long long pages;
+        long long faults;  // Under LRU with `frames` frames
+    };
+    
+public:
+    TraceAnalyzer(const MMUConfig& config, long long window)
+        : offsetBits(log2Exact(config.pageSize)), maxPages((int64_t)1 << config.pageNumberBits()),
+          frames(config.frames), window(window), format(config.format) {}
+    
+    string analyze(const char* data, size_t size) {
+        bool binary = isBinaryTrace(data, size);
+        TraceRecord rec;
+        string_view line, command;
+        
+        // Sized by a first pass, as the Fenwick tree cannot grow
+        long long total = 0;
+        if (binary) {
+            BinaryTraceReader scan(data, size);
+            while (scan.next(rec)) {
+                total += (rec.op == CMD_ACCESS || rec.op == CMD_WRITE);
+            }
+        } else {
+            ScriptTokenizer scan(data, size);
+            while (scan.next(rec, line, command)) {
+                total += (rec.op == CMD_ACCESS || rec.op == CMD_WRITE);
+            }
+        }
+        marks.assign(total + 1, 0);
+        
+        unordered_map<int, LiveProcess> processes;
+        map<int, FaultFrequency> frequency;
+        unordered_map<PageKey, long long, PageKeyHash> lastAccess;  // Live pages only
+        vector<long long> distances;  // distances[d]: accesses with reuse distance d
+        long long accesses = 0, skipped = 0, cold = 0, live = 0, maxLive = 0;
+        
+        // Working set: distinct pages among the last `window` accesses. A
+        // window longer than the trace never wraps.
+        vector<PageKey> recent(min(window, total));
+        unordered_map<PageKey, long long, PageKeyHash> inWindow;
+        long long wssSum = 0, wssMax = 0;
+        vector<pair<long long, long long>> wssSeries;
+        
+        auto step = [&](const TraceRecord& rec) {
+            if (rec.op == CMD_CREATE) {
+                if (processes.find(rec.pid) == processes.end()) {
+                    processes[rec.pid] = LiveProcess{min(rec.arg, maxPages), {}};
+                    frequency.emplace(rec.pid, FaultFrequency{0, 0, 0});
+                }
+                return;
+            }
+            if (rec.op == CMD_TERMINATE) {
+                auto it = processes.find(rec.pid);
+                if (it == processes.end()) {
+                    return;
+                }
+                for (int64_t page : it->second.touched) {
+                    auto last = lastAccess.find(PageKey{rec.pid, page});
+                    mark(last->second, -1);
+                    lastAccess.erase(last);
+                    live--;
+                }
+                processes.erase(it);
+                return;
+            }
+            if (rec.op == CMD_FORK || rec.op == CMD_SHARE || rec.op == CMD_MMAP) {
+                auto it = processes.find(rec.pid);
+                if (it == processes.end()) {
+                    return;
+                }
+                int64_t pages = it->second.pages;
+                if (rec.op == CMD_FORK) {
+                    int child = (int)rec.arg;
+                    if (processes.find(child) == processes.end()) {
+                        processes[child] = LiveProcess{pages, {}};
+                        frequency.emplace(child, FaultFrequency{0, 0, 0});
+                    }
+                    return;
+                }
+                int64_t added = rec.arg;
+                if (rec.op == CMD_SHARE) {
+                    auto source = processes.find((int)rec.arg);
+                    added = (source == processes.end() || rec.arg == rec.pid) ? 0 : source->second.pages;
+                }
+                if (added >= 1 && added <= maxPages - pages) {
+                    it->second.pages = pages + added;
+                }
+                return;
+            }
+            if (rec.op != CMD_ACCESS && rec.op != CMD_WRITE) {
+                return;
+            }
+            
+            auto it = processes.find(rec.pid);
+            int64_t page = rec.arg >> offsetBits;
+            if (it == processes.end() || page < 0 || page >= it->second.pages) {
+                skipped++;
+                return;
+            }
+            FaultFrequency& counts = frequency[rec.pid];
+            PageKey key{rec.pid, page};
+            long long now = accesses++;
+            counts.accesses++;
+            
+            auto last = lastAccess.find(key);
+            if (last == lastAccess.end()) {
+                cold++;
+                counts.faults++;
+                counts.pages++;
+                it->second.touched.push_back(page);
+                lastAccess.emplace(key, now);
+                maxLive = max(maxLive, ++live);
+            } else {
+                long long distance = marksUpTo(now - 1) - marksUpTo(last->second);
+                if ((long long)distances.size() <= distance) {
+                    distances.resize(distance + 1, 0);
+                }
+                distances[distance]++;
+                counts.faults += (distance >= frames);
+                mark(last->second, -1);
+                last->second = now;
+            }
+            mark(now, 1);
+            
+            if (window > 0) {
+                if (now >= window) {
+                    auto leaving = inWindow.find(recent[now % window]);
+                    if (--leaving->second == 0) {
+                        inWindow.erase(leaving);
+                    }
                 }
-                break;
-                
-            case TIMER_INTERRUPT:
-                output << "Type: TIMER INTERRUPT\n";
-                output << "Context switch triggered\n";
-                break;
+                recent[now % window] = key;
+                inWindow[key]++;
+                long long wss = (long long)inWindow.size();
+                wssSum += wss;
+                wssMax = max(wssMax, wss);
+                if ((now + 1) % window == 0) {
+                    wssSeries.push_back(make_pair(now + 1, wss));
+                }
+            }
+        };
+        
+        if (binary) {
+            BinaryTraceReader reader(data, size);
+            while (reader.next(rec)) {
+                step(rec);
+            }
+        } else {
+            ScriptTokenizer tokens(data, size);
+            while (tokens.next(rec, line, command)) {
+                step(rec);
+            }
         }
         
-        output << "=========================\n\n";
-    }
-    
-    // Terminate process
-    void terminateProcess(int pid) {
-        if (processTable.find(pid) == processTable.end()) {
-            output << "Error: Process " << pid << " not found\n";
-            return;
+        // misses[m]: misses with m frames, for m = 1..maxLive
+        vector<long long> misses(maxLive + 1, cold);
+        long long farther = 0;
+        for (long long m = (long long)distances.size() - 1; m >= 1; m--) {
+            farther += distances[m];
+            if (m <= maxLive) {
+                misses[m] += farther;
+            }
         }
         
-        PCB* pcb = processTable[pid];
+        // Reuse distances in power-of-two buckets: 0, 1, 2-3, 4-7, ...
+        vector<tuple<long long, long long, long long>> buckets;
+        for (long long low = 0; low < (long long)distances.size(); low = low ? low * 2 : 1) {
+            long long high = min(low ? low * 2 - 1 : 0, (long long)distances.size() - 1), count = 0;
+            for (long long d = low; d <= high; d++) {
+                count += distances[d];
+            }
+            buckets.push_back(make_tuple(low, high, count));
+        }
+        double wssMean = (accesses > 0 && window > 0) ? (double)wssSum / accesses : 0.0;
         
-        // Free all allocated frames
-        for (int i = 0; i < pcb->pageTable.size(); i++) {
-            if (pcb->pageTable[i].valid) {
-                freeFrame(pcb->pageTable[i].frameNumber);
+        if (format != FORMAT_TEXT) {
+            EventStream events(format);
+            events.emit(EV_ANALYSIS, {accesses, skipped, cold, maxLive, window, llround(wssMean * 1000), wssMax});
+            for (auto& point : wssSeries) {
+                events.emit(EV_WORKING_SET, {point.first, point.second});
+            }
+            events.emit(EV_REUSE, {-1, -1, cold});
+            for (auto& bucket : buckets) {
+                events.emit(EV_REUSE, {get<0>(bucket), get<1>(bucket), get<2>(bucket)});
             }
+            for (long long m = 1; m <= maxLive; m++) {
+                events.emit(EV_MISS_RATIO, {m, misses[m]});
+            }
+            for (auto& pair : frequency) {
+                events.emit(EV_FAULT_FREQUENCY, {pair.first, pair.second.accesses, pair.second.pages,
+                                                 pair.second.faults});
+            }
+            return events.take();
         }
         
-        // Clear TLB entries
-        for (auto& entry : tlb) {
-            if (entry.valid && entry.pid == pid) {
-                entry.valid = false;
+        stringstream out;
+        out << fixed << setprecision(2);
+        out << "=== TRACE ANALYSIS ===\n";
+        out << "Accesses: " << accesses << "\n";
+        if (skipped > 0) {
+            out << "Skipped: " << skipped << " (no such process or address)\n";
+        }
+        out << "Cold Misses: " << cold << "\n";
+        out << "Peak Live Pages: " << maxLive << "\n";
+        if (window > 0) {
+            out << "Working Set (window " << window << " accesses): mean " << wssMean << ", max " << wssMax
+                << " pages\n";
+        }
+        
+        out << "\n=== REUSE DISTANCE ===\n";
+        out << "cold: " << cold << "\n";
+        for (auto& bucket : buckets) {
+            out << get<0>(bucket);
+            if (get<1>(bucket) > get<0>(bucket)) {
+                out << "-" << get<1>(bucket);
             }
+            out << ": " << get<2>(bucket) << "\n";
         }
         
-        pcb->state = TERMINATED;
-        output << "Process " << pid << " terminated. Page faults: " << pcb->pageFaults << "\n";
+        // Sizes growing by half each row, plus the simulated memory size
+        out << "\n=== MISS RATIO CURVE (LRU) ===\n";
+        set<long long> sizes;
+        for (long long m = 1; m <= maxLive; m = max(m + 1, m * 3 / 2)) {
+            sizes.insert(m);
+        }
+        if (frames <= maxLive) {
+            sizes.insert(frames);
+        }
+        for (long long m : sizes) {
+            double ratio = accesses > 0 ? (double)misses[m] / accesses * 100 : 0;
+            out << m << " frames: " << misses[m] << " misses, " << ratio << "%\n";
+        }
         
-        delete pcb;
-        processTable.erase(pid);
+        out << "\n=== PAGE FAULT FREQUENCY (LRU, " << frames << " frames) ===\n";
+        for (auto& pair : frequency) {
+            const FaultFrequency& counts = pair.second;
+            out << "Process " << pair.first << ": " << counts.accesses << " accesses, " << counts.pages
+                << " pages, " << counts.faults << " faults";
+            if (counts.accesses > 0) {
+                out << ", " << (double)counts.faults / counts.accesses * 1000 << " per 1000 accesses";
+            }
+            out << "\n";
+        }
+        return out.str();
     }
+};
+
+// One configuration of a sweep; `label` holds the swept options
+struct SweepPoint {
+    MMUConfig config;
+    string label;
+};
+
+// Parameter sweep: the trace is decoded once into records that every run
+// shares read-only, then the configurations run on a pool of worker
+// threads. Results are listed in grid order.
+string runSweep(const char* data, size_t size, const vector<SweepPoint>& points, int threads,
+                OutputFormat format) {
+    const vector<TraceRecord> records = decodeTrace(data, size);
+    vector<RunStatistics> results(points.size());
+    atomic<size_t> nextPoint(0);
     
-    // Print statistics
-    void printStatistics() {
-        output << "\n=== SYSTEM STATISTICS ===\n";
-        output << "TLB Hits: " << tlbHits << "\n";
-        output << "TLB Misses: " << tlbMisses << "\n";
-        
-        if (tlbHits + tlbMisses > 0) {
-            double hitRate = (double)tlbHits / (tlbHits + tlbMisses) * 100;
-            output << "TLB Hit Rate: " << fixed << setprecision(2) << hitRate << "%\n";
+    auto worker = [&]() {
+        size_t i;
+        while ((i = nextPoint++) < points.size()) {
+            MMUConfig config = points[i].config;
+            config.verbosity = VERBOSITY_SUMMARY;
+            config.format = FORMAT_TEXT;
+            MMU mmu(config);
+            results[i] = mmu.replay(records);
         }
-        
-        output << "Free Frames: " << freeFrames.size() << "/" << PHYSICAL_MEMORY_SIZE << "\n";
-        output << "Active Processes: " << processTable.size() << "\n";
-        output << "=========================\n";
+    };
+    
+    vector<thread> pool;
+    for (int t = 0; t < threads && t < (int)points.size(); t++) {
+        pool.emplace_back(worker);
+    }
+    for (thread& th : pool) {
+        th.join();
     }
     
-    // Print memory map
-    void printMemoryMap() {
-        output << "\n=== MEMORY MAP ===\n";
-        for (auto& pair : processTable) {
-            PCB* pcb = pair.second;
-            output << "Process " << pcb->pid << " (State: ";
-            
-            switch (pcb->state) {
-                case NEW: output << "NEW"; break;
-                case READY: output << "READY"; break;
-                case RUNNING: output << "RUNNING"; break;
-                case WAITING: output << "WAITING"; break;
-                case TERMINATED: output << "TERMINATED"; break;
-            }
-            
-            output << ")\n";
-            output << "  Page Faults: " << pcb->pageFaults << "\n";
-            output << "  Valid Pages: ";
-            
-            int validCount = 0;
-            for (int i = 0; i < pcb->allocatedPages; i++) {
-                if (pcb->pageTable[i].valid) {
-                    output << i << "->" << pcb->pageTable[i].frameNumber << " ";
-                    validCount++;
-                }
-            }
-            
-            if (validCount == 0) {
-                output << "None";
+    if (format != FORMAT_TEXT) {
+        EventStream events(format);
+        for (size_t i = 0; i < points.size(); i++) {
+            const RunStatistics& r = results[i];
+            events.emit(EV_SWEEP_RESULT, {(long long)i, r.accesses, r.tlbHits, r.tlbMisses, r.pageFaults,
+                                          r.replacements}, points[i].label);
+            if (points[i].config.swapSlots > 0) {
+                events.emit(EV_SWEEP_SWAP, {(long long)i, r.accesses > 0 ? r.elapsedNanos / r.accesses : 0,
+                                            r.diskReads, r.diskWrites});
             }
-            output << "\n";
         }
-        output << "==================\n";
+        return events.take();
     }
-};
+    
+    // Access times once any configuration has a swap device
+    bool swapped = false;
+    for (const SweepPoint& point : points) {
+        swapped = swapped || point.config.swapSlots > 0;
+    }
+    
+    size_t labelWidth = 13;
+    for (const SweepPoint& point : points) {
+        labelWidth = max(labelWidth, point.label.size());
+    }
+    
+    stringstream out;
+    out << fixed << setprecision(2);
+    out << "=== PARAMETER SWEEP ===\n";
+    out << "Commands: " << records.size() << ", configurations: " << points.size() << ", threads: "
+        << min(threads, (int)points.size()) << "\n\n";
+    out << left << setw(labelWidth) << "Configuration" << right << setw(12) << "Accesses" << setw(10) << "TLB Hit%"
+        << setw(12) << "Faults" << setw(10) << "Fault%" << setw(14) << "Replacements";
+    if (swapped) {
+        out << setw(12) << "EAT ns" << setw(12) << "Disk Reads" << setw(12) << "Disk Writes";
+    }
+    out << "\n";
+    for (size_t i = 0; i < points.size(); i++) {
+        const RunStatistics& r = results[i];
+        double hitRate = (r.tlbHits + r.tlbMisses > 0) ? (double)r.tlbHits / (r.tlbHits + r.tlbMisses) * 100 : 0;
+        double faultRate = (r.accesses > 0) ? (double)r.pageFaults / r.accesses * 100 : 0;
+        out << left << setw(labelWidth) << (points[i].label.empty() ? "(defaults)" : points[i].label) << right
+            << setw(12) << r.accesses << setw(10) << hitRate << setw(12) << r.pageFaults << setw(10) << faultRate
+            << setw(14) << r.replacements;
+        if (swapped) {
+            double eat = (r.accesses > 0) ? (double)r.elapsedNanos / r.accesses : 0;
+            out << setw(12) << eat << setw(12) << r.diskReads << setw(12) << r.diskWrites;
+        }
+        out << "\n";
+    }
+    return out.str();
+}
 
 // Original main function for file-based execution
 int main_original() {
@@ -468,93 +5727,392 @@ int main_original() {
         return 1;
     }
     
+    string content((istreambuf_iterator<char>(input)), 
+                  istreambuf_iterator<char>());
+    
     MMU mmu(output);
+    output << mmu.executeCommands(content);
     
-    output << "=== OS SIMULATOR - PHASE 2 ===\n";
-    output << "Page Size: " << PAGE_SIZE << " bytes\n";
-    output << "Physical Memory: " << PHYSICAL_MEMORY_SIZE << " frames\n";
-    output << "Virtual Memory: " << VIRTUAL_MEMORY_SIZE << " pages per process\n\n";
+    input.close();
+    output.close();
     
-    string line;
-    int lineNum = 0;
+    cout << "Simulation complete. Check output.txt for results.\n";
     
-    while (getline(input, line)) {
-        lineNum++;
-        
-        if (line.empty() || line[0] == '#') {
-            continue;  // Skip empty lines and comments
+    return 0;
+}
+
+// Read-only memory mapping of a whole file, so large binary traces are
+// replayed without being copied into memory first
+class MappedFile {
+private:
+    const char* ptr;
+    size_t length;
+    bool opened;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    
+public:
+    explicit MappedFile(const string& path) : ptr(nullptr), length(0), opened(false) {
+#ifdef _WIN32
+        mapping = NULL;
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = (size_t)fileSize.QuadPart;
+        opened = true;
+        if (length > 0) {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            ptr = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            opened = (ptr != nullptr);
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            length = (size_t)st.st_size;
+            opened = true;
+            if (length > 0) {
+                void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                ptr = (mapped == MAP_FAILED) ? nullptr : (const char*)mapped;
+                opened = (ptr != nullptr);
+            }
+        }
+        close(fd);
+#endif
+    }
+    
+    ~MappedFile() {
+#ifdef _WIN32
+        if (ptr) UnmapViewOfFile(ptr);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (ptr) munmap((void*)ptr, length);
+#endif
+    }
+    
+    bool isOpen() const { return opened; }
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+};
+
+bool parseConfigOption(const string& arg, MMUConfig& config);
+
+// Daemon mode: each job's frame options apply on top of the defaults
+JobRunner jobRunner(const MMUConfig& defaults) {
+    return [defaults](const string& job, const string& optionText, const OutputSink& sink) {
+        MMUConfig config = defaults;
+        istringstream optionWords(optionText);
+        string arg;
+        while (optionWords >> arg) {
+            if (!parseConfigOption(arg, config)) {
+                cerr << "Warning: Ignoring invalid job option " << arg << endl;
+            }
+        }
+        if (!config.validate().empty()) {
+            cerr << "Warning: Ignoring invalid job options " << optionText << endl;
+            config = defaults;
         }
         
-        output << "Command [" << lineNum << "]: " << line << "\n";
-        
-        istringstream iss(line);
-        string command;
-        iss >> command;
-        
-        if (command == "CREATE") {
-            int pid, pages;
-            iss >> pid >> pages;
-            mmu.createProcess(pid, pages);
+        // Results go out chunk by chunk while the job runs
+        MMU mmu(config);
+        mmu.setOutputSink(sink);
+        mmu.executeCommands(job);
+    };
+}
+
+// Apply a --name=value MMU option; returns false if arg is not one or its value is invalid
+bool parseConfigOption(const string& arg, MMUConfig& config) {
+    size_t eq = arg.find('=');
+    string name = arg.substr(0, eq);
+    string value = (eq == string::npos) ? "" : arg.substr(eq + 1);
+    
+    if (name == "--tlb-size") {
+        config.tlbSize = atoi(value.c_str());
+    }
+    else if (name == "--tlb-ways") {
+        if (value == "full") {
+            config.tlbWays = 0;
+        }
+        else if (value == "direct") {
+            config.tlbWays = 1;
+        }
+        else {
+            config.tlbWays = atoi(value.c_str());
+        }
+    }
+    else if (name == "--verbosity") {
+        if (value == "full") {
+            config.verbosity = VERBOSITY_FULL;
+        }
+        else if (value == "events") {
+            config.verbosity = VERBOSITY_EVENTS;
         }
-        else if (command == "ACCESS") {
-            int pid, addr;
-            iss >> pid >> addr;
-            output << "Accessing virtual address " << addr << " of process " << pid << "\n";
-            int physAddr = mmu.translateAddress(pid, addr, false);
-            if (physAddr != -1) {
-                output << "Physical address: " << physAddr << "\n";
+        else if (value == "summary") {
+            config.verbosity = VERBOSITY_SUMMARY;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "--policy") {
+        static const map<string, ReplacementPolicyType> policies = {
+            {"fifo", POLICY_FIFO}, {"lru", POLICY_LRU}, {"clock", POLICY_CLOCK},
+            {"nru", POLICY_NRU}, {"lfu", POLICY_LFU}, {"opt", POLICY_OPT}
+        };
+        auto it = policies.find(value);
+        if (it == policies.end()) {
+            return false;
+        }
+        config.policy = it->second;
+    }
+    else if (name == "--format") {
+        if (value == "text") {
+            config.format = FORMAT_TEXT;
+        }
+        else if (value == "ndjson") {
+            config.format = FORMAT_NDJSON;
+        }
+        else if (value == "binary") {
+            config.format = FORMAT_BINARY;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "--frames") {
+        config.frames = atoi(value.c_str());
+    }
+    else if (name == "--scheduler") {
+        static const map<string, SchedulerType> schedulers = {
+            {"none", SCHEDULER_NONE}, {"fcfs", SCHEDULER_FCFS}, {"rr", SCHEDULER_RR},
+            {"priority", SCHEDULER_PRIORITY}, {"mlfq", SCHEDULER_MLFQ}, {"cfs", SCHEDULER_CFS}
+        };
+        auto it = schedulers.find(value);
+        if (it == schedulers.end()) {
+            return false;
+        }
+        config.scheduler = it->second;
+    }
+    else if (name == "--quantum") {
+        config.quantum = atoi(value.c_str());
+    }
+    else if (name == "--cpus") {
+        config.cpus = atoi(value.c_str());
+    }
+    else if (name == "--page-size") {
+        config.pageSize = atoi(value.c_str());
+    }
+    else if (name == "--va-bits") {
+        config.vaBits = atoi(value.c_str());
+    }
+    else if (name == "--swap") {
+        config.swapSlots = value.empty() ? SWAP_SLOTS : atoi(value.c_str());
+        return config.swapSlots > 0;
+    }
+    else if (name == "--mem-time") {
+        config.memoryNanos = atoi(value.c_str());
+    }
+    else if (name == "--disk-latency") {
+        config.diskLatency = atoi(value.c_str());
+    }
+    else if (name == "--disk-bandwidth") {
+        config.diskBandwidth = atoi(value.c_str());
+    }
+    else if (name == "--write-back") {
+        config.writeBackBatch = atoi(value.c_str());
+    }
+    else if (name == "--prefetch") {
+        config.prefetch = atoi(value.c_str());
+    }
+    else if (name == "--huge-pages") {
+        // Sizes in bytes, K, M or G, separated by colons, or none
+        config.hugePages.clear();
+        if (value == "none") {
+            return true;
+        }
+        stringstream sizes(value);
+        string size;
+        while (getline(sizes, size, ':')) {
+            char* end;
+            long long bytes = strtoll(size.c_str(), &end, 10);
+            string unit = end;
+            int shift = unit.empty() ? 0 : unit == "K" ? 10 : unit == "M" ? 20 : unit == "G" ? 30 : -1;
+            if (end == size.c_str() || shift < 0 || bytes <= 0 || bytes > (1LL << 40)) {
+                return false;
+            }
+            config.hugePages.push_back(bytes << shift);
+        }
+        return !config.hugePages.empty();
+    }
+    else if (name == "--allocator") {
+        if (value == "buddy") {
+            config.allocator = ALLOCATOR_BUDDY;
+        }
+        else if (value == "bitmap") {
+            config.allocator = ALLOCATOR_BITMAP;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (name == "--page-table") {
+        if (value == "hashed") {
+            config.pageTableType = PAGE_TABLE_HASHED;
+        }
+        else if (value == "flat") {
+            config.pageTableType = PAGE_TABLE_RADIX;
+            config.pageTableLevels = 1;
+        }
+        else if (value.size() == 7 && value.compare(1, 6, "-level") == 0 && value[0] >= '1' && value[0] <= '4') {
+            config.pageTableType = PAGE_TABLE_RADIX;
+            config.pageTableLevels = value[0] - '0';
+        }
+        else {
+            return false;
+        }
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Benchmarks include this file with OS_SIM_NO_MAIN defined
+#ifndef OS_SIM_NO_MAIN
+// New main function for CLI execution with backend integration
+int main(int argc, char* argv[]) {
+    // Options may appear anywhere; everything else is a file name
+    MMUConfig config;
+    bool serve = false;
+    bool convert = false;
+    bool deltaEncode = false;
+    long long analyzeWindow = -1;  // Set by --analyze
+    int sweepThreads = 0;          // Set by --sweep
+    vector<pair<string, vector<string>>> sweepAxes;  // Options given as value lists
+    long long checkpointEvery = 0;  // Set by --checkpoint
+    string checkpointDir = ".";
+    string resumePath;              // Set by --resume
+    long long stopAt = -1;          // Set by --stop-at
+    string socketPath;
+    vector<string> files;
+    
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--serve") {
+            serve = true;
+        }
+        else if (arg.compare(0, 8, "--serve=") == 0) {
+            serve = true;
+            socketPath = arg.substr(8);
+        }
+        else if (arg == "--convert" || arg == "--convert=delta") {
+            convert = true;
+            deltaEncode = (arg == "--convert=delta");
+        }
+        else if (arg == "--sweep") {
+            sweepThreads = max(1u, thread::hardware_concurrency());
+        }
+        else if (arg.compare(0, 8, "--sweep=") == 0) {
+            sweepThreads = max(1, atoi(arg.c_str() + 8));
+        }
+        else if (arg.compare(0, 2, "--") == 0 && arg.find(',') != string::npos) {
+            // A list of values to sweep, e.g. --frames=16,32,64
+            size_t eq = arg.find('=');
+            vector<string> values;
+            istringstream list(arg.substr(eq + 1));
+            string value;
+            while (getline(list, value, ',')) {
+                values.push_back(value);
             }
+            sweepAxes.push_back(make_pair(arg.substr(0, eq), values));
         }
-        else if (command == "WRITE") {
-            int pid, addr;
-            iss >> pid >> addr;
-            output << "Writing to virtual address " << addr << " of process " << pid << "\n";
-            int physAddr = mmu.translateAddress(pid, addr, true);
-            if (physAddr != -1) {
-                output << "Physical address: " << physAddr << "\n";
+        else if (arg == "--analyze") {
+            analyzeWindow = ANALYSIS_WINDOW;
+        }
+        else if (arg.compare(0, 10, "--analyze=") == 0) {
+            analyzeWindow = atoll(arg.c_str() + 10);
+            if (analyzeWindow < 0) {
+                cerr << "Error: Working-set window must not be negative" << endl;
+                return 1;
+            }
+        }
+        else if (arg.compare(0, 13, "--checkpoint=") == 0) {
+            checkpointEvery = atoll(arg.c_str() + 13);
+            if (checkpointEvery <= 0) {
+                cerr << "Error: Checkpoint interval must be positive" << endl;
+                return 1;
             }
         }
-        else if (command == "TERMINATE") {
-            int pid;
-            iss >> pid;
-            mmu.terminateProcess(pid);
+        else if (arg.compare(0, 17, "--checkpoint-dir=") == 0) {
+            checkpointDir = arg.substr(17);
+        }
+        else if (arg.compare(0, 9, "--resume=") == 0) {
+            resumePath = arg.substr(9);
         }
-        else if (command == "STATS") {
-            mmu.printStatistics();
+        else if (arg.compare(0, 10, "--stop-at=") == 0) {
+            stopAt = atoll(arg.c_str() + 10);
+            if (stopAt <= 0) {
+                cerr << "Error: --stop-at needs a positive command count" << endl;
+                return 1;
+            }
+        }
+        else if (parseConfigOption(arg, config)) {
+            continue;
         }
-        else if (command == "MEMMAP") {
-            mmu.printMemoryMap();
+        else if (arg.compare(0, 2, "--") == 0) {
+            cerr << "Error: Unknown or invalid option " << arg << endl;
+            return 1;
         }
         else {
-            output << "Unknown command: " << command << "\n";
+            files.push_back(arg);
         }
-        
-        output << "\n";
     }
     
-    output << "\n=== FINAL STATISTICS ===\n";
-    mmu.printStatistics();
-    mmu.printMemoryMap();
+    if (!sweepAxes.empty() && sweepThreads == 0) {
+        cerr << "Error: Lists of option values need --sweep" << endl;
+        return 1;
+    }
     
-    input.close();
-    output.close();
+    string configError = config.validate();
+    if (!configError.empty() && sweepThreads == 0) {
+        cerr << "Error: " << configError << endl;
+        return 1;
+    }
     
-    cout << "Simulation complete. Check output.txt for results.\n";
+    bool checkpointing = checkpointEvery > 0 || !resumePath.empty() || stopAt > 0;
+    if (checkpointing && (config.cpus > 1 || config.scheduler != SCHEDULER_NONE)) {
+        cerr << "Error: Checkpoints need a single CPU running the trace order" << endl;
+        return 1;
+    }
     
-    return 0;
-}
-
-// New main function for CLI execution with backend integration
-int main(int argc, char* argv[]) {
-    if (argc == 1) {
+    if (serve && files.empty()) {
+        if (!socketPath.empty()) {
+            // Daemon mode on a Unix socket: phase2.exe --serve=/tmp/phase2.sock
+            return serveSocket(socketPath.c_str(), jobRunner(config));
+        }
+        // Daemon mode on stdin/stdout: phase2.exe --serve
+        serveStdio(jobRunner(config));
+        return 0;
+    }
+    else if (argc == 1) {
         // No arguments - run original behavior
         return main_original();
     }
-    else if (argc == 3) {
-        // CLI mode: phase2.exe input.txt output.txt
-        ifstream inputFile(argv[1]);
+    else if (convert && files.size() == 2) {
+        // Converter: phase2.exe --convert[=delta] input.txt trace.p2t
+        ifstream inputFile(files[0]);
         if (!inputFile.is_open()) {
-            cerr << "Error: Cannot open input file " << argv[1] << endl;
+            cerr << "Error: Cannot open input file " << files[0] << endl;
             return 1;
         }
         
@@ -562,23 +6120,156 @@ int main(int argc, char* argv[]) {
                       istreambuf_iterator<char>());
         inputFile.close();
         
-        MMU mmu;
-        string result = mmu.executeCommands(content);
+        int skipped;
+        string trace = convertTextTrace(content, deltaEncode, skipped);
+        if (skipped > 0) {
+            cerr << "Warning: Skipped " << skipped << " unknown command(s)" << endl;
+        }
+        
+        ofstream outputFile(files[1], ios::binary);
+        if (!outputFile.is_open()) {
+            cerr << "Error: Cannot open output file " << files[1] << endl;
+            return 1;
+        }
+        
+        outputFile << trace;
+        outputFile.close();
+        
+        return 0;
+    }
+    else if (sweepThreads > 0 && files.size() == 2) {
+        // Sweep: phase2.exe --sweep[=threads] --frames=16,32,64 --policy=fifo,lru input.txt results.txt
+        vector<SweepPoint> points = {SweepPoint{config, ""}};
+        for (auto& axis : sweepAxes) {
+            vector<SweepPoint> expanded;
+            for (const SweepPoint& point : points) {
+                for (const string& value : axis.second) {
+                    SweepPoint next = point;
+                    string option = axis.first + "=" + value;
+                    if (!parseConfigOption(option, next.config)) {
+                        cerr << "Error: Unknown or invalid option " << option << endl;
+                        return 1;
+                    }
+                    next.label += (next.label.empty() ? "" : " ") + option;
+                    expanded.push_back(next);
+                }
+            }
+            points.swap(expanded);
+        }
+        
+        // Combinations that do not fit together are left out of the grid
+        vector<SweepPoint> valid;
+        for (const SweepPoint& point : points) {
+            string error = point.config.validate();
+            if (error.empty()) {
+                valid.push_back(point);
+            } else {
+                cerr << "Warning: Skipping " << point.label << ": " << error << endl;
+            }
+        }
+        if (valid.empty()) {
+            cerr << "Error: No valid configuration to sweep" << endl;
+            return 1;
+        }
+        
+        MappedFile inputFile(files[0]);
+        if (!inputFile.isOpen()) {
+            cerr << "Error: Cannot open input file " << files[0] << endl;
+            return 1;
+        }
+        
+        ofstream outputFile(files[1], config.format == FORMAT_BINARY ? ios::binary : ios::out);
+        if (!outputFile.is_open()) {
+            cerr << "Error: Cannot open output file " << files[1] << endl;
+            return 1;
+        }
+        
+        outputFile << runSweep(inputFile.data(), inputFile.size(), valid, sweepThreads, config.format);
+        outputFile.close();
+        
+        return 0;
+    }
+    else if (analyzeWindow >= 0 && files.size() == 2) {
+        // Analysis: phase2.exe --analyze[=window] input.txt|trace.p2t report.txt
+        MappedFile inputFile(files[0]);
+        if (!inputFile.isOpen()) {
+            cerr << "Error: Cannot open input file " << files[0] << endl;
+            return 1;
+        }
+        
+        ofstream outputFile(files[1], config.format == FORMAT_BINARY ? ios::binary : ios::out);
+        if (!outputFile.is_open()) {
+            cerr << "Error: Cannot open output file " << files[1] << endl;
+            return 1;
+        }
+        
+        TraceAnalyzer analyzer(config, analyzeWindow);
+        outputFile << analyzer.analyze(inputFile.data(), inputFile.size());
+        outputFile.close();
+        
+        return 0;
+    }
+    else if (!serve && files.size() == 2) {
+        // CLI mode: phase2.exe [options] input.txt|trace.p2t output.txt
+        MappedFile inputFile(files[0]);
+        if (!inputFile.isOpen()) {
+            cerr << "Error: Cannot open input file " << files[0] << endl;
+            return 1;
+        }
         
-        ofstream outputFile(argv[2]);
+        ofstream outputFile(files[1], config.format == FORMAT_BINARY ? ios::binary : ios::out);
         if (!outputFile.is_open()) {
-            cerr << "Error: Cannot open output file " << argv[2] << endl;
+            cerr << "Error: Cannot open output file " << files[1] << endl;
             return 1;
         }
         
-        outputFile << result;
+        // Written as it is produced, so memory use does not grow with the trace
+        MMU mmu(config);
+        mmu.setOutputSink([&outputFile](const string& data) {
+            outputFile << data;
+        });
+        if (!resumePath.empty()) {
+            MappedFile checkpoint(resumePath);
+            if (!checkpoint.isOpen()) {
+                cerr << "Error: Cannot open checkpoint " << resumePath << endl;
+                return 1;
+            }
+            string error = mmu.restoreCheckpoint(checkpoint.data(), checkpoint.size());
+            if (!error.empty()) {
+                cerr << "Error: " << resumePath << ": " << error << endl;
+                return 1;
+            }
+        }
+        if (checkpointEvery > 0) {
+            mmu.setCheckpoints(checkpointEvery, [&checkpointDir](long long commands, const string& data) {
+                string path = checkpointDir + "/checkpoint-" + to_string(commands) + ".p2ck";
+                ofstream file(path, ios::binary);
+                file << data;
+                if (!file) {
+                    cerr << "Warning: Cannot write checkpoint " << path << endl;
+                }
+            });
+        }
+        mmu.setStopAt(stopAt);
+        mmu.executeInput(inputFile.data(), inputFile.size());
         outputFile.close();
         
         return 0;
     }
     else {
-        cerr << "Usage: " << argv[0] << " [input_file output_file]" << endl;
+        cerr << "Usage: " << argv[0] << " [options] [input_file output_file | --serve[=socket_path]]" << endl;
+        cerr << "       " << argv[0] << " --convert[=delta] script.txt trace.p2t" << endl;
+        cerr << "       " << argv[0] << " --analyze[=window] [options] input_file report_file" << endl;
+        cerr << "       " << argv[0] << " --sweep[=threads] [options, each may list values: --frames=16,32,64] input_file results_file" << endl;
+        cerr << "Options: --tlb-size=N --tlb-ways=N|direct|full --policy=fifo|lru|clock|nru|lfu|opt" << endl;
+        cerr << "         --verbosity=full|events|summary --format=text|ndjson|binary" << endl;
+        cerr << "         --page-size=BYTES --va-bits=N --page-table=flat|2-level|3-level|4-level|hashed" << endl;
+        cerr << "         --frames=N --allocator=buddy|bitmap --cpus=N --scheduler=none|fcfs|rr|priority|mlfq|cfs --quantum=N" << endl;
+        cerr << "         --swap[=slots] --mem-time=NS --disk-latency=US --disk-bandwidth=MBPS --write-back=N --prefetch=N" << endl;
+        cerr << "         --huge-pages=SIZE[:SIZE...]|none (bytes, or with K, M or G)" << endl;
+        cerr << "         --checkpoint=N --checkpoint-dir=DIR --resume=CHECKPOINT --stop-at=N" << endl;
         cerr << "If no arguments provided, uses default input_phase2.txt" << endl;
         return 1;
     }
-}
\ No newline at end of file
+}
+#endif
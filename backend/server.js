@@ -1,60 +1,224 @@
 const express = require('express');
 const cors = require('cors');
-const { exec } = require('child_process');
+const { spawn } = require('child_process');
+const { PassThrough, Transform } = require('stream');
+const { StringDecoder } = require('string_decoder');
 const fs = require('fs');
 const path = require('path');
 
 const app = express();
-const PORT = 5000;
+const PORT = process.env.PORT || 5000;
 
 // Middleware
 app.use(cors());
-app.use(express.json());
-
-// Utility function to execute C++ programs
-const executeCppProgram = (program, inputContent) => {
-  return new Promise((resolve, reject) => {
-    // Create temporary files
-    const inputFile = `temp_input_${Date.now()}.txt`;
-    const outputFile = `temp_output_${Date.now()}.txt`;
-    
-    console.log(`Executing ${program} with input file: ${inputFile}`);
-    
-    // Write input to temporary file
-    fs.writeFileSync(inputFile, inputContent);
-    
-    // Execute C++ program
-    const command = process.platform === 'win32' ? `${program}.exe` : `./${program}`;
-    exec(`${command} ${inputFile} ${outputFile}`, (error, stdout, stderr) => {
-      if (error) {
-        console.error('Execution error:', error);
-        // Cleanup on error
-        if (fs.existsSync(inputFile)) fs.unlinkSync(inputFile);
-        if (fs.existsSync(outputFile)) fs.unlinkSync(outputFile);
-        reject(`Execution error: ${error.message}`);
-        return;
-      }
-      
-      if (stderr) {
-        console.error('Stderr:', stderr);
-      }
-      
-      // Read output file
-      if (fs.existsSync(outputFile)) {
-        const output = fs.readFileSync(outputFile, 'utf8');
-        console.log(`Execution successful. Output length: ${output.length} characters`);
-        
-        // Cleanup temporary files
-        fs.unlinkSync(inputFile);
-        fs.unlinkSync(outputFile);
-        
-        resolve(output);
+// Traces can be large; their output is streamed back rather than buffered
+app.use(express.json({ limit: '64mb' }));
+
+// Long-lived simulator process speaking the framed job protocol:
+// requests are "<length>\n<payload>", responses are "<length>\n<data>"
+// chunks closed by an empty "0\n" chunk. Jobs are answered in order.
+// Per-job options ride in the request header: "<length> <options>\n".
+// The simulators send a chunk per job (Phase 1) or per 64KB (Phase 2) while
+// running, so a job given a sink stream gets its output as it is produced.
+class SimulatorDaemon {
+  constructor(program, args = []) {
+    this.program = program;
+    this.args = args;
+    this.child = null;
+    this.pending = [];
+    this.buffer = Buffer.alloc(0);
+  }
+
+  start() {
+    const command = process.platform === 'win32' ? `${this.program}.exe` : `./${this.program}`;
+    console.log(`Starting ${this.program} daemon`);
+
+    const child = spawn(command, ['--serve', ...this.args], { stdio: ['pipe', 'pipe', 'inherit'] });
+    this.child = child;
+    this.buffer = Buffer.alloc(0);
+
+    // A process already replaced by a respawn may still report; ignore it
+    child.stdout.on('data', (chunk) => {
+      if (child === this.child) this.onData(chunk);
+    });
+    child.stdin.on('error', (error) => console.error(`${this.program} stdin error:`, error.message));
+    child.on('error', (error) => this.onExit(child, `Execution error: ${error.message}`));
+    child.on('exit', (code, signal) => this.onExit(child, `${this.program} exited (code ${code}, signal ${signal})`));
+  }
+
+  onExit(child, reason) {
+    if (child !== this.child) return;
+    console.error(reason);
+    this.child = null;
+
+    // Fail every job still waiting on the dead process; the next job respawns it
+    const failed = this.pending;
+    this.pending = [];
+    failed.forEach((job) => job.reject(reason));
+  }
+
+  onData(chunk) {
+    this.buffer = this.buffer.length ? Buffer.concat([this.buffer, chunk]) : chunk;
+
+    while (this.pending.length > 0) {
+      const newline = this.buffer.indexOf(0x0a);
+      if (newline === -1) return;
+
+      const length = parseInt(this.buffer.toString('ascii', 0, newline), 10);
+      const end = newline + 1 + length;
+      if (this.buffer.length < end) return;
+
+      const job = this.pending[0];
+      if (length === 0) {
+        this.pending.shift();
+        if (job.sink) {
+          job.sink.end();
+          job.resolve();
+        } else {
+          job.resolve(Buffer.concat(job.chunks));
+        }
       } else {
-        console.error('Output file not found:', outputFile);
-        reject('Output file not found');
+        this.deliver(job, this.buffer.subarray(newline + 1, end));
       }
+      this.buffer = this.buffer.subarray(end);
+    }
+  }
+
+  deliver(job, data) {
+    if (!job.sink) {
+      job.chunks.push(data);
+      return;
+    }
+    // The client went away; drain the rest of the job so later jobs line up
+    if (job.sink.destroyed) return;
+
+    // Stop reading from the simulator until a slow client catches up
+    if (!job.sink.write(data) && this.child) {
+      const stdout = this.child.stdout;
+      const resume = () => {
+        job.sink.off('drain', resume);
+        job.sink.off('close', resume);
+        stdout.resume();
+      };
+      stdout.pause();
+      job.sink.on('drain', resume);
+      job.sink.on('close', resume);
+    }
+  }
+
+  // Resolves with the whole output, or, when a sink stream is given, writes
+  // each chunk to it as it arrives and ends it when the job is done
+  run(inputContent, options = [], sink = null) {
+    return new Promise((resolve, reject) => {
+      if (!this.child) this.start();
+
+      const payload = Buffer.from(inputContent, 'utf8');
+      const header = options.length ? `${payload.length} ${options.join(' ')}` : `${payload.length}`;
+      this.pending.push({ resolve, reject, sink, chunks: [] });
+      this.child.stdin.write(`${header}\n`);
+      this.child.stdin.write(payload);
     });
+  }
+}
+
+const daemons = {
+  // Phase 1 decks hold many independent jobs, run them across all cores
+  phase1: new SimulatorDaemon('phase1', ['--batch']),
+  phase2: new SimulatorDaemon('phase2')
+};
+
+// Output formats the simulators can produce, with the content type each is served as
+const OUTPUT_FORMATS = {
+  text: 'application/json',
+  ndjson: 'application/x-ndjson',
+  binary: 'application/octet-stream'
+};
+
+// JSON-escape UTF-8 text that may arrive split at any byte
+const escapingTransform = (prefix, suffix) => {
+  const decoder = new StringDecoder('utf8');
+  const escape = (text) => JSON.stringify(text).slice(1, -1);
+  const stream = new Transform({
+    transform(chunk, encoding, done) {
+      done(null, escape(decoder.write(chunk)));
+    },
+    flush(done) {
+      done(null, escape(decoder.end()) + suffix);
+    }
   });
+  stream.push(prefix);
+  return stream;
+};
+
+// Server-Sent Events: one "output" event per chunk, then "end"
+const sseTransform = () => {
+  const decoder = new StringDecoder('utf8');
+  return new Transform({
+    transform(chunk, encoding, done) {
+      done(null, `event: output\ndata: ${JSON.stringify(decoder.write(chunk))}\n\n`);
+    },
+    flush(done) {
+      const rest = decoder.end();
+      done(null, (rest ? `event: output\ndata: ${JSON.stringify(rest)}\n\n` : '') + 'event: end\ndata: {}\n\n');
+    }
+  });
+};
+
+// Build the stream the simulator output is written through for a request.
+// Text keeps the original {success, output} JSON envelope, but written
+// incrementally; event streams are sent as-is.
+const createResponseStream = (res, format, sse) => {
+  if (sse) {
+    res.type('text/event-stream');
+    res.set('Cache-Control', 'no-cache');
+    return sseTransform();
+  }
+  res.type(OUTPUT_FORMATS[format]);
+  if (format === 'text') {
+    return escapingTransform('{"success":true,"output":"', '"}');
+  }
+  return new PassThrough();
+};
+
+// Utility function to execute C++ programs, streaming the output to res
+const executeCppProgram = async (program, inputContent, format, res, sse) => {
+  console.log(`Executing ${program} job, input length: ${inputContent.length}, format: ${format}`);
+  const options = format === 'text' ? [] : [`--format=${format}`];
+  const stream = createResponseStream(res, format, sse);
+  stream.pipe(res);
+  res.on('close', () => stream.destroy());
+
+  const started = Date.now();
+  await daemons[program].run(inputContent, options, stream);
+  console.log(`Execution successful in ${Date.now() - started} ms`);
+};
+
+// Phase endpoint: POST { fileContent, format? }. Send "Accept: text/event-stream"
+// to get Server-Sent Events instead of a chunked body.
+const simulationHandler = (program, label) => async (req, res) => {
+  try {
+    const { fileContent, format = 'text' } = req.body;
+    const sse = (req.get('Accept') || '').includes('text/event-stream');
+    
+    if (!fileContent) {
+      return res.status(400).json({ error: 'File content is required' });
+    }
+    if (!OUTPUT_FORMATS[format] || (sse && format === 'binary')) {
+      return res.status(400).json({ error: `Unknown output format: ${format}` });
+    }
+    
+    console.log(`Received ${label} request, content length:`, fileContent.length);
+    await executeCppProgram(program, fileContent, format, res, sse);
+    
+  } catch (error) {
+    console.error(`${label} error:`, error);
+    if (res.headersSent) {
+      // Part of the result is already out; cut the response short
+      res.destroy();
+    } else {
+      res.status(500).json({ error: error.toString() });
+    }
+  }
 };
 
 // Health check endpoint
@@ -78,42 +242,10 @@ app.get('/api/check-executables', (req, res) => {
 });
 
 // Phase 1 endpoint
-app.post('/api/phase1', async (req, res) => {
-  try {
-    const { fileContent } = req.body;
-    
-    if (!fileContent) {
-      return res.status(400).json({ error: 'File content is required' });
-    }
-    
-    console.log('Received Phase 1 request, content length:', fileContent.length);
-    const output = await executeCppProgram('phase1', fileContent);
-    res.json({ success: true, output });
-    
-  } catch (error) {
-    console.error('Phase 1 error:', error);
-    res.status(500).json({ error: error.toString() });
-  }
-});
+app.post('/api/phase1', simulationHandler('phase1', 'Phase 1'));
 
 // Phase 2 endpoint
-app.post('/api/phase2', async (req, res) => {
-  try {
-    const { fileContent } = req.body;
-    
-    if (!fileContent) {
-      return res.status(400).json({ error: 'File content is required' });
-    }
-    
-    console.log('Received Phase 2 request, content length:', fileContent.length);
-    const output = await executeCppProgram('phase2', fileContent);
-    res.json({ success: true, output });
-    
-  } catch (error) {
-    console.error('Phase 2 error:', error);
-    res.status(500).json({ error: error.toString() });
-  }
-});
+app.post('/api/phase2', simulationHandler('phase2', 'Phase 2'));
 
 // Start server
 app.listen(PORT, () => {
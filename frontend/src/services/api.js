@@ -41,4 +41,58 @@ export const executePhase1 = async (fileContent) => {
 // Phase 2 API
 export const executePhase2 = async (fileContent) => {
   return await apiCall('/phase2', { fileContent });
-};
\ No newline at end of file
+};
+
+// Structured event stream (NDJSON), parsed into an array of event objects
+export const executeEvents = async (phase, fileContent) => {
+  const response = await fetch(`${API_BASE_URL}/${phase}`, {
+    method: 'POST',
+    headers: {
+      'Content-Type': 'application/json',
+    },
+    body: JSON.stringify({ fileContent, format: 'ndjson' }),
+  });
+
+  if (!response.ok) {
+    const errorData = await response.json();
+    throw new Error(errorData.error || `HTTP error! status: ${response.status}`);
+  }
+
+  const text = await response.text();
+  return text.split('\n').filter((line) => line).map((line) => JSON.parse(line));
+};
+
+// Stream a simulation as Server-Sent Events, calling onOutput with each piece
+// of text output as the simulator produces it
+export const streamSimulation = async (phase, fileContent, onOutput) => {
+  const response = await fetch(`${API_BASE_URL}/${phase}`, {
+    method: 'POST',
+    headers: {
+      'Content-Type': 'application/json',
+      'Accept': 'text/event-stream',
+    },
+    body: JSON.stringify({ fileContent }),
+  });
+
+  if (!response.ok) {
+    const errorData = await response.json();
+    throw new Error(errorData.error || `HTTP error! status: ${response.status}`);
+  }
+
+  const reader = response.body.pipeThrough(new TextDecoderStream()).getReader();
+  let buffer = '';
+  for (;;) {
+    const { value, done } = await reader.read();
+    if (done) break;
+    buffer += value;
+
+    let end;
+    while ((end = buffer.indexOf('\n\n')) !== -1) {
+      const message = buffer.slice(0, end);
+      buffer = buffer.slice(end + 2);
+      if (message.startsWith('event: output\n')) {
+        onOutput(JSON.parse(message.slice(message.indexOf('data: ') + 6)));
+      }
+    }
+  }
+};